@@ -19,6 +19,8 @@ namespace Average
         inline double value(size_t i) const           { return m_values[i].first;  }
         inline size_t & valueRate(size_t i)           { return m_values[i].second; }
         inline size_t valueRate(size_t i) const       { return m_values[i].second; }
+        // sums counters and averages of load with the same rates
+        inline void accumulate(const Load & other)    { m_count += other.m_count; for (size_t i = 0; i < m_values.size() && i < other.m_values.size(); ++i) m_values[i].first += other.m_values[i].first; }
 
         QByteArray toJSON(const QByteArray & counterName) const;
 
@@ -67,17 +67,26 @@ int main(int argc, char *argv[])
         broker->setMaxFlowPerSecond(QoS::Value_1, options.maxFlowQoS1);
         broker->setMaxFlowPerSecond(QoS::Value_2, options.maxFlowQoS2);
         broker->setBanDuration(options.banDuration, options.banAccumulative);
+        broker->setRoutingCacheSize(options.routingCacheSize);
+        broker->setSharedSubscriptionStrategy(options.sharedStrategy);
 
         QList<ServerPtr> listeners;
         {
             for (auto listener: options.listeners)
             {
-                listeners.append(ServerPtr(new Server(listener.secureMode, QHostAddress(listener.address), listener.port, options.serverName, subProtocols)));
+                listeners.append(ServerPtr(new Server(listener.secureMode, QHostAddress(listener.address), listener.port, options.serverName, subProtocols, listener.ioThreads)));
                 QObject::connect(listeners.last().data(), &Server::cantStartListening, &app, [&] { app.exit(1); }, Qt::QueuedConnection);
 #               ifndef QT_NO_OPENSSL
                 if (SecureMode::Secured == listener.secureMode)
                     listeners.last()->setSslConfiguration(options.ssl);
 #               endif
+                listeners.last()->setWriteDelay(listener.writeDelay);
+                if (listener.writeBufferLimit >= 0)
+                    listeners.last()->setWriteBufferLimit(listener.writeBufferLimit);
+                if (listener.closeTimeout >= 0)
+                    listeners.last()->setCloseTimeout(listener.closeTimeout);
+                if (listener.epollBackend && ConnectionType::TCP == listener.connectionType)
+                    listeners.last()->setBackend(Server::Backend::Epoll);
                 broker->addListener(listeners.last());
                 listeners.last()->start();
             }
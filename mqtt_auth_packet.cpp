@@ -82,7 +82,12 @@ bool AuthPacket::unserialize(const QByteArray & data, Version protocolVersion)
             ++buf; --remaining_length;
 
             bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-            if ( ok) { ok = isPropertiesValid(m_header.props); }
+            if (!ok) {
+                m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                return false;
+            }
+            ok = isPropertiesValid(m_header.props);
             if (!ok) {
                 m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                 m_unserializeReasonString = QStringLiteral("protocol error: invalid auth properties");
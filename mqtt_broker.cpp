@@ -12,6 +12,7 @@
 
 #include <QUuid>
 #include <QTimer>
+#include <algorithm>
 
 #include "logger.h"
 
@@ -46,6 +47,7 @@ Broker::Broker(Store::IFactory * storerFactory, QObject * parent)
     ,subcount(0)
     ,storerFactory(storerFactory)
     ,sessions(new SessionsContainer(storerFactory, this))
+    ,sharedStrategy(SharedStrategy::RoundRobin)
     ,retainPackets(storerFactory->createStorer(QStringLiteral("retained")))
     ,sharedSubscriptionsStorer(storerFactory->createStorer(QStringLiteral("sharedSubscriptions")))
     ,passFile(Q_NULLPTR)
@@ -100,6 +102,7 @@ void Broker::initialize()
 {
     connect(sessions, &SessionsContainer::sessionExpired, this, &Broker::sessionExpired);
     connect(sessions, &SessionsContainer::sessionBeforeDelete, this, &Broker::sessionBeforeDelete);
+    connect(sessions, &SessionsContainer::sessionLoaded, this, &Broker::sessionLoaded);
 
     startPublishStatisticTimer();
 
@@ -120,9 +123,40 @@ void Broker::sessionExpired(Session * session)
 void Broker::sessionBeforeDelete(Session * session)
 {
     statistic->decreaseSubscriptionCount(qint32(session->subscriptions().count()));
+    unindexSessionSubscriptions(session);
     removeSharedSubscriptions(session);
 }
 
+void Broker::sessionLoaded(SessionPtr session)
+{
+    for (SessionSubscriptions::Node * node: session->subscriptions())
+        indexSubscription(session, Topic(node->topic()), &node->data());
+}
+
+void Broker::indexSubscription(const SessionPtr & session, const Topic & topic, SessionSubscriptionData * data)
+{
+    routingCache.invalidate(topic);
+    subscriptionsIndex.provide(topic)->data().add(session, data);
+}
+
+void Broker::unindexSubscription(Session * session, const Topic & topic)
+{
+    routingCache.invalidate(topic);
+    SubscriptionsIndex::Node * node = subscriptionsIndex.findNode(topic);
+    if (node == Q_NULLPTR || !node->isFilter())
+        return;
+    IndexSubscriptionData & data = node->data();
+    data.remove(session);
+    if (data.isEmpty())
+        subscriptionsIndex.remove(node);
+}
+
+void Broker::unindexSessionSubscriptions(Session * session)
+{
+    for (SessionSubscriptions::Node * node: session->subscriptions())
+        unindexSubscription(session, Topic(node->topic()));
+}
+
 void Broker::startPublishStatisticTimer()
 {
     QTimer * timer = new QTimer(this);
@@ -135,6 +169,7 @@ void Broker::publishStatistic()
     publishBrokerInfo();
     publishMqttClientsInfo();
     publishSubscriptionsInfo();
+    publishRoutingCacheInfo();
     publishMqttMessRecvInfo();
     publishMqttMessSentInfo();
     publishMqttMessDropInfo();
@@ -208,27 +243,27 @@ void Broker::storeSharedSubscriptions()
     const quint8 * buf = Q_NULLPTR;
     union { quint8 b; SubscribeOptions o = {}; } options;
 
-    QList<SubscriptionNode*> nodes = sharedSubscriptions.toTopicNodeList();
-    for (SubscriptionNode * node: nodes)
+    for (SharedSubscriptions::Node * node: sharedSubscriptions)
     {
         QByteArray data;
-        SharedSubscriptionData * d = dynamic_cast<SharedSubscriptionData*>(node->data());
-        const SharedConsumersSessionsList & consumers = d->consumers();
+        const SharedConsumersGroups & consumers = node->data().consumers();
         data.append(Encoder::encodeVariableByteInteger(consumers.count()));
         for (auto it = consumers.begin(); it != consumers.end(); ++it) {
             const QString & consumer = it.key();
-            const SharedSubscriptionSessionsList & sessions = it.value();
+            const SharedSubscriptionGroup & group = it.value();
             data.append(Encoder::encodeUTF8(consumer));
-            data.append(Encoder::encodeVariableByteInteger(sessions.count()));
-            for (const SharedSubscriptionSessionData & session_data: sessions) {
-                SessionPtr session = session_data.session.toStrongRef();
-                data.append(Encoder::encodeUTF8(session.isNull() ? QString() : session->clientId()));
-                options.o = session_data.data.options;
-                data.append(reinterpret_cast<const char*>(&options.b), sizeof(options.b));
-                data.append(Encoder::encodeFourByteInteger(session_data.data.identifier));
+            data.append(Encoder::encodeVariableByteInteger(group.count()));
+            for (const SharedSubscriptionMembersList * members: { &group.connected(), &group.disconnected() }) {
+                for (const SharedSubscriptionMember & member: *members) {
+                    SessionPtr session = member.session.toStrongRef();
+                    data.append(Encoder::encodeUTF8(session.isNull() ? QString() : session->clientId()));
+                    options.o = member.data.options;
+                    data.append(reinterpret_cast<const char*>(&options.b), sizeof(options.b));
+                    data.append(Encoder::encodeFourByteInteger(member.data.identifier));
+                }
             }
         }
-        sharedSubscriptionsStorer->store(node->topic(), data.toHex());
+        sharedSubscriptionsStorer->store(node->topic().toString(), data.toHex());
     }
 }
 
@@ -242,9 +277,11 @@ void Broker::loadSharedSubscriptions()
     {
         QString key = sharedSubscriptionsStorer->nextKey();
 
-        SubscriptionNode * node = sharedSubscriptions.provide(Topic(key));
-        if (node->data() == Q_NULLPTR)
-            node->data() = new SharedSubscriptionData();
+        const Topic topic(key);
+        bool created = false;
+        SharedSubscriptions::Node * node = sharedSubscriptions.provide(topic, &created);
+        if (created)
+            routingCache.invalidate(topic);
 
         QByteArray data = QByteArray::fromHex(sharedSubscriptionsStorer->load(key));
         const quint8 * buf = reinterpret_cast<const quint8*>(data.constData());
@@ -260,8 +297,10 @@ void Broker::loadSharedSubscriptions()
                 options.b = *buf;                                                     ++buf; --rl;
                 quint32 identifier = Decoder::decodeFourByteInteger(buf, &rl, &bc);     buf += bc;
                 SessionPtr session = sessions->find(session_client_id);
-                if (!session.isNull())
-                    dynamic_cast<SharedSubscriptionData*>(node->data())->add(consumer_name, session, options.o, identifier);
+                if (!session.isNull()) {
+                    node->data().add(consumer_name, session, options.o, identifier);
+                    addSharedMembership(session.data(), node->topic().toString(), consumer_name);
+                }
                 --sessions_count;
             }
             --consumers_count;
@@ -284,12 +323,11 @@ QString Broker::generateClientId(Version version)
     return id;
 }
 
-SessionSubscriptionData * Broker::selectSubscriptionDataWithMaximumQoS(const SubscriptionNode::List & nodes, std::vector<quint32> & outSubscriptionIdentifiers)
+SessionSubscriptionData * Broker::selectSubscriptionDataWithMaximumQoS(const SessionSubscriptionDataArray & subscriptions, std::vector<quint32> & outSubscriptionIdentifiers)
 {
     QoS max_qos = QoS::Value_0;
     SessionSubscriptionData * result = Q_NULLPTR;
-    for (const auto node: nodes) {
-        SessionSubscriptionData * data = dynamic_cast<SessionSubscriptionData*>(node->data());
+    for (const auto data: subscriptions) {
         if (max_qos != QoS::Value_2 && data->maxQoS() >= max_qos) {
             max_qos = data->maxQoS();
             result = data;
@@ -300,160 +338,96 @@ SessionSubscriptionData * Broker::selectSubscriptionDataWithMaximumQoS(const Sub
     return result;
 }
 
-SharedSubscriptionSessionData selectSharedSubscriptionSessionWithMaxQoS(SharedSubscriptionSessionsList & consumerSessions, bool amongConnected, bool * hasNotConnected)
+const Broker::SharedSubscriptionSessionsArray & Broker::selectSharedSubscriptionSessions(const SharedSubscriptions::List & nodes, const TopicName & topicName, SharedSubscriptions::List & emptyNodes)
 {
-    bool has_not_among_connected = false;
-    Mqtt::QoS max_qos = Mqtt::QoS::Value_0;
-    SessionPtr consumer_session;
-    SubscribeOptions options;
-    quint32 subscription_id = 0;
+    static thread_local SharedSubscriptionSessionsArray matched_sessions;
+    // consumer group with the same name receives message once, even if several its filters match
+    static thread_local std::vector<QString> served_consumers;
+    matched_sessions.clear();
+    served_consumers.clear();
 
-    auto it = consumerSessions.begin();
-    while (it != consumerSessions.end()) {
-        auto & pair = *it;
-        SessionPtr session = pair.session;
-        if (session.isNull()) {
-            it = consumerSessions.erase(it);
-            continue;
-        }
-        if (session->isConnected() == amongConnected) {
-            Mqtt::QoS qos = pair.data.options.maximumQoS();
-            if (qos >= max_qos) {
-                max_qos = qos;
-                consumer_session = session;
-                options = pair.data.options;
-                subscription_id = pair.data.identifier;
+    const uint topic_hash = (SharedStrategy::StickyTopic == sharedStrategy) ? topicName.hash() : 0;
+
+    for (auto node: nodes)
+    {
+        SharedConsumersGroups & consumers = node->data().consumers();
+        auto consumer_it = consumers.begin();
+        while (consumer_it != consumers.end())
+        {
+            SharedSubscriptionGroup & group = *consumer_it;
+            if (group.isEmpty()) {
+                consumer_it = consumers.erase(consumer_it);
+                continue;
             }
-            if (Mqtt::QoS::Value_2 == max_qos)
-                break;
-        } else {
-            has_not_among_connected = true;
+            if (std::find(served_consumers.begin(), served_consumers.end(), consumer_it.key()) == served_consumers.end()) {
+                auto consumer_session = group.select(sharedStrategy, topic_hash);
+                if (!consumer_session.session.isNull()) {
+                    matched_sessions.push_back(consumer_session);
+                    served_consumers.push_back(consumer_it.key());
+                }
+            }
+            ++consumer_it;
         }
-        ++it;
+        if (node->data().isEmpty())
+            emptyNodes.push_back(node);
     }
 
-    if (hasNotConnected != Q_NULLPTR)
-        *hasNotConnected = has_not_among_connected;
-
-    return { consumer_session, { options, subscription_id } };
+    return matched_sessions;
 }
 
-SharedSubscriptionSessionData selectSharedSubscriptionSession(SharedSubscriptionSessionsList & consumerSessions, bool amongConnected, bool * hasNotConnected)
+void Broker::removeSharedSubscriptions(Session * session)
 {
-    bool has_not_among_connected = false;
-    SessionPtr consumer_session;
-    SubscribeOptions options;
-    quint32 subscription_id = 0;
-
-    // cleanup
-    auto it = consumerSessions.begin();
-    while (it != consumerSessions.end()) {
-        SessionPtr session = (*it).session;
-        if (session.isNull()) {
-            it = consumerSessions.erase(it);
-            continue;
-        }
-        ++it;
-    }
+    auto memberships_it = sharedMemberships.find(session);
+    if (memberships_it == sharedMemberships.end())
+        return;
 
-    for (decltype(consumerSessions.size()) i = 0; i < consumerSessions.size(); ++i)
+    for (const SharedSubscriptionMembership & membership: *memberships_it)
     {
-        consumerSessions.selectNext();
-        auto & head = consumerSessions.head();
-        SessionPtr s_ptr = head.session.toStrongRef();
-        if (s_ptr->isConnected() == amongConnected) {
-            consumer_session = head.session.toStrongRef();
-            options = head.data.options;
-            subscription_id = head.data.identifier;
-            break;
-        } else {
-            has_not_among_connected = true;
-        }
+        SharedSubscriptions::Node * node = sharedSubscriptions.findNode(Topic(membership.first));
+        if (node == Q_NULLPTR || !node->isFilter())
+            continue;
+        SharedSubscriptionData * data = &node->data();
+        data->remove(membership.second, session);
+        if (data->isEmpty())
+            removeSharedSubscriptionNode(node);
     }
 
-    if (hasNotConnected != Q_NULLPTR)
-        *hasNotConnected = has_not_among_connected;
-
-    return { consumer_session, { options, subscription_id } };
+    sharedMemberships.erase(memberships_it);
 }
 
-SharedSubscriptionSessionData selectSharedSubscriptionSession(SharedSubscriptionSessionsList & consumerSessions)
+void Broker::addSharedMembership(Session * session, const QString & filter, const QString & consumer)
 {
-    bool has_not_connected = false;
-    // find connected session
-    auto consumer_session = selectSharedSubscriptionSession(consumerSessions, true, &has_not_connected);
-    if (consumer_session.session.isNull() && has_not_connected) {
-        // if not found connected session and there is unconnected session,
-        // find unconnected session for store message and sending message later, when it become possible.
-        consumer_session = selectSharedSubscriptionSession(consumerSessions, false, Q_NULLPTR);
-    }
-    return consumer_session;
+    sharedMemberships[session].insert(qMakePair(filter, consumer));
 }
 
-
-const Broker::SharedSubscriptionSessionsArray & Broker::selectSharedSubscriptionSessions(const SubscriptionNode::List & nodes)
+void Broker::removeSharedMembership(Session * session, const QString & filter, const QString & consumer)
 {
-    static thread_local SharedSubscriptionSessionsArray matched_sessions;
-    matched_sessions.clear();
+    auto memberships_it = sharedMemberships.find(session);
+    if (memberships_it == sharedMemberships.end())
+        return;
+    memberships_it->remove(qMakePair(filter, consumer));
+    if (memberships_it->isEmpty())
+        sharedMemberships.erase(memberships_it);
+}
 
-    SharedConsumersSessionsList matched_consumer_sessions;
+void Broker::setSharedMembershipsConnected(Session * session, bool connected)
+{
+    auto memberships_it = sharedMemberships.constFind(session);
+    if (memberships_it == sharedMemberships.constEnd())
+        return;
 
-    for (auto node: nodes)
+    for (const SharedSubscriptionMembership & membership: *memberships_it)
     {
-        SharedSubscriptionData * data = dynamic_cast<SharedSubscriptionData*>(node->data());
-        auto consumer_it = data->consumers().begin();
-        while (consumer_it != data->consumers().end())
-        {
-            SharedSubscriptionSessionsList & consumer_sessions = *consumer_it;
-            if (consumer_sessions.size() == 0) {
-                consumer_it = data->consumers().erase(consumer_it);
-                continue;
-            }
-            auto consumer_session = selectSharedSubscriptionSession(consumer_sessions);
-            if (!consumer_session.session.isNull()) {
-                matched_consumer_sessions[consumer_it.key()].push_back({ consumer_session.session.toStrongRef(), consumer_session.data });
-            }
-            ++consumer_it;
-        }
-        if (data->isEmpty())
-            sharedSubscriptions.remove(node);
+        SharedSubscriptions::Node * node = sharedSubscriptions.findNode(Topic(membership.first));
+        if (node != Q_NULLPTR && node->isFilter())
+            node->data().setConnected(membership.second, session, connected);
     }
-
-    for (auto & session_list: matched_consumer_sessions) {
-        matched_sessions.push_back((session_list.size() > 1) ? selectSharedSubscriptionSession(session_list) : session_list[0]);
-    }
-
-    return matched_sessions;
 }
 
-void Broker::removeSharedSubscriptions(Session * session)
+void Broker::removeSharedSubscriptionNode(SharedSubscriptions::Node * node)
 {
-    QList<SubscriptionNode*> nodes = sharedSubscriptions.toTopicNodeList();
-    for (SubscriptionNode * node: nodes)
-    {
-        SharedSubscriptionData * data = dynamic_cast<SharedSubscriptionData*>(node->data());
-        auto consumer_it = data->consumers().begin();
-        while (consumer_it != data->consumers().end())
-        {
-            SharedSubscriptionSessionsList & consumer_sessions = *consumer_it;
-            auto it = consumer_sessions.begin();
-            while (it != consumer_sessions.end()) {
-                SessionPtr session_ptr = (*it).session;
-                if (session_ptr.isNull() || session_ptr.data() == session) {
-                    it = consumer_sessions.erase(it);
-                    continue;
-                }
-                ++it;
-            }
-            if (consumer_sessions.size() == 0) {
-                consumer_it = data->consumers().erase(consumer_it);
-                continue;
-            }
-            ++consumer_it;
-        }
-        if (data->isEmpty())
-            sharedSubscriptions.remove(node);
-    }
+    routingCache.invalidate(Topic(node->topic()));
+    sharedSubscriptions.remove(node);
 }
 
 void Broker::publish(const QString & fromClientId, const Topic & topic, const PublishPacket & packet)
@@ -461,11 +435,19 @@ void Broker::publish(const QString & fromClientId, const Topic & topic, const Pu
     static thread_local SubscriptionIdentifiersArray subscription_identifiers;
 
     if (packet.isRetained())
-        retainPackets.add(packet.topicName(), fromClientId, packet);
+        retainPackets.add(packet.topic().toString(), fromClientId, packet);
+
+    RoutingCacheEntry * route = routingCache.find(packet.topic());
+    if (route == Q_NULLPTR)
+        route = resolveRoute(packet.topic(), topic);
 
-    if (sharedSubscriptions.has(topic))
+    publishFrames.begin(&packet);
+
+    // shared subscribers are served first, as before routing cache
+    SharedSubscriptions::List empty_shared_nodes;
+    if (!route->shared.empty())
     {
-        auto & array = selectSharedSubscriptionSessions(sharedSubscriptions.nodes());
+        auto & array = selectSharedSubscriptionSessions(route->shared, packet.topic(), empty_shared_nodes);
         for (auto & pair: array) {
             if (SessionPtr s_ptr = pair.session.toStrongRef()) {
                 subscription_identifiers.clear();
@@ -476,20 +458,73 @@ void Broker::publish(const QString & fromClientId, const Topic & topic, const Pu
         }
     }
 
-    for (auto s_ptr : *sessions)
+    for (auto & subscriber: route->subscribers) {
+        if (SessionPtr s_ptr = subscriber.session.toStrongRef()) {
+            if (!(subscriber.options.noLocal() && fromClientId == s_ptr->clientId()))
+                processPublishPacket(s_ptr, packet, subscriber.options, subscriber.identifiers);
+        }
+    }
+
+    // removal of shared node invalidates cached route, so it is done when route is not used anymore
+    for (auto node: empty_shared_nodes)
+        removeSharedSubscriptionNode(node);
+
+    publishFrames.end();
+}
+
+RoutingCacheEntry * Broker::resolveRoute(const TopicName & topicName, const Topic & topic)
+{
+    typedef std::vector<std::pair<Session*, const SubscriberData*>> MatchedSubscribersArray;
+
+    static thread_local SessionSubscriptionDataArray session_subscriptions;
+    static thread_local MatchedSubscribersArray matched;
+
+    RoutingCacheEntry * route = routingCache.insert(topicName, topic);
+
+    SharedSubscriptions::Matches shared_nodes;
+    if (sharedSubscriptions.match(topic, shared_nodes) != 0)
+        route->shared.assign(shared_nodes.begin(), shared_nodes.end());
+
+    SubscriptionsIndex::Matches nodes;
+    if (subscriptionsIndex.match(topic, nodes) == 0)
+        return route;
+
+    matched.clear();
+
+    for (auto node: nodes) {
+        const IndexSubscriptionData & data = node->data();
+        for (auto it = data.subscribers().constBegin(); it != data.subscribers().constEnd(); ++it)
+            matched.push_back({ it.key(), &it.value() });
+    }
+
+    // session may be subscribed by several matching topic filters, keep them side by side
+    if (nodes.size() > 1) {
+        std::stable_sort(matched.begin(), matched.end(),
+                         [] (const MatchedSubscribersArray::value_type & l, const MatchedSubscribersArray::value_type & r) -> bool
+        { return l.first < r.first; });
+    }
+
+    auto it = matched.begin();
+    while (it != matched.end())
     {
-        if (s_ptr.isNull())
-            continue;
-        Session * session = s_ptr.data();
-        if (!session->subscriptions().has(topic))
-            continue;
-        subscription_identifiers.clear();
+        auto group_end = it + 1;
+        while (group_end != matched.end() && group_end->first == it->first)
+            ++group_end;
+
+        session_subscriptions.clear();
+        for (auto g_it = it; g_it != group_end; ++g_it)
+            session_subscriptions.push_back(g_it->second->data);
+
+        RoutingCacheEntry::Subscriber subscriber;
+        subscriber.session = it->second->session;
         // In this case the Server MUST deliver the message to the Client respecting the maximum QoS of all the matching subscriptions
-        SessionSubscriptionData * data = selectSubscriptionDataWithMaximumQoS(session->subscriptions().nodes(), subscription_identifiers);
-        if (data->options().noLocal() && fromClientId == session->clientId())
-            continue;
-        processPublishPacket(s_ptr, packet, data->options(), subscription_identifiers);
+        subscriber.options = selectSubscriptionDataWithMaximumQoS(session_subscriptions, subscriber.identifiers)->options();
+        route->subscribers.push_back(std::move(subscriber));
+
+        it = group_end;
     }
+
+    return route;
 }
 
 void Broker::publishWill(const ConnectPacket & connectPacket, bool immediately)
@@ -503,7 +538,7 @@ void Broker::publishWill(const ConnectPacket & connectPacket, bool immediately)
 
     if (immediately)
     {
-        const Topic topic(packet.topicName());
+        const Topic topic(packet.topic());
         if (topic.isValidForPublish())
             publish(connectPacket.clientId(), topic, packet);
     }
@@ -516,7 +551,7 @@ void Broker::publishWill(const ConnectPacket & connectPacket, bool immediately)
     }
 }
 
-void Broker::publishRetainedPackets(SessionPtr & session, const SubscriptionNode::List & newSubscriptions)
+void Broker::publishRetainedPackets(SessionPtr & session, const SessionSubscriptions::List & newSubscriptions)
 {
     static thread_local SubscriptionIdentifiersArray subscription_identifiers;
 
@@ -532,11 +567,11 @@ void Broker::publishRetainedPackets(SessionPtr & session, const SubscriptionNode
             continue;
         }
 
-        const Topic topic(it.key());
+        const TopicPath & topic = retainPackets.topicPath(it.key());
 
         for (auto node: newSubscriptions)
         {
-            SessionSubscriptionData * data = dynamic_cast<SessionSubscriptionData*>(node->data());
+            SessionSubscriptionData * data = &node->data();
             if ((SubscribeOptions::RetainHandling::NotSendAtSubscribe == data->options().retainHandlingType())
                  || (SubscribeOptions::RetainHandling::SendAtSubscribeForNewSubscription == data->options().retainHandlingType() && !data->isNew())
                     || (data->options().noLocal() && unit.clientId() == session->clientId()))
@@ -565,41 +600,44 @@ void Broker::processPublishPacket(SessionPtr & session, const PublishPacket & so
 {
     ++subcount;
 
-    PublishPacket packet = sourcePacket;
-
-    if (identifiers.size() > 0) {
-        packet.properties().detach();
-        for (auto id: identifiers)
-            packet.properties().append({ PropertyId::SubscriptionIdentifier, id });
-    }
+    // source is shared by all subscribers, their options are applied when it is encoded
+    PublishDelivery delivery(sourcePacket);
+    delivery.identifiers = &identifiers;
 
     if (!subscribeOptions.retainAsPublished())
-        packet.setRetain(false);
+        delivery.retain = false;
 
-    if (packet.QoS() > subscribeOptions.maximumQoS())
-        packet.setQoS(subscribeOptions.maximumQoS());
+    if (delivery.qos > subscribeOptions.maximumQoS())
+        delivery.qos = subscribeOptions.maximumQoS();
+
+    // subscribers of the same message with equal options share encoded frame
+    const bool fanout = publishFrames.isBoundTo(&sourcePacket);
 
     if ((session->isConnected() || !session->isClean())
-            && packet.QoS() != QoS::Value_0)
-        session->addPendingPacket(packet);
+            && delivery.qos != QoS::Value_0) {
+        if (fanout && session->isConnected())
+            session->addPendingPacket(sourcePacket, delivery, session->protocolVersion(), publishFrames.frame(sourcePacket, delivery, session->protocolVersion()));
+        else
+            session->addPendingPacket(sourcePacket, delivery);
+    }
 
     if (!session->isConnected()) {
         if (!session->isClean()) {
-            if (QoS::Value_0 == packet.QoS() && isQoS0OfflineEnabled()
-                    && !packet.topicName().startsWith(QStringLiteral(u"$SYS/")))
-                session->addPendingPacket(packet);
+            if (QoS::Value_0 == delivery.qos && isQoS0OfflineEnabled()
+                    && !sourcePacket.topic().startsWith("$SYS/"))
+                session->addPendingPacket(sourcePacket, delivery);
         }
         return;
     }
 
-    if (QoS::Value_0 == packet.QoS())
+    if (QoS::Value_0 == delivery.qos)
     {
-        QByteArray data = packet.serialize(session->protocolVersion());
+        QByteArray data = fanout ? publishFrames.frame(sourcePacket, delivery, session->protocolVersion())
+                                 : session->codec().serializeDelivery(sourcePacket, delivery);
         bool can_send = (data.size() <= session->maxPacketSize());
         if (!can_send) {
-            if (session->processClientAlias(packet)) {
-                packet.setTopicName(QString());
-                data = packet.serialize(session->protocolVersion());
+            if (session->processClientAlias(sourcePacket.topic(), &delivery.topicAlias)) {
+                data = session->codec().serializeDelivery(sourcePacket, delivery);
                 can_send = (data.size() <= session->maxPacketSize());
             }
             if (!can_send) {
@@ -657,14 +695,17 @@ void Broker::publishPendingPackets(SessionPtr & session)
             default: break;
         }
 
-        QByteArray data = unit->packet().serialize(session->protocolVersion());
+        QByteArray data = unit->frame(session->protocolVersion());
+        if (!data.isEmpty())
+            PublishFrameCache::setPacketId(data, id, unit->packet().isDuplicate());
+        else
+            data = session->codec().serializePublish(unit->packet());
         bool can_send = (data.size() <= session->maxPacketSize());
         if (!can_send)
         {
-            PublishPacket packet = unit->packet();
-            if (session->processClientAlias(packet)) {
-                packet.setTopicName(QString());
-                data = packet.serialize(session->protocolVersion());
+            PublishDelivery delivery(unit->packet());
+            if (session->processClientAlias(unit->packet().topic(), &delivery.topicAlias)) {
+                data = session->codec().serializeDelivery(unit->packet(), delivery);
                 can_send = (data.size() <= session->maxPacketSize());
             }
             if (!can_send) {
@@ -696,7 +737,7 @@ void Broker::executePublishWill(const QString & clientId, const PublishPacket &
             return;
         }
     }
-    Topic topic(packet.topicName());
+    Topic topic(packet.topic());
     if (topic.isValidForPublish()) {
         publish(clientId, topic, packet);
         log_note << "client" << clientId << "will message has been published" << end_log;
@@ -726,6 +767,7 @@ void Broker::handleCloseConnection(quintptr connectionId)
         sessions->store(session);
         log_note << session->connection() << "mqtt client" << session->clientId() << "DISCONNECTED" << end_log;
         session->clearConnection();
+        setSharedMembershipsConnected(session.data(), false);
         if (session->isClean())
             sessions->remove(session->clientId());
     }
@@ -743,11 +785,13 @@ void Broker::handleNetworkData(quintptr connectionId, const QByteArray & data)
 {
     if (SessionPtr session = sessions->find(connectionId, SessionsContainer::Placing::AmongConneted))
     {
+        // packets reference receive buffers, PUBLISH keeps buffer instead of copying payload
+        ChunkDataController::FrameArray frames;
         session->dataController().append(data);
-        while (session->dataController().packetAvailable()) {
-            QByteArray packet = session->dataController().takePacket();
+        session->dataController().takePackets(frames);
+        for (const ChunkDataController::Frame & frame: frames) {
             if (!session->isBanned())
-                handleControlPacket(session, packet);
+                handleControlPacket(session, frame.data, frame.buffer);
         }
         session->restartElapsed();
         return;
@@ -755,7 +799,7 @@ void Broker::handleNetworkData(quintptr connectionId, const QByteArray & data)
     statistic->increaseDroppedMessages();
 }
 
-void Broker::handleControlPacket(SessionPtr & session, const QByteArray & data)
+void Broker::handleControlPacket(SessionPtr & session, const QByteArray & data, const QByteArray & buffer)
 {
     Mqtt::PacketType type = Mqtt::ControlPacket::extractType(data);
 
@@ -779,7 +823,7 @@ void Broker::handleControlPacket(SessionPtr & session, const QByteArray & data)
         case Mqtt::PacketType::PUBLISH:
         {
             subcount = 0;
-            handlePublishPacket(session, data);
+            handlePublishPacket(session, data, buffer);
             if (subcount == 0)
                 statistic->increaseDroppedPublishMessages();
             return;
@@ -932,6 +976,7 @@ void Broker::sendConnackSuccess(SessionPtr & session)
 void Broker::finalizeSuccessfulConnect(SessionPtr & session)
 {
     sessions->insert(session->clientId(), session);
+    setSharedMembershipsConnected(session.data(), true);
     sendConnackSuccess(session);
     updateClientsStatistic();
     publishPendingPackets(session);
@@ -1022,17 +1067,17 @@ void Broker::handlePingRequestPacket(SessionPtr & session, const QByteArray & da
     }
 }
 
-void Broker::handlePublishPacket(SessionPtr & session, const QByteArray & data)
+void Broker::handlePublishPacket(SessionPtr & session, const QByteArray & data, const QByteArray & buffer)
 {
     statistic->increasePublishMessages();
 
     PublishPacket packet;
 
-    if (packet.unserialize(data, session->protocolVersion()))
+    if (session->codec().unserializePublish(packet, data, buffer))
     {
         log_trace << session->connection() << "packet" << packet.type() << "unserialized succesfully" << end_log;
 
-        const Topic topic(packet.topicName());
+        const Topic topic(packet.topic());
 
         if (topic.isValidForPublish())
         {
@@ -1073,7 +1118,7 @@ void Broker::handlePublishPacket(SessionPtr & session, const QByteArray & data)
                     PublishAckPacket puback;
                     puback.setPacketId(packet.packetId());
                     puback.setReasonCode(subcount == 0 ? ReasonCodeV5::NoMatchingSubscribers : ReasonCodeV5::Success);
-                    QByteArray data = puback.serialize(session->protocolVersion(), session->maxPacketSize());
+                    QByteArray data = session->codec().serializePublishAnswer(puback, session->maxPacketSize());
                     session->connection().write(data);
                     statistic->increaseSentMessages();
                     return;
@@ -1090,7 +1135,7 @@ void Broker::handlePublishPacket(SessionPtr & session, const QByteArray & data)
                         pubrec.setReasonCode(ReasonCodeV5::PacketIdentifierInUse);
                         if (session->protocolVersion() < Version::Ver_5_0) { break; /* close connection */ }
                     }
-                    QByteArray data = pubrec.serialize(session->protocolVersion(), session->maxPacketSize());
+                    QByteArray data = session->codec().serializePublishAnswer(pubrec, session->maxPacketSize());
                     session->connection().write(data);
                     statistic->increaseSentMessages();
                     return;
@@ -1111,7 +1156,7 @@ void Broker::handlePubAckPacket(SessionPtr & session, const QByteArray & data)
 {
     const Network::ServerClient & conn = session->connection();
     PublishAckPacket packet;
-    if (packet.unserialize(data, session->protocolVersion())) {
+    if (session->codec().unserializePublishAnswer(packet, data)) {
         log_trace << conn << "packet" << packet.type() << "unserialized succesfully" << end_log;
         session->packetDelivered(packet.packetId(), packet.reasonCode(), true);
         publishPendingPackets(session);
@@ -1124,7 +1169,7 @@ void Broker::handlePubAckPacket(SessionPtr & session, const QByteArray & data)
 void Broker::handlePubRecPacket(SessionPtr & session, const QByteArray & data)
 {
     PublishRecPacket packet;
-    if (packet.unserialize(data, session->protocolVersion())) {
+    if (session->codec().unserializePublishAnswer(packet, data)) {
         log_trace << session->connection() << "packet" << packet.type() << "unserialized succesfully" << end_log;
         session->packetDelivered(packet.packetId(), packet.reasonCode(), false);
         if (packet.reasonCode() >= ReasonCodeV5::UnspecifiedError) {
@@ -1134,7 +1179,7 @@ void Broker::handlePubRecPacket(SessionPtr & session, const QByteArray & data)
             PublishRelPacket pubrel;
             pubrel.setPacketId(packet.packetId());
             pubrel.setReasonCode(ReasonCodeV5::Success);
-            QByteArray data = pubrel.serialize(session->protocolVersion(), session->maxPacketSize());
+            QByteArray data = session->codec().serializePublishAnswer(pubrel, session->maxPacketSize());
             session->connection().write(data);
             statistic->increaseSentMessages();
             return;
@@ -1147,13 +1192,13 @@ void Broker::handlePubRecPacket(SessionPtr & session, const QByteArray & data)
 void Broker::handlePubRelPacket(SessionPtr & session, const QByteArray & data)
 {
     PublishRelPacket packet;
-    if (packet.unserialize(data, session->protocolVersion())) {
+    if (session->codec().unserializePublishAnswer(packet, data)) {
         log_trace << session->connection() << "packet" << packet.type() << "unserialized succesfully" << end_log;
         session->freePacketId(packet.packetId());
         PublishCompPacket pubcomp;
         pubcomp.setPacketId(packet.packetId());
         pubcomp.setReasonCode(ReasonCodeV5::Success);
-        QByteArray data = pubcomp.serialize(session->protocolVersion(), session->maxPacketSize());
+        QByteArray data = session->codec().serializePublishAnswer(pubcomp, session->maxPacketSize());
         session->connection().write(data);
         statistic->increaseSentMessages();
         return;
@@ -1165,7 +1210,7 @@ void Broker::handlePubRelPacket(SessionPtr & session, const QByteArray & data)
 void Broker::handlePubCompPacket(SessionPtr & session, const QByteArray & data)
 {
     PublishCompPacket packet;
-    if (packet.unserialize(data, session->protocolVersion())) {
+    if (session->codec().unserializePublishAnswer(packet, data)) {
         log_trace << session->connection() << "packet" << packet.type() << "unserialized succesfully" << end_log;
         session->freePacketId(packet.packetId());
         publishPendingPackets(session);
@@ -1241,7 +1286,7 @@ void Broker::handleSubscribePacket(SessionPtr & session, const QByteArray & data
     SubscribeAckPacket suback;
     suback.setPacketId(packet.packetId());
 
-    static thread_local SubscriptionNode::List new_nodes;
+    static thread_local SessionSubscriptions::List new_nodes;
     new_nodes.clear();
     new_nodes.reserve(packet.topics().count());
 
@@ -1257,12 +1302,15 @@ void Broker::handleSubscribePacket(SessionPtr & session, const QByteArray & data
             {
                 case Topic::All:
                 case Topic::System: {
-                    auto node = session->subscriptions().provide(topic);
-                    SessionSubscriptionData * data = dynamic_cast<SessionSubscriptionData*>(node->data());
-                    if (data == Q_NULLPTR) {
-                        node->data() = data = new SessionSubscriptionData();
+                    bool created = false;
+                    auto node = session->subscriptions().provide(topic, &created);
+                    SessionSubscriptionData * data = &node->data();
+                    if (created) {
+                        indexSubscription(session, topic, data);
                         statistic->increaseSubscriptionCount();
                     } else {
+                        // cached routes keep options of subscription
+                        routingCache.invalidate(topic);
                         data->setNew(false);
                     }
                     data->setOptions(options);
@@ -1273,10 +1321,12 @@ void Broker::handleSubscribePacket(SessionPtr & session, const QByteArray & data
                 case Topic::Shared: {
                     // No Retained Messages are sent to the Session when it first subscribes.
                     // It will be sent other matching messages as they are published.
-                    auto node = sharedSubscriptions.provide(topic);
-                    if (node->data() == Q_NULLPTR)
-                        node->data() = new SharedSubscriptionData();
-                    dynamic_cast<SharedSubscriptionData*>(node->data())->add(topic.consumer(), session, options, sub_id);
+                    bool created = false;
+                    auto node = sharedSubscriptions.provide(topic, &created);
+                    if (created)
+                        routingCache.invalidate(topic);
+                    node->data().add(topic.consumer(), session, options, sub_id);
+                    addSharedMembership(session.data(), node->topic().toString(), topic.consumer());
                     storeSharedSubscriptions();
                     break;
                 }
@@ -1325,6 +1375,7 @@ void Broker::handleUnsubscribePacket(SessionPtr & session, const QByteArray & da
                     case Topic::System: {
                         auto node = session->subscriptions().findNode(topic);
                         if (node != Q_NULLPTR) {
+                            unindexSubscription(session.data(), topic);
                             session->subscriptions().remove(node);
                             unsuback.returnCodes().append(ReasonCodeV5::Success);
                             statistic->decreaseSubscriptionCount();
@@ -1334,13 +1385,14 @@ void Broker::handleUnsubscribePacket(SessionPtr & session, const QByteArray & da
                         break;
                     }
                     case Topic::Shared: {
-                        SubscriptionNode * node = sharedSubscriptions.findNode(topic);
-                        if (node != Q_NULLPTR) {
-                            SharedSubscriptionData * data = dynamic_cast<SharedSubscriptionData*>(node->data());
-                            int count = data->remove(topic.consumer(), session);
+                        SharedSubscriptions::Node * node = sharedSubscriptions.findNode(topic);
+                        if (node != Q_NULLPTR && node->isFilter()) {
+                            SharedSubscriptionData * data = &node->data();
+                            int count = data->remove(topic.consumer(), session.data());
+                            removeSharedMembership(session.data(), node->topic().toString(), topic.consumer());
                             unsuback.returnCodes().append(count > 0 ? ReasonCodeV5::Success : ReasonCodeV5::NoSubscriptionExisted);
                             if (data->isEmpty())
-                                sharedSubscriptions.remove(node);
+                                removeSharedSubscriptionNode(node);
                         }
                         break;
                     }
@@ -1380,6 +1432,7 @@ void Broker::sendDisconnect(SessionPtr & session, ReasonCodeV5 reason)
 #define TopicSysBroker                QStringLiteral(u"$SYS/broker")
 #define TopicSysMqttClients           QStringLiteral(u"$SYS/broker/mqtt/clients")
 #define TopicSysMqttSubscriptions     QStringLiteral(u"$SYS/broker/mqtt/subscriptions")
+#define TopicSysMqttRoutingCache      QStringLiteral(u"$SYS/broker/mqtt/routing/cache")
 #define TopicSysMqttMessagesAllRecv   QStringLiteral(u"$SYS/broker/mqtt/all/received")
 #define TopicSysMqttMessagesAllSent   QStringLiteral(u"$SYS/broker/mqtt/all/sent")
 #define TopicSysMqttMessagesAllDrop   QStringLiteral(u"$SYS/broker/mqtt/all/dropped")
@@ -1390,10 +1443,12 @@ void Broker::sendDisconnect(SessionPtr & session, ReasonCodeV5 reason)
 
 #define BytesStatisticName            QByteArrayLiteral("bytes")
 #define MessagesStatisticName         QByteArrayLiteral("messages")
+#define WritesStatisticName           QByteArrayLiteral("writes")
 
 void Broker::publishBrokerInfo()          { publishSystemPacket(TopicSysBroker             , makeBrokerInfoPayload());        }
 void Broker::publishMqttClientsInfo()     { publishSystemPacket(TopicSysMqttClients        , makeMqttClientsInfoPayload());   }
 void Broker::publishSubscriptionsInfo()   { publishSystemPacket(TopicSysMqttSubscriptions  , makeSubscriptionsInfoPayload()); }
+void Broker::publishRoutingCacheInfo()    { publishSystemPacket(TopicSysMqttRoutingCache   , makeRoutingCacheInfoPayload());  }
 
 void Broker::publishMqttMessRecvInfo()    { publishSystemPacket(TopicSysMqttMessagesAllRecv, statistic->allmessages.received.load().toJSON(MessagesStatisticName)); }
 void Broker::publishMqttMessSentInfo()    { publishSystemPacket(TopicSysMqttMessagesAllSent, statistic->allmessages.sent.load()    .toJSON(MessagesStatisticName)); }
@@ -1404,7 +1459,7 @@ void Broker::publishMqttPublishDropInfo() { publishSystemPacket(TopicSysMqttMess
 
 void Broker::publishNetworkLoadInfo()     { publishSystemPacket(TopicSysNetworkLoad        , makeNetworkLoadInfoPayload());   }
 
-void Broker::publishSystemPackets(SessionPtr & session, const SubscriptionNode::List & newSubscriptions)
+void Broker::publishSystemPackets(SessionPtr & session, const SessionSubscriptions::List & newSubscriptions)
 {
     static thread_local SubscriptionIdentifiersArray subscription_identifiers;
 
@@ -1413,7 +1468,7 @@ void Broker::publishSystemPackets(SessionPtr & session, const SubscriptionNode::
         for (auto node: newSubscriptions)
         {
             if (node->matchesWith(topic)) {
-                SessionSubscriptionData * data = dynamic_cast<SessionSubscriptionData*>(node->data());
+                const SessionSubscriptionData * data = &node->data();
                 subscription_identifiers.clear();
                 if (data->identifier() != 0)
                     subscription_identifiers.push_back(data->identifier());
@@ -1425,6 +1480,7 @@ void Broker::publishSystemPackets(SessionPtr & session, const SubscriptionNode::
     publishSystemInfo(TopicSysBroker             , std::bind(&Broker::makeBrokerInfoPayload         , this));
     publishSystemInfo(TopicSysMqttClients        , std::bind(&Broker::makeMqttClientsInfoPayload    , this));
     publishSystemInfo(TopicSysMqttSubscriptions  , std::bind(&Broker::makeSubscriptionsInfoPayload  , this));
+    publishSystemInfo(TopicSysMqttRoutingCache   , std::bind(&Broker::makeRoutingCacheInfoPayload   , this));
 
     publishSystemInfo(TopicSysMqttMessagesAllRecv, std::bind(&Average::Load::toJSON, &statistic->allmessages.received.load(), MessagesStatisticName));
     publishSystemInfo(TopicSysMqttMessagesAllSent, std::bind(&Average::Load::toJSON, &statistic->allmessages.sent.load()    , MessagesStatisticName));
@@ -1439,6 +1495,7 @@ void Broker::publishSystemPackets(SessionPtr & session, const SubscriptionNode::
 #undef TopicSysBroker
 #undef TopicSysMqttClients
 #undef TopicSysMqttSubscriptions
+#undef TopicSysMqttRoutingCache
 #undef TopicSysMqttMessagesAllRecv
 #undef TopicSysMqttMessagesAllSent
 #undef TopicSysMqttMessagesPubRecv
@@ -1459,7 +1516,7 @@ PublishPacket Broker::makeSystemInfoPacket(const QString & topic, const QByteArr
 void Broker::publishSystemPacket(const QString & t, const QByteArray & payload)
 {
     PublishPacket packet = makeSystemInfoPacket(t, payload);
-    Topic topic(packet.topicName());
+    Topic topic(packet.topic());
     publish(QString(), topic, packet);
 }
 
@@ -1545,6 +1602,23 @@ QByteArray Broker::makeSubscriptionsInfoPayload() const
     return payload;
 }
 
+QByteArray Broker::makeRoutingCacheInfoPayload() const
+{
+    QByteArray payload;
+    payload.reserve(100);
+    payload.append('{');
+    payload.append("\"capacity\":");
+    payload.append(QByteArray::number(routingCache.capacity()));
+    payload.append(",\"count\":");
+    payload.append(QByteArray::number(routingCache.count()));
+    payload.append(",\"hits\":");
+    payload.append(QByteArray::number(routingCache.hits()));
+    payload.append(",\"misses\":");
+    payload.append(QByteArray::number(routingCache.misses()));
+    payload.append('}');
+    return payload;
+}
+
 QByteArray Broker::makeNetworkLoadInfoPayload() const
 {
     QByteArray payload;
@@ -1560,6 +1634,7 @@ QByteArray Broker::makeNetworkLoadInfoPayload() const
             Network::Server * server = s_ptr.data();
             Average::Load recv = server->receivedStats();
             Average::Load sent = server->sentStats();
+            Average::Load writes = server->writesStats();
             const char * type = Network::secureModeCStr(server->secureMode());
             if (it != listeners.begin())
                 payload.append(',');
@@ -1573,6 +1648,9 @@ QByteArray Broker::makeNetworkLoadInfoPayload() const
                 payload.append(',');
                 payload.append("\"sent\":");
                     payload.append(sent.toJSON(BytesStatisticName));
+                payload.append(',');
+                payload.append("\"writes\":");
+                    payload.append(writes.toJSON(WritesStatisticName));
             payload.append('}');
         }
         ++it;
@@ -1584,3 +1662,4 @@ QByteArray Broker::makeNetworkLoadInfoPayload() const
 
 #undef BytesStatisticName
 #undef MessagesStatisticName
+#undef WritesStatisticName
@@ -5,6 +5,9 @@
 #include "mqtt_sessions_container.h"
 #include "mqtt_chunk_data_controller.h"
 #include "mqtt_subscriptions_shared.h"
+#include "mqtt_subscriptions_index.h"
+#include "mqtt_routing_cache.h"
+#include "mqtt_publish_frame_cache.h"
 #include "mqtt_store_publish_container.h"
 #include "mqtt_storer_factory_interface.h"
 #include "mqtt_statistic.h"
@@ -17,7 +20,7 @@ namespace Mqtt
     class PasswordFile;
     class PublishPacket;
 
-    typedef std::vector<quint32> SubscriptionIdentifiersArray;
+    typedef std::vector<SessionSubscriptionData*> SessionSubscriptionDataArray;
 
     class Broker: public QObject
     {
@@ -49,16 +52,20 @@ namespace Mqtt
         quint32 maxFlowPerSecond(QoS qos) const;
         void setMaxFlowPerSecond(QoS qos, quint32 messagesCount);
         void setBanDuration(quint32 seconds, bool accumulative);
+        int routingCacheSize() const;
+        void setRoutingCacheSize(int topicsCount);
+        SharedStrategy sharedSubscriptionStrategy() const;
+        void setSharedSubscriptionStrategy(SharedStrategy strategy);
         bool setPasswordFile(const QString & filePath);
         PasswordFile * passwordFile();
         void addListener(Network::ServerPtr listener);
 
     private:
-        void handleControlPacket(SessionPtr & session, const QByteArray & data);
+        void handleControlPacket(SessionPtr & session, const QByteArray & data, const QByteArray & buffer);
         void handleConnectPacket(SessionPtr & session, const QByteArray & data);
         void handleAuthPacket(SessionPtr & session, const QByteArray & data);
         void handlePingRequestPacket(SessionPtr & session, const QByteArray & data);
-        void handlePublishPacket(SessionPtr & session, const QByteArray & data);
+        void handlePublishPacket(SessionPtr & session, const QByteArray & data, const QByteArray & buffer);
         void handlePubAckPacket(SessionPtr & session, const QByteArray & data);
         void handlePubRecPacket(SessionPtr & session, const QByteArray & data);
         void handlePubRelPacket(SessionPtr & session, const QByteArray & data);
@@ -76,11 +83,12 @@ namespace Mqtt
         void sendDisconnect(SessionPtr & session, ReasonCodeV5 reason);
 
         void publish(const QString & fromClientId, const Topic & topic, const PublishPacket & packet);
+        RoutingCacheEntry * resolveRoute(const TopicName & topicName, const Topic & topic);
         void publishWill(const ConnectPacket & connectPacket, bool immediately = false);
         void executePublishWill(const QString & clientId, const PublishPacket & packet);
 
-        void publishRetainedPackets(SessionPtr & session, const SubscriptionNode::List & newSubscriptions);
-        void publishSystemPackets(SessionPtr & session, const SubscriptionNode::List & newSubscriptions);
+        void publishRetainedPackets(SessionPtr & session, const SessionSubscriptions::List & newSubscriptions);
+        void publishSystemPackets(SessionPtr & session, const SessionSubscriptions::List & newSubscriptions);
         void processPublishPacket(SessionPtr & session, const PublishPacket & sourcePacket, SubscribeOptions subscribeOptions, const SubscriptionIdentifiersArray & identifiers);
         void publishPendingPackets(SessionPtr & session);
 
@@ -88,6 +96,11 @@ namespace Mqtt
         void publishSystemPacket(const QString & topic, const QByteArray & payload);
 
         void sessionBeforeDelete(Session * session);
+        void sessionLoaded(SessionPtr session);
+
+        void indexSubscription(const SessionPtr & session, const Topic & topic, SessionSubscriptionData * data);
+        void unindexSubscription(Session * session, const Topic & topic);
+        void unindexSessionSubscriptions(Session * session);
 
         void storeSharedSubscriptions();
         void loadSharedSubscriptions();
@@ -100,10 +113,12 @@ namespace Mqtt
         QByteArray makeBrokerInfoPayload() const;
         QByteArray makeMqttClientsInfoPayload() const;
         QByteArray makeSubscriptionsInfoPayload() const;
+        QByteArray makeRoutingCacheInfoPayload() const;
 
         void publishBrokerInfo();
         void publishMqttClientsInfo();
         void publishSubscriptionsInfo();
+        void publishRoutingCacheInfo();
         void publishMqttMessRecvInfo();
         void publishMqttMessSentInfo();
         void publishMqttMessDropInfo();
@@ -113,12 +128,17 @@ namespace Mqtt
         void publishNetworkLoadInfo();
 
     private:
-        SessionSubscriptionData * selectSubscriptionDataWithMaximumQoS(const SubscriptionNode::List & nodes, SubscriptionIdentifiersArray & outSubscriptionIdentifiers);
+        SessionSubscriptionData * selectSubscriptionDataWithMaximumQoS(const SessionSubscriptionDataArray & subscriptions, SubscriptionIdentifiersArray & outSubscriptionIdentifiers);
 
         typedef std::vector<SharedSubscriptionSessionData> SharedSubscriptionSessionsArray;
-        const SharedSubscriptionSessionsArray & selectSharedSubscriptionSessions(const SubscriptionNode::List & nodes);
+        // nodes left without consumers are appended to emptyNodes, caller removes them
+        const SharedSubscriptionSessionsArray & selectSharedSubscriptionSessions(const SharedSubscriptions::List & nodes, const TopicName & topicName, SharedSubscriptions::List & emptyNodes);
 
         void removeSharedSubscriptions(Session * session);
+        void addSharedMembership(Session * session, const QString & filter, const QString & consumer);
+        void removeSharedMembership(Session * session, const QString & filter, const QString & consumer);
+        void setSharedMembershipsConnected(Session * session, bool connected);
+        void removeSharedSubscriptionNode(SharedSubscriptions::Node * node);
 
     private:
         bool                       isQoS0QueueEnabled;
@@ -130,6 +150,12 @@ namespace Mqtt
         Store::IFactory          * storerFactory;
         SessionsContainer        * sessions;
         SharedSubscriptions        sharedSubscriptions;
+        SharedStrategy             sharedStrategy;
+        // shared subscriptions of each session, so its removal touches only own groups
+        QHash<Session*, SharedSubscriptionMemberships> sharedMemberships;
+        SubscriptionsIndex         subscriptionsIndex;
+        RoutingCache               routingCache;
+        PublishFrameCache          publishFrames;
         Store::PublishContainer    retainPackets;
         Store::IStorer           * sharedSubscriptionsStorer;
         QList<Network::ServerWPtr> listeners;
@@ -139,8 +165,12 @@ namespace Mqtt
     typedef QSharedPointer<Broker> BrokerPtr;
     typedef QWeakPointer<Broker> BrokerWPtr;
 
-    inline bool Broker::isQoS0OfflineEnabled() const        { return isQoS0QueueEnabled;    }
-    inline void Broker::setQoS0OfflineEnabled(bool enabled) { isQoS0QueueEnabled = enabled; }
+    inline bool Broker::isQoS0OfflineEnabled() const         { return isQoS0QueueEnabled;               }
+    inline void Broker::setQoS0OfflineEnabled(bool enabled)  { isQoS0QueueEnabled = enabled;            }
+    inline int Broker::routingCacheSize() const              { return routingCache.capacity();          }
+    inline void Broker::setRoutingCacheSize(int topicsCount) { routingCache.setCapacity(topicsCount);   }
+    inline SharedStrategy Broker::sharedSubscriptionStrategy() const           { return sharedStrategy;     }
+    inline void Broker::setSharedSubscriptionStrategy(SharedStrategy strategy) { sharedStrategy = strategy; }
 }
 
 #endif // MQTT_BROKER_H
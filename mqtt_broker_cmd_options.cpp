@@ -2,6 +2,7 @@
 
 #include <QCoreApplication>
 #include <QRegularExpression>
+#include <QUrlQuery>
 #include <QDir>
 
 #ifndef QT_NO_OPENSSL
@@ -35,9 +36,12 @@ BrokerOptions::BrokerOptions()
     cmd.addOption(qos2FlowOption);
     cmd.addOption(banDurationOpt);
     cmd.addOption(banTypeOption);
+    cmd.addOption(routingCacheOption);
+    cmd.addOption(sharedStrategyOpt);
     cmd.addOption(passFileOption);
     cmd.addOption(serverNameOption);
     cmd.addOption(listenerOption);
+    cmd.addOption(ioThreadsOption);
 #   ifndef QT_NO_OPENSSL
     cmd.addOption(certFileOption);
     cmd.addOption(keyFileOption);
@@ -100,6 +104,12 @@ void BrokerOptions::parse(QStringList ARGS)
     banDuration     = cmd.value(banDurationOpt).toULong();
     banAccumulative = cmd.value(banTypeOption).toUInt();
 
+    routingCacheSize = cmd.value(routingCacheOption).toInt();
+
+    ioThreads = qMax(1, cmd.value(ioThreadsOption).toInt());
+
+    parseSharedStrategy();
+
     parseListeners(ssl);
 
     if (listeners.isEmpty()) {
@@ -157,6 +167,21 @@ std::tuple<SecureMode, ConnectionType, QString, quint16> BrokerOptions::parseCon
     return std::make_tuple(SecureMode::Unknown, ConnectionType::Unknown, QString(), 0);
 }
 
+void BrokerOptions::parseSharedStrategy()
+{
+    const QString value = cmd.value(sharedStrategyOpt);
+    if (value == QStringLiteral("round-robin"))
+        sharedStrategy = SharedStrategy::RoundRobin;
+    else if (value == QStringLiteral("least-in-flight"))
+        sharedStrategy = SharedStrategy::LeastInFlight;
+    else if (value == QStringLiteral("sticky-topic"))
+        sharedStrategy = SharedStrategy::StickyTopic;
+    else {
+        qDebug().noquote() << "unknown shared subscriptions strategy:" << value << '\n';
+        cmd.showHelp(1);
+    }
+}
+
 void BrokerOptions::parseListeners(bool sslEnabled)
 {
     QStringList values = cmd.values(listenerOption);
@@ -183,6 +208,23 @@ void BrokerOptions::parseListeners(bool sslEnabled)
             host.connectionType = std::get<1>(result);
             host.address        = std::get<2>(result);
             host.port           = std::get<3>(result);
+            host.ioThreads      = ioThreads;
+
+            const int query = listener.indexOf('?');
+            if (query != -1) {
+                const QUrlQuery params(listener.mid(query + 1));
+                host.writeDelay = qMax(0, params.queryItemValue(QStringLiteral("write-delay")).toInt());
+                if (params.hasQueryItem(QStringLiteral("write-buffer-limit")))
+                    host.writeBufferLimit = qMax(Q_INT64_C(0), params.queryItemValue(QStringLiteral("write-buffer-limit")).toLongLong());
+                if (params.hasQueryItem(QStringLiteral("close-timeout")))
+                    host.closeTimeout = qMax(0, params.queryItemValue(QStringLiteral("close-timeout")).toInt());
+                if (params.hasQueryItem(QStringLiteral("io-threads")))
+                    host.ioThreads = qMax(1, params.queryItemValue(QStringLiteral("io-threads")).toInt());
+                host.epollBackend = (params.queryItemValue(QStringLiteral("backend")) == QStringLiteral("epoll"));
+                if (host.epollBackend && (ConnectionType::TCP != host.connectionType || SecureMode::NonSecured != host.secureMode))
+                    qDebug() << "epoll backend supports plain mqtt:// listeners only, listener" << listener << "uses qt." << '\n';
+            }
+
             listeners.append(host);
         }
     }
@@ -8,6 +8,7 @@
 #endif
 
 #include "mqtt_constants.h"
+#include "mqtt_enum_shared_strategy.h"
 #include "network_secure_mode.h"
 #include "network_connection_type.h"
 
@@ -24,6 +25,7 @@ namespace Mqtt
 
     private:
         void parseSsl(bool * sslEnabled);
+        void parseSharedStrategy();
         void parseListeners(bool sslEnabled);
         void parseConnections(const QList<QStringList> & ARGS, const QString & commandName, bool sslEnabled);
         void showCommandHelp(const QCommandLineParser & cmd, const QString & command, int exitCode);
@@ -48,6 +50,13 @@ namespace Mqtt
         quint32 banDuration      = 0;
         bool    banAccumulative = false;
 
+        qint32 routingCacheSize = 0;
+
+        // default count of I/O threads of listener without ?io-threads
+        qint32 ioThreads = 1;
+
+        SharedStrategy sharedStrategy = SharedStrategy::RoundRobin;
+
 
         class Host
         {
@@ -56,6 +65,15 @@ namespace Mqtt
             Network::ConnectionType connectionType;
             QString                 address;
             quint16                 port;
+            // listener parameters given as URL query, e.g. mqtt://0.0.0.0:1883?write-delay=2
+            qint32                  writeDelay = 0;
+            // ?backend=epoll, plain TCP listener served by native epoll loop (Linux only)
+            bool                    epollBackend = false;
+            // ?write-buffer-limit=<bytes>&close-timeout=<msecs>, negative - server defaults
+            qint64                  writeBufferLimit = -1;
+            qint32                  closeTimeout = -1;
+            // ?io-threads=<count>, threads sharing port of listener (Linux only), --io-threads by default
+            qint32                  ioThreads = 1;
         };
 
         class Connection
@@ -95,12 +113,15 @@ namespace Mqtt
         QCommandLineOption qos2FlowOption      {"qos2-max-flow"     , QString("QoS %1 messages max flow rate per second from client (default %2).").arg(2).arg(Constants::DefaultQoS2FlowRate), "count", QString::number(Constants::DefaultQoS2FlowRate)};
         QCommandLineOption banDurationOpt      {"ban-duration"      , QString("Client ban duration when max flow rate reached (default %1).").arg(QString::number(Constants::DefaultBanDuration)), "seconds", QString::number(Constants::DefaultBanDuration)};
         QCommandLineOption banTypeOption       {"ban-accumulative"  , "Ban duration accumulative (1 enable, 0 disable, default 0) ", "value", "0"};
+        QCommandLineOption routingCacheOption  {"routing-cache-size", QString("Max count of topics with cached subscribers, 0 disables cache (default %1).").arg(Constants::DefaultRoutingCacheSize), "count", QString::number(Constants::DefaultRoutingCacheSize)};
+        QCommandLineOption sharedStrategyOpt   {"shared-strategy"   , "Shared subscriptions distribution: round-robin, least-in-flight, sticky-topic (default round-robin).", "name", "round-robin"};
         QCommandLineOption verboseOption       {"verbose"           , "Verbose level (from 0 to 12, default 3).", "value", "3"};
         QCommandLineOption passFileOption      {{"p", "pass-file"}  , "Passwords file path.",  "file"};
         QCommandLineOption certFileOption      {{"c", "cert-file"}  , "Certificate file path (*.public.pem).",  "file"};
         QCommandLineOption keyFileOption       {{"k", "key-file"}   , "Private key file path (*.private.pem).", "file"};
         QCommandLineOption serverNameOption    {{"s", "server-name"}, "Server name of broker used with websockets handshake.", "name", "mqtt"};
-        QCommandLineOption listenerOption      {{"l", "listener"}   , "Network listener to start: mqtt(s)://localhost:1883", "name"};
+        QCommandLineOption listenerOption      {{"l", "listener"}   , "Network listener to start: mqtt(s)://localhost:1883, optional parameters: ?write-delay=msecs (gathers outgoing data, default 0), &backend=qt|epoll (epoll for plain mqtt:// on Linux, default qt), &io-threads=count (threads sharing port, Linux only, default --io-threads)", "name"};
+        QCommandLineOption ioThreadsOption     {"io-threads"        , "Default count of network threads per listener sharing its port, listener's ?io-threads overrides it, Linux only (default 1).", "count", "1"};
 
         QCommandLineOption connCleanStart      {"clean-start"       , "MQTT clean start on connect. (1 enable, 0 disable, default 1)",  "value", "1"};
         QCommandLineOption connReconnectPeriod {"reconnect-period"  , "MQTT reconnect period in seconds", "value", "5"};
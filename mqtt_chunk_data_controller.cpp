@@ -1,20 +1,46 @@
 #include "mqtt_chunk_data_controller.h"
-#include "mqtt_control_packet.h"
 #include "mqtt_constants.h"
 
+#include <cstring>
+
 using namespace Mqtt;
 
+static constexpr qint64 MinBlockSize  = 4096;
+// block grown for big packet is not kept when it becomes empty
+static constexpr qint64 IdleBlockSize = 64 * 1024;
+
+// full length of packet starting at data, 0 when fixed header is incomplete, -1 when it is malformed
+static qint64 frameLength(const char * data, qint64 size)
+{
+    const quint8 * b = reinterpret_cast<const quint8*>(data);
+    quint64 remaining_length = 0;
+    for (qint64 i = 1; i < 5; ++i) {
+        if (i >= size)
+            return 0;
+        remaining_length |= quint64(b[i] & 0x7F) << (7 * (i - 1));
+        if (!(b[i] & 0x80))
+            return qint64(remaining_length) + 1 + i;
+    }
+    return -1;
+}
+
 ChunkDataController::ChunkDataController()
     :m_max_data_size(Constants::MaxIncomingDataLength)
-    ,m_packet_len(0)
     ,m_timeout(Constants::DefaultKeepAliveInterval * 2 * 1000)
+    ,m_chunk()
+    ,m_chunk_pos(0)
+    ,m_block()
+    ,m_block_pos(0)
+    ,m_block_size(0)
+    ,m_has_frame(false)
+    ,m_frame()
 {
     m_timer.start();
 }
 
 void ChunkDataController::oneSecondTimer()
 {
-    if (m_data.isEmpty())
+    if (isEmpty())
         return;
 
     if (m_timer.elapsed() > m_timeout) {
@@ -28,55 +54,173 @@ void ChunkDataController::append(const QByteArray & chunk)
     if (chunk.isEmpty())
         return;
 
-    if ((chunk.size() + m_data.size()) > m_max_data_size) {
+    if ((chunk.size() + pendingSize()) > m_max_data_size) {
         clear();
         return;
     }
 
-    m_data = m_data.isEmpty() ? chunk : m_data.append(chunk);
-    m_data_raw = QByteArray::fromRawData(m_data.constData(), m_data.length());
+    // not taken bytes of previous chunk have to precede new one
+    if (m_chunk_pos < m_chunk.size())
+        stash(m_chunk.constData() + m_chunk_pos, m_chunk.size() - m_chunk_pos);
+
+    m_chunk = chunk;
+    m_chunk_pos = 0;
     m_timer.restart();
 }
 
 bool ChunkDataController::packetAvailable()
 {
-    m_packet_len = 0;
+    if (!m_has_frame)
+        m_has_frame = nextFrame(m_frame);
+    return m_has_frame;
+}
+
+QByteArray ChunkDataController::takePacket()
+{
+    QByteArray owner;
+    QByteArray packet = takePacket(&owner);
+    if (packet.constData() == owner.constData() && packet.size() == owner.size())
+        return owner;
+    return QByteArray(packet.constData(), packet.size());
+}
+
+QByteArray ChunkDataController::takePacket(QByteArray * owner)
+{
+    if (!packetAvailable())
+        return QByteArray();
+
+    QByteArray packet = m_frame.data;
+    *owner = m_frame.buffer;
+    m_frame = Frame();
+    m_has_frame = false;
+    return packet;
+}
+
+int ChunkDataController::takePackets(FrameArray & frames)
+{
+    const int count = frames.size();
+
+    if (m_has_frame) {
+        frames.append(m_frame);
+        m_frame = Frame();
+        m_has_frame = false;
+    }
+
+    Frame frame;
+    while (nextFrame(frame))
+        frames.append(frame);
 
-    if (m_data_raw.length() < 2)
+    return (frames.size() - count);
+}
+
+bool ChunkDataController::nextFrame(Frame & frame)
+{
+    if (m_block_pos < m_block_size)
+    {
+        qint64 len = frameLength(m_block.constData() + m_block_pos, m_block_size - m_block_pos);
+        // fixed header itself may be split
+        while (len == 0 && m_chunk_pos < m_chunk.size()) {
+            stash(m_chunk.constData() + m_chunk_pos, 1);
+            ++m_chunk_pos;
+            len = frameLength(m_block.constData() + m_block_pos, m_block_size - m_block_pos);
+        }
+
+        if (len < 0 || len > m_max_data_size) {
+            clear();
+            return false;
+        }
+
+        if (len == 0)
+            return false;
+
+        const qint64 missing = len - (m_block_size - m_block_pos);
+        if (missing > 0) {
+            const qint64 available = m_chunk.size() - m_chunk_pos;
+            if (missing > available) {
+                stash(m_chunk.constData() + m_chunk_pos, available);
+                m_chunk.clear();
+                m_chunk_pos = 0;
+                return false;
+            }
+            stash(m_chunk.constData() + m_chunk_pos, missing);
+            m_chunk_pos += missing;
+        }
+
+        frame.data = QByteArray::fromRawData(m_block.constData() + m_block_pos, int(len));
+        frame.buffer = m_block;
+        m_block_pos += len;
+        if (m_block_pos == m_block_size)
+            clearBlock();
+        return true;
+    }
+
+    const qint64 available = m_chunk.size() - m_chunk_pos;
+    if (available == 0)
         return false;
 
-    m_packet_len = ControlPacket::packetFullLength(m_data_raw);
+    const char * p = m_chunk.constData() + m_chunk_pos;
+    const qint64 len = frameLength(p, available);
 
-    if (m_packet_len == -1)
+    if (len < 0 || len > m_max_data_size) {
+        clear();
         return false;
+    }
 
-    if (m_packet_len > quint64(m_data_raw.length())) {
-        m_data = QByteArray(m_data_raw.constData(), m_data_raw.length());
-        m_data_raw = QByteArray::fromRawData(m_data.constData(), m_data.length());
+    if (len == 0 || len > available) {
+        stash(p, available);
+        m_chunk.clear();
+        m_chunk_pos = 0;
         return false;
     }
 
+    frame.data = (len == m_chunk.size()) ? m_chunk : QByteArray::fromRawData(p, int(len));
+    frame.buffer = m_chunk;
+    m_chunk_pos += len;
+    if (m_chunk_pos == m_chunk.size()) {
+        m_chunk.clear();
+        m_chunk_pos = 0;
+    }
     return true;
 }
 
-QByteArray ChunkDataController::takePacket()
+void ChunkDataController::stash(const char * data, qint64 size)
 {
-    QByteArray packet;
-    if (m_packet_len == m_data.length()) {
-        packet = m_data;
-        clear();
-    } else if (m_packet_len == m_data_raw.length()) {
-        packet = QByteArray(m_data_raw.constData(), m_packet_len);
-        clear();
-    } else if (m_packet_len < m_data_raw.length()) {
-        packet = QByteArray(m_data_raw.constData(), m_packet_len);
-        m_data_raw = QByteArray::fromRawData(m_data_raw.constData() + packet.length(), m_data_raw.length() - packet.length());
+    const qint64 pending = m_block_size - m_block_pos;
+    const qint64 required = pending + size;
+
+    // taken packets may reference block, then it is replaced instead of being overwritten,
+    // otherwise pending bytes are moved to its beginning when there is no room at the end
+    if (!m_block.isDetached() || required > m_block.size()) {
+        const qint64 capacity = (required > m_block.size()) ? qMax(required, qint64(m_block.size()) * 2) : qint64(m_block.size());
+        QByteArray block(int(qMax(MinBlockSize, capacity)), Qt::Uninitialized);
+        if (pending != 0)
+            std::memcpy(block.data(), m_block.constData() + m_block_pos, size_t(pending));
+        m_block = block;
+        m_block_pos = 0;
+        m_block_size = pending;
+    } else if (m_block_size + size > m_block.size()) {
+        std::memmove(m_block.data(), m_block.constData() + m_block_pos, size_t(pending));
+        m_block_pos = 0;
+        m_block_size = pending;
     }
-    return packet;
+
+    std::memcpy(m_block.data() + m_block_size, data, size_t(size));
+    m_block_size += size;
 }
 
 void ChunkDataController::clear()
 {
-    m_data_raw.clear();
-    m_data.clear();
+    m_chunk.clear();
+    m_chunk_pos = 0;
+    clearBlock();
+    m_frame = Frame();
+    m_has_frame = false;
+}
+
+void ChunkDataController::clearBlock()
+{
+    m_block_pos = 0;
+    m_block_size = 0;
+    if (m_block.size() > IdleBlockSize)
+        m_block = QByteArray();
 }
@@ -3,11 +3,25 @@
 
 #include <QByteArray>
 #include <QElapsedTimer>
+#include <QVarLengthArray>
 
 namespace Mqtt
 {
+    // assembles packets from received chunks, packets are parsed in place inside chunks,
+    // only bytes of packet split between chunks are copied into reusable assembly block
     class ChunkDataController
     {
+    public:
+        // packet references data of buffer, buffer keeps it valid
+        class Frame
+        {
+        public:
+            QByteArray data;
+            QByteArray buffer;
+        };
+
+        typedef QVarLengthArray<Frame, 16> FrameArray;
+
     public:
         ChunkDataController();
 
@@ -24,20 +38,38 @@ namespace Mqtt
         bool   isEmpty() const;
 
         QByteArray takePacket();
+        // takes packet without copying, packet references receive buffer which is shared with owner
+        QByteArray takePacket(QByteArray * owner);
+        // appends all complete packets without copying, returns count of appended
+        int    takePackets(FrameArray & frames);
+
+    private:
+        bool   nextFrame(Frame & frame);
+        void   stash(const char * data, qint64 size);
+        void   clearBlock();
+        qint64 pendingSize() const;
 
     private:
         qint32        m_max_data_size;
-        quint64       m_packet_len;
         qint64        m_timeout;
-        QByteArray    m_data;
-        QByteArray    m_data_raw;
+        // last received chunk, bytes before m_chunk_pos are taken
+        QByteArray    m_chunk;
+        qint64        m_chunk_pos;
+        // bytes preceding chunk, in [m_block_pos, m_block_size)
+        QByteArray    m_block;
+        qint64        m_block_pos;
+        qint64        m_block_size;
+        // packet found by packetAvailable
+        bool          m_has_frame;
+        Frame         m_frame;
         QElapsedTimer m_timer;
     };
 
     inline void ChunkDataController::setTimeout(qint64 secs)           { m_timeout = secs * 1000;      }
     inline qint32 ChunkDataController::maxDataSize() const             { return m_max_data_size;       }
     inline void ChunkDataController::setMaxDataSize(qint32 bytesCount) { m_max_data_size = bytesCount; }
-    inline bool ChunkDataController::isEmpty() const                   { return m_data.isEmpty();      }
+    inline bool ChunkDataController::isEmpty() const                   { return (!m_has_frame && pendingSize() == 0); }
+    inline qint64 ChunkDataController::pendingSize() const             { return (m_block_size - m_block_pos) + (m_chunk.size() - m_chunk_pos); }
 }
 
 #endif // MQTT_CHUNK_DATA_CONTROLLER_H
@@ -0,0 +1,56 @@
+#include "mqtt_codec.h"
+
+using namespace Mqtt;
+
+template <Version V>
+static QByteArray serializePublish(const PublishPacket & packet)
+{
+    return packet.serialize<V>();
+}
+
+template <Version V>
+static QByteArray serializeDelivery(const PublishPacket & source, const PublishDelivery & delivery)
+{
+    return source.serialize<V>(delivery);
+}
+
+template <Version V>
+static bool unserializePublish(PublishPacket & packet, const QByteArray & data, const QByteArray & buffer)
+{
+    return packet.unserialize<V>(data, &buffer);
+}
+
+template <Version V>
+static QByteArray serializePublishAnswer(const PublishAnswerPacket & packet, qint32 maxPacketSize)
+{
+    return packet.serialize<V>(maxPacketSize);
+}
+
+template <Version V>
+static bool unserializePublishAnswer(PublishAnswerPacket & packet, const QByteArray & data)
+{
+    return packet.unserialize<V>(data);
+}
+
+static const Codec kCodecV3 =
+{
+     &serializePublish<Version::Ver_3_1_1>
+    ,&serializeDelivery<Version::Ver_3_1_1>
+    ,&unserializePublish<Version::Ver_3_1_1>
+    ,&serializePublishAnswer<Version::Ver_3_1_1>
+    ,&unserializePublishAnswer<Version::Ver_3_1_1>
+};
+
+static const Codec kCodecV5 =
+{
+     &serializePublish<Version::Ver_5_0>
+    ,&serializeDelivery<Version::Ver_5_0>
+    ,&unserializePublish<Version::Ver_5_0>
+    ,&serializePublishAnswer<Version::Ver_5_0>
+    ,&unserializePublishAnswer<Version::Ver_5_0>
+};
+
+const Codec & Codec::forVersion(Version version)
+{
+    return (Version::Ver_5_0 == version) ? kCodecV5 : kCodecV3;
+}
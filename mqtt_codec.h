@@ -0,0 +1,25 @@
+#ifndef MQTT_CODEC_H
+#define MQTT_CODEC_H
+
+#include "mqtt_publish_packet.h"
+
+namespace Mqtt
+{
+    // encoders and decoders of per message packets specialized by protocol version,
+    // codec is selected once per session, so these paths don't branch on version
+    class Codec
+    {
+    public:
+        QByteArray (*serializePublish)(const PublishPacket & packet);
+        QByteArray (*serializeDelivery)(const PublishPacket & source, const PublishDelivery & delivery);
+        bool (*unserializePublish)(PublishPacket & packet, const QByteArray & data, const QByteArray & buffer);
+        QByteArray (*serializePublishAnswer)(const PublishAnswerPacket & packet, qint32 maxPacketSize);
+        bool (*unserializePublishAnswer)(PublishAnswerPacket & packet, const QByteArray & data);
+
+    public:
+        // Ver_3_1 packets are encoded as Ver_3_1_1 ones, unknown version gets Ver_3_1_1 codec
+        static const Codec & forVersion(Version version);
+    };
+}
+
+#endif // MQTT_CODEC_H
@@ -1,6 +1,7 @@
 #include "mqtt_connect_packet.h"
 #include "mqtt_decoder.h"
 #include "mqtt_encoder.h"
+#include "mqtt_text_validator.h"
 #include "mqtt_constants.h"
 
 #define MQTT_PROTO_NAME_OLD QStringLiteral("MQIsdp")
@@ -192,7 +193,12 @@ bool ConnectPacket::unserialize(const QByteArray & data)
                     }
                     case Parse::Properties: {
                         bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props);      buf += len;
-                        if ( ok) { ok = isPropertiesValid(m_header.props); }
+                        if (!ok) {
+                            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                            m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                            return false;
+                        }
+                        ok = isPropertiesValid(m_header.props);
                         if (!ok) {
                             m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                             m_unserializeReasonString = QStringLiteral("protocol error: invalid properties");
@@ -203,7 +209,13 @@ bool ConnectPacket::unserialize(const QByteArray & data)
                     }
                     // PAYLOAD in order Client Identifier, Will Properties(V 5), Will Topic, Will Message, User Name, Password
                     case Parse::ClientId: {
-                        m_payload.clientId = Decoder::decodeUTF8(buf, &remaining_length, &len); buf += len;
+                        quint8 flags = TextValidator::Valid;
+                        m_payload.clientId = Decoder::decodeUTF8(buf, &remaining_length, &len, &flags); buf += len;
+                        if (flags & (TextValidator::Malformed | TextValidator::Null)) {
+                            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                            m_unserializeReasonString = QStringLiteral("malformed packet: client identifier is not valid UTF-8 string");
+                            return false;
+                        }
                         step = (m_header.flags.willFlag == 1)
                                ? ((Version::Ver_5_0 == m_header.protoVersion) ? Parse::WillProps : Parse::WillTopic)
                                : Parse::User;
@@ -211,7 +223,12 @@ bool ConnectPacket::unserialize(const QByteArray & data)
                     }
                     case Parse::WillProps: {
                         bool ok = unserializeProperties(buf, &remaining_length, &len, m_payload.willProps);  buf += len;
-                        if ( ok) { ok = isWillPropertiesValid(m_payload.willProps); }
+                        if (!ok) {
+                            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                            m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                            return false;
+                        }
+                        ok = isWillPropertiesValid(m_payload.willProps);
                         if (!ok) {
                             m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                             m_unserializeReasonString = QStringLiteral("protocol error: invalid will properties");
@@ -221,7 +238,18 @@ bool ConnectPacket::unserialize(const QByteArray & data)
                         break;
                     }
                     case Parse::WillTopic: {
-                        m_payload.willTopic = Decoder::decodeUTF8(buf, &remaining_length, &len);   buf += len;
+                        quint8 flags = TextValidator::Valid;
+                        m_payload.willTopic = Decoder::decodeUTF8(buf, &remaining_length, &len, &flags); buf += len;
+                        if (flags & (TextValidator::Malformed | TextValidator::Null)) {
+                            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                            m_unserializeReasonString = QStringLiteral("malformed packet: will topic is not valid UTF-8 string");
+                            return false;
+                        }
+                        if (flags & TextValidator::Wildcard) {
+                            m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
+                            m_unserializeReasonString = QStringLiteral("will topic must not contain wildcars characters");
+                            return false;
+                        }
                         step = Parse::WillPayload;
                         break;
                     }
@@ -231,7 +259,13 @@ bool ConnectPacket::unserialize(const QByteArray & data)
                         break;
                     }
                     case Parse::User: {
-                        m_payload.username = Decoder::decodeUTF8(buf, &remaining_length, &len);    buf += len;
+                        quint8 flags = TextValidator::Valid;
+                        m_payload.username = Decoder::decodeUTF8(buf, &remaining_length, &len, &flags); buf += len;
+                        if (flags & (TextValidator::Malformed | TextValidator::Null)) {
+                            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                            m_unserializeReasonString = QStringLiteral("malformed packet: user name is not valid UTF-8 string");
+                            return false;
+                        }
                         step = Parse::Password;
                         break;
                     }
@@ -524,7 +558,12 @@ bool ConnackPacket::unserialize(const QByteArray & data, Version protocolVersion
             if (Version::Ver_5_0 == protocolVersion)
             {
                 bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid connack properties");
@@ -23,6 +23,7 @@ namespace Mqtt
         static constexpr qint64  MaxSubscriptionIdentifier = 268435455;
         static constexpr quint32 ForeverSessionInterval    = std::numeric_limits<quint32>::max();
         static constexpr quint16 TopicAliasMaximum         = std::numeric_limits<quint16>::max() - 1;
+        static constexpr qint32  DefaultRoutingCacheSize   = 4096; /* topics count */
     };
 }
 
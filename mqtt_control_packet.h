@@ -2,6 +2,7 @@
 #define MQTT_CONTROL_PACKET_H
 
 #include "mqtt_enums.h"
+#include "mqtt_properties.h"
 
 #include <QPair>
 #include <QVariant>
@@ -9,9 +10,6 @@
 
 namespace Mqtt
 {
-    typedef QPair<QString, QString> UserProperty;
-    typedef QPair<PropertyId, QVariant> Property;
-    typedef QList<Property> Properties;
 
     class ControlPacket
     {
@@ -33,7 +31,12 @@ namespace Mqtt
         static void setProperty(Properties & source, PropertyId target, QVariant value);
         static void removeProperty(Properties & source, PropertyId target);
         static QByteArray serializeProperties(const Properties & props);
-        static bool unserializeProperties(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount, Properties & props);
+        // size of properties without length prefix
+        static int propertiesSize(const Properties & props);
+        // writes length prefix and properties
+        static void writeProperties(BufferWriter & writer, const Properties & props, int size);
+        static bool unserializeProperties(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount, Properties & props,
+                                          Properties::Decoding decoding = Properties::Decoding::Eager);
 
      public:
         PacketType type() const;
@@ -1,4 +1,5 @@
 #include "mqtt_decoder.h"
+#include "mqtt_text_validator.h"
 #include <QByteArray>
 #include <QString>
 
@@ -31,6 +32,28 @@ QString Decoder::decodeUTF8(const quint8 * buf, qint64 * rl, size_t * bc)
     return val;
 }
 
+QString Decoder::decodeUTF8(const quint8 * buf, qint64 * rl, size_t * bc, quint8 * flags)
+{
+    const QByteArray val = Decoder::decodeUTF8Bytes(buf, rl, bc, flags);
+    return QString::fromUtf8(val.constData(), val.size());
+}
+
+QByteArray Decoder::decodeUTF8Bytes(const quint8 * buf, qint64 * rl, size_t * bc, quint8 * flags)
+{
+    *bc  = 0;
+    *flags = TextValidator::Malformed;
+    quint16    len = ((*rl >= sizeof(quint16)) ? Decoder::decodeInteger<quint16>(buf, rl, bc) : 0);
+    QByteArray val;
+    if (*rl >= len) {
+        const char * data = reinterpret_cast<const char*>(buf + sizeof(len));
+        *flags = TextValidator::scanUtf8(data, len);
+        if (!(*flags & TextValidator::Malformed))
+            val = QByteArray(data, len);
+    }
+    *bc += len; *rl -= len;
+    return val;
+}
+
 QByteArray Decoder::decodeBinaryData(const quint8 * buf, qint64 * rl, size_t * bc)
 {
     *bc  = 0;
@@ -28,6 +28,10 @@ namespace Mqtt
         { return Decoder::decodeInteger<quint32>(buf, remainigLenght, bytesCount); }
 
         static QString decodeUTF8(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount);
+        // string is validated, flags are set to TextValidator::Flags, string is empty when it is malformed
+        static QString decodeUTF8(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount, quint8 * flags);
+        // string is validated and kept in UTF-8, flags are set to TextValidator::Flags
+        static QByteArray decodeUTF8Bytes(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount, quint8 * flags);
 
         static QByteArray decodeBinaryData(const quint8 * buf, qint64 * remainingLength, size_t * bytesCount);
     };
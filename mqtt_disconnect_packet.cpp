@@ -89,7 +89,12 @@ bool DisconnectPacket::unserialize(const QByteArray & data, Version protocolVers
             if (Version::Ver_5_0 == protocolVersion && remaining_length > 0)
             {
                 bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid disconnect properties");
@@ -1,5 +1,7 @@
 #include "mqtt_encoder.h"
 
+#include <cstring>
+
 #define MAX_VARINT_BYTES 10
 
 using namespace Mqtt;
@@ -24,3 +26,101 @@ QByteArray Encoder::encodeBinaryData(const QByteArray & bin)
     result.reserve(bin.length() + 2);
     return result.append(Encoder::encodeInteger<quint16>(bin.length())).append(bin);
 }
+
+int Encoder::variableByteIntegerSize(quint64 value)
+{
+    int n = 1;
+    for ( ; value > 127; ++n)
+        value >>= 7;
+    return n;
+}
+
+int Encoder::utf8Size(const QString & string)
+{
+    int size = 0;
+    const QChar * c = string.constData();
+    const QChar * e = c + string.size();
+    for ( ; c != e; ++c) {
+        ushort u = c->unicode();
+        if (u < 0x80) {
+            size += 1;
+        } else if (u < 0x800) {
+            size += 2;
+        } else if (QChar::isHighSurrogate(u) && (c + 1) != e && QChar::isLowSurrogate((c + 1)->unicode())) {
+            size += 4; ++c;
+        } else {
+            // lone surrogate is replaced by U+FFFD
+            size += 3;
+        }
+    }
+    return size;
+}
+
+BufferWriter::BufferWriter(QByteArray & buffer)
+    :m_data(buffer.data())
+    ,m_size(int(buffer.size()))
+    ,m_pos(0)
+{
+
+}
+
+void BufferWriter::writeByte(quint8 value)
+{
+    Q_ASSERT(m_pos < m_size);
+    m_data[m_pos++] = char(value);
+}
+
+void BufferWriter::writeVariableByteInteger(quint64 value)
+{
+    for ( ; value > 127; value >>= 7)
+        writeByte(0x80 | quint8(value & 0x7F));
+    writeByte(quint8(value));
+}
+
+void BufferWriter::writeBinaryData(const char * data, int size)
+{
+    writeTwoByteInteger(quint16(size));
+    writeRaw(data, size);
+}
+
+void BufferWriter::writeUTF8(const QString & string)
+{
+    writeTwoByteInteger(quint16(Encoder::utf8Size(string)));
+
+    const QChar * c = string.constData();
+    const QChar * e = c + string.size();
+    for ( ; c != e; ++c) {
+        uint u = c->unicode();
+        if (u < 0x80) {
+            writeByte(quint8(u));
+            continue;
+        }
+        if (u < 0x800) {
+            writeByte(quint8(0xC0 | (u >> 6)));
+            writeByte(quint8(0x80 | (u & 0x3F)));
+            continue;
+        }
+        if (QChar::isSurrogate(u)) {
+            if (QChar::isHighSurrogate(u) && (c + 1) != e && QChar::isLowSurrogate((c + 1)->unicode())) {
+                u = QChar::surrogateToUcs4(ushort(u), (c + 1)->unicode()); ++c;
+                writeByte(quint8(0xF0 | (u >> 18)));
+                writeByte(quint8(0x80 | ((u >> 12) & 0x3F)));
+                writeByte(quint8(0x80 | ((u >> 6) & 0x3F)));
+                writeByte(quint8(0x80 | (u & 0x3F)));
+                continue;
+            }
+            u = QChar::ReplacementCharacter;
+        }
+        writeByte(quint8(0xE0 | (u >> 12)));
+        writeByte(quint8(0x80 | ((u >> 6) & 0x3F)));
+        writeByte(quint8(0x80 | (u & 0x3F)));
+    }
+}
+
+void BufferWriter::writeRaw(const char * data, int size)
+{
+    Q_ASSERT(m_pos + size <= m_size);
+    if (size > 0)
+        memcpy(m_data + m_pos, data, size_t(size));
+    m_pos += size;
+}
@@ -3,6 +3,8 @@
 
 #include <QtGlobal>
 #include <QtEndian>
+#include <QByteArray>
+#include <QString>
 
 namespace Mqtt
 {
@@ -31,7 +33,54 @@ namespace Mqtt
 
         static QByteArray encodeUTF8(const QString & string)
         { return Encoder::encodeBinaryData(string.toUtf8()); }
+
+    public:
+        // sizes of encoded values, used to compute frame length before encoding
+        static int variableByteIntegerSize(quint64 value);
+        // without two bytes of length
+        static int utf8Size(const QString & string);
     };
+
+    // encodes directly into buffer, which is sized up front by exact frame length
+    class BufferWriter
+    {
+    public:
+        explicit BufferWriter(QByteArray & buffer);
+
+    public:
+        void writeByte(quint8 value);
+        void writeVariableByteInteger(quint64 value);
+        void writeTwoByteInteger(quint16 value);
+        void writeFourByteInteger(quint32 value);
+        // length prefixed
+        void writeBinaryData(const char * data, int size);
+        void writeBinaryData(const QByteArray & bin);
+        void writeUTF8(const QString & string);
+        void writeRaw(const char * data, int size);
+        void writeRaw(const QByteArray & data);
+
+        int position() const;
+
+    private:
+        template<typename T>
+        void writeInteger(T value)
+        {
+            Q_ASSERT(m_pos + int(sizeof(value)) <= m_size);
+            qToBigEndian<T>(value, m_data + m_pos);
+            m_pos += int(sizeof(value));
+        }
+
+    private:
+        char * m_data;
+        int    m_size;
+        int    m_pos;
+    };
+
+    inline void BufferWriter::writeTwoByteInteger(quint16 value)   { writeInteger<quint16>(value);                      }
+    inline void BufferWriter::writeFourByteInteger(quint32 value)  { writeInteger<quint32>(value);                      }
+    inline void BufferWriter::writeBinaryData(const QByteArray & bin) { writeBinaryData(bin.constData(), int(bin.size())); }
+    inline void BufferWriter::writeRaw(const QByteArray & data)    { writeRaw(data.constData(), int(data.size()));      }
+    inline int BufferWriter::position() const                      { return m_pos;                                      }
 }
 
 #endif // MQTT_ENCODER_H
@@ -0,0 +1,15 @@
+#include "mqtt_enum_shared_strategy.h"
+
+#include <QDebug>
+
+QDebug operator << (QDebug d, Mqtt::SharedStrategy strategy)
+{
+    switch (strategy)
+    {
+       case Mqtt::SharedStrategy::RoundRobin    : d << QStringLiteral("round-robin");     break;
+       case Mqtt::SharedStrategy::LeastInFlight : d << QStringLiteral("least-in-flight"); break;
+       case Mqtt::SharedStrategy::StickyTopic   : d << QStringLiteral("sticky-topic");    break;
+    }
+
+    return d;
+}
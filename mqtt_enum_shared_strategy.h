@@ -0,0 +1,20 @@
+#ifndef MQTT_ENUM_SHARED_STRATEGY_H
+#define MQTT_ENUM_SHARED_STRATEGY_H
+
+#include <QtGlobal>
+
+namespace Mqtt
+{
+    // how message is distributed among members of shared subscription group
+    enum class SharedStrategy : quint8
+    {
+         RoundRobin    = 0
+        ,LeastInFlight = 1 /* member with least count of in-flight messages */
+        ,StickyTopic   = 2 /* same topic goes to same member, join or leave of member moves only topics of that member */
+    };
+}
+
+class QDebug;
+QDebug operator << (QDebug d, Mqtt::SharedStrategy strategy);
+
+#endif // MQTT_ENUM_SHARED_STRATEGY_H
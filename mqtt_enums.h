@@ -7,6 +7,7 @@
 #include "mqtt_enum_qos.h"
 #include "mqtt_enum_retcode_v3.h"
 #include "mqtt_enum_retcode_v5.h"
+#include "mqtt_enum_shared_strategy.h"
 #include "mqtt_enum_version.h"
 
 #endif // MQTT_ENUMS_H
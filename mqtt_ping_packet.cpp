@@ -63,9 +63,13 @@ QByteArray PingResponsePacket::serialize(Version protocolVersion) const
 {
     Q_UNUSED(protocolVersion)
 
-    QByteArray data; data.resize(2);
-    memcpy(data.data(), &m_headerFix, 1);
-    memset(data.data() + 1, 0, 1);
+    // frame never changes, all responses share one buffer
+    static thread_local QByteArray data;
+    if (data.isEmpty()) {
+        data.resize(2);
+        memcpy(data.data(), &m_headerFix, 1);
+        memset(data.data() + 1, 0, 1);
+    }
     return data;
 }
 
@@ -0,0 +1,536 @@
+#include "mqtt_properties.h"
+#include "mqtt_encoder.h"
+#include "mqtt_decoder.h"
+#include "mqtt_text_validator.h"
+
+#include <cstring>
+
+using namespace Mqtt;
+
+#define SCHEMA_SIZE 43
+
+// indexed by property id
+static const PropertySchema schema_table[SCHEMA_SIZE] =
+{
+    /*  0                                 */ { PropertyType::Unknown            , -1, false }
+    /*  1 PayloadFormatIndicator          */,{ PropertyType::Byte               ,  0, false }
+    /*  2 MessageExpiryInterval           */,{ PropertyType::FourByteInteger    ,  1, false }
+    /*  3 ContentType                     */,{ PropertyType::UTF8String         , -1, false }
+    /*  4                                 */,{ PropertyType::Unknown            , -1, false }
+    /*  5                                 */,{ PropertyType::Unknown            , -1, false }
+    /*  6                                 */,{ PropertyType::Unknown            , -1, false }
+    /*  7                                 */,{ PropertyType::Unknown            , -1, false }
+    /*  8 ResponseTopic                   */,{ PropertyType::UTF8String         , -1, false }
+    /*  9 CorrelationData                 */,{ PropertyType::BinaryData         , -1, false }
+    /* 10                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 11 SubscriptionIdentifier          */,{ PropertyType::VariableByteInteger, -1, true  }
+    /* 12                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 13                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 14                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 15                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 16                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 17 SessionExpiryInterval           */,{ PropertyType::FourByteInteger    ,  2, false }
+    /* 18 AssignedClientIdentifier        */,{ PropertyType::UTF8String         , -1, false }
+    /* 19 ServerKeepAlive                 */,{ PropertyType::TwoByteInteger     ,  3, false }
+    /* 20                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 21 AuthentificationMethod          */,{ PropertyType::UTF8String         , -1, false }
+    /* 22 AuthentificationData            */,{ PropertyType::BinaryData         , -1, false }
+    /* 23 RequestProblemInformation       */,{ PropertyType::Byte               ,  4, false }
+    /* 24 WillDelayInterval               */,{ PropertyType::FourByteInteger    ,  5, false }
+    /* 25 RequestResponseInformation      */,{ PropertyType::Byte               ,  6, false }
+    /* 26 ResponseInformation             */,{ PropertyType::UTF8String         , -1, false }
+    /* 27                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 28 ServerReference                 */,{ PropertyType::UTF8String         , -1, false }
+    /* 29                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 30                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 31 ReasonString                    */,{ PropertyType::UTF8String         , -1, false }
+    /* 32                                 */,{ PropertyType::Unknown            , -1, false }
+    /* 33 ReceiveMaximum                  */,{ PropertyType::TwoByteInteger     ,  7, false }
+    /* 34 TopicAliasMaximum               */,{ PropertyType::TwoByteInteger     ,  8, false }
+    /* 35 TopicAlias                      */,{ PropertyType::TwoByteInteger     ,  9, false }
+    /* 36 MaximumQoS                      */,{ PropertyType::Byte               , 10, false }
+    /* 37 RetainAvailable                 */,{ PropertyType::Byte               , 11, false }
+    /* 38 UserProperty                    */,{ PropertyType::UTF8StringPair     , -1, true  }
+    /* 39 MaximumPacketSize               */,{ PropertyType::FourByteInteger    , 12, false }
+    /* 40 WildcardSubscriptionAvailable   */,{ PropertyType::Byte               , 13, false }
+    /* 41 SubscriptionIdentifierAvailable */,{ PropertyType::Byte               , 14, false }
+    /* 42 SharedSubscriptionAvailable     */,{ PropertyType::Byte               , 15, false }
+};
+
+// property id of each integer slot
+static const PropertyId slot_ids[Properties::IntegerSlotsCount] =
+{
+     PropertyId::PayloadFormatIndicator
+    ,PropertyId::MessageExpiryInterval
+    ,PropertyId::SessionExpiryInterval
+    ,PropertyId::ServerKeepAlive
+    ,PropertyId::RequestProblemInformation
+    ,PropertyId::WillDelayInterval
+    ,PropertyId::RequestResponseInformation
+    ,PropertyId::ReceiveMaximum
+    ,PropertyId::TopicAliasMaximum
+    ,PropertyId::TopicAlias
+    ,PropertyId::MaximumQoS
+    ,PropertyId::RetainAvailable
+    ,PropertyId::MaximumPacketSize
+    ,PropertyId::WildcardSubscriptionAvailable
+    ,PropertyId::SubscriptionIdentifierAvailable
+    ,PropertyId::SharedSubscriptionAvailable
+};
+
+static int integerSize(PropertyType type)
+{
+    switch (type)
+    {
+        case PropertyType::Byte:            return 1;
+        case PropertyType::TwoByteInteger:  return 2;
+        case PropertyType::FourByteInteger: return 4;
+        default: break;
+    }
+    return 0;
+}
+
+template<typename Array>
+static int indexOf(const Array & array, PropertyId id)
+{
+    for (int i = 0; i < array.count(); ++i)
+        if (array.at(i).id == id)
+            return i;
+    return -1;
+}
+
+template<typename Array>
+static void removeAll(Array & array, PropertyId id)
+{
+    int j = 0;
+    for (int i = 0; i < array.count(); ++i)
+        if (array.at(i).id != id)
+            array[j++] = array.at(i);
+    array.resize(j);
+}
+
+Properties::Properties()
+    :m_integers()
+    ,m_present(0)
+    ,m_encoded_ids(0)
+    ,m_encoded_count(0)
+{
+
+}
+
+Properties::Properties(std::initializer_list<Property> props)
+    :m_integers()
+    ,m_present(0)
+    ,m_encoded_ids(0)
+    ,m_encoded_count(0)
+{
+    for (const Property & p: props)
+        append(p);
+}
+
+const PropertySchema & Properties::schema(PropertyId id)
+{
+    const int i = static_cast<int>(id);
+    return schema_table[(i < SCHEMA_SIZE) ? i : 0];
+}
+
+quint64 Properties::mask(std::initializer_list<PropertyId> ids)
+{
+    quint64 result = 0;
+    for (PropertyId id: ids)
+        result |= (quint64(1) << static_cast<int>(id));
+    return result;
+}
+
+int Properties::count() const
+{
+    int n = 0;
+    for (quint16 m = m_present; m != 0; m &= (m - 1))
+        ++n;
+    return n + m_strings.count() + m_binaries.count() + m_subscription_ids.count() + m_user.count() + m_encoded_count;
+}
+
+void Properties::clear()
+{
+    m_present = 0;
+    m_encoded.clear();
+    m_encoded_ids = 0;
+    m_encoded_count = 0;
+    m_strings.clear();
+    m_binaries.clear();
+    m_subscription_ids.clear();
+    m_user.clear();
+}
+
+bool Properties::contains(PropertyId id) const
+{
+    if (m_encoded_ids & (quint64(1) << static_cast<int>(id)))
+        return true;
+
+    const PropertySchema & s = schema(id);
+    switch (s.type)
+    {
+        case PropertyType::Byte:
+        case PropertyType::TwoByteInteger:
+        case PropertyType::FourByteInteger:     return (m_present & (1u << s.slot)) != 0;
+        case PropertyType::UTF8String:          return indexOf(m_strings, id) >= 0;
+        case PropertyType::BinaryData:          return indexOf(m_binaries, id) >= 0;
+        case PropertyType::VariableByteInteger: return !m_subscription_ids.isEmpty();
+        case PropertyType::UTF8StringPair:      return !m_user.isEmpty();
+        default: break;
+    }
+    return false;
+}
+
+quint64 Properties::ids() const
+{
+    quint64 result = 0;
+    for (int slot = 0; slot < IntegerSlotsCount; ++slot)
+        if (m_present & (1u << slot))
+            result |= (quint64(1) << static_cast<int>(slot_ids[slot]));
+    for (const auto & e: m_strings)
+        result |= (quint64(1) << static_cast<int>(e.id));
+    for (const auto & e: m_binaries)
+        result |= (quint64(1) << static_cast<int>(e.id));
+    if (!m_subscription_ids.isEmpty())
+        result |= (quint64(1) << static_cast<int>(PropertyId::SubscriptionIdentifier));
+    if (!m_user.isEmpty())
+        result |= (quint64(1) << static_cast<int>(PropertyId::UserProperty));
+    return (result | m_encoded_ids);
+}
+
+QVariant Properties::value(PropertyId id) const
+{
+    if (m_encoded_ids & (quint64(1) << static_cast<int>(id)))
+        decodeEncoded();
+
+    const PropertySchema & s = schema(id);
+    switch (s.type)
+    {
+        case PropertyType::Byte:
+        case PropertyType::TwoByteInteger:
+        case PropertyType::FourByteInteger:
+            return (m_present & (1u << s.slot)) ? QVariant(m_integers[s.slot]) : QVariant();
+        case PropertyType::UTF8String: {
+            int i = indexOf(m_strings, id);
+            return (i >= 0) ? QVariant(m_strings.at(i).value) : QVariant();
+        }
+        case PropertyType::BinaryData: {
+            int i = indexOf(m_binaries, id);
+            return (i >= 0) ? QVariant(m_binaries.at(i).value) : QVariant();
+        }
+        case PropertyType::VariableByteInteger:
+            return !m_subscription_ids.isEmpty() ? QVariant(m_subscription_ids.first()) : QVariant();
+        case PropertyType::UTF8StringPair:
+            return !m_user.isEmpty() ? QVariant::fromValue<UserProperty>(m_user.first()) : QVariant();
+        default: break;
+    }
+    return QVariant();
+}
+
+void Properties::append(const Property & property)
+{
+    const PropertyId id = property.first;
+    const PropertySchema & s = schema(id);
+    if (s.slot < 0)
+        decodeEncoded();
+    switch (s.type)
+    {
+        case PropertyType::Byte:
+        case PropertyType::TwoByteInteger:
+        case PropertyType::FourByteInteger:     setInteger(id, property.second.toUInt());                         break;
+        case PropertyType::UTF8String:          m_strings.append({ id, property.second.toString() });              break;
+        case PropertyType::BinaryData:          m_binaries.append({ id, property.second.toByteArray() });          break;
+        case PropertyType::VariableByteInteger: m_subscription_ids.append(property.second.toUInt());              break;
+        case PropertyType::UTF8StringPair:      m_user.append(property.second.value<UserProperty>());            break;
+        default: break;
+    }
+}
+
+void Properties::set(PropertyId id, const QVariant & value)
+{
+    remove(id);
+    append({ id, value });
+}
+
+void Properties::remove(PropertyId id)
+{
+    const PropertySchema & s = schema(id);
+    if (s.slot < 0)
+        decodeEncoded();
+    switch (s.type)
+    {
+        case PropertyType::Byte:
+        case PropertyType::TwoByteInteger:
+        case PropertyType::FourByteInteger:     m_present &= ~(1u << s.slot); break;
+        case PropertyType::UTF8String:          removeAll(m_strings, id);      break;
+        case PropertyType::BinaryData:          removeAll(m_binaries, id);     break;
+        case PropertyType::VariableByteInteger: m_subscription_ids.clear();    break;
+        case PropertyType::UTF8StringPair:      m_user.clear();                break;
+        default: break;
+    }
+}
+
+quint32 Properties::integer(PropertyId id, quint32 defaultValue) const
+{
+    const PropertySchema & s = schema(id);
+    if (s.slot < 0 || !(m_present & (1u << s.slot)))
+        return defaultValue;
+    return m_integers[s.slot];
+}
+
+void Properties::setInteger(PropertyId id, quint32 value)
+{
+    const PropertySchema & s = schema(id);
+    if (s.slot < 0)
+        return;
+    m_integers[s.slot] = value;
+    m_present |= (1u << s.slot);
+}
+
+Property Properties::at(int i) const
+{
+    decodeEncoded();
+
+    for (int slot = 0; slot < IntegerSlotsCount; ++slot) {
+        if (m_present & (1u << slot)) {
+            if (i == 0)
+                return { slot_ids[slot], QVariant(m_integers[slot]) };
+            --i;
+        }
+    }
+    if (i < m_strings.count())
+        return { m_strings.at(i).id, QVariant(m_strings.at(i).value) };
+    i -= m_strings.count();
+    if (i < m_binaries.count())
+        return { m_binaries.at(i).id, QVariant(m_binaries.at(i).value) };
+    i -= m_binaries.count();
+    if (i < m_subscription_ids.count())
+        return { PropertyId::SubscriptionIdentifier, QVariant(m_subscription_ids.at(i)) };
+    i -= m_subscription_ids.count();
+    return { PropertyId::UserProperty, QVariant::fromValue<UserProperty>(m_user.at(i)) };
+}
+
+int Properties::encodedSize() const
+{
+    // property identifiers are less than 128, so each takes one byte
+    int size = 0;
+
+    for (int slot = 0; slot < IntegerSlotsCount; ++slot)
+        if (m_present & (1u << slot))
+            size += 1 + integerSize(schema(slot_ids[slot]).type);
+
+    for (const auto & e: m_strings)
+        size += 3 + Encoder::utf8Size(e.value);
+
+    for (const auto & e: m_binaries)
+        size += 3 + int(e.value.size());
+
+    for (quint32 id: m_subscription_ids)
+        size += 1 + Encoder::variableByteIntegerSize(id);
+
+    for (const UserProperty & p: m_user)
+        size += 5 + Encoder::utf8Size(p.first) + Encoder::utf8Size(p.second);
+
+    return size + int(m_encoded.size());
+}
+
+void Properties::write(BufferWriter & writer, int size) const
+{
+    writer.writeVariableByteInteger(quint64(size));
+
+    for (int slot = 0; slot < IntegerSlotsCount; ++slot) {
+        if (!(m_present & (1u << slot)))
+            continue;
+        writer.writeByte(static_cast<quint8>(slot_ids[slot]));
+        switch (schema(slot_ids[slot]).type)
+        {
+            case PropertyType::Byte:            writer.writeByte(quint8(m_integers[slot]));              break;
+            case PropertyType::TwoByteInteger:  writer.writeTwoByteInteger(quint16(m_integers[slot]));   break;
+            case PropertyType::FourByteInteger: writer.writeFourByteInteger(m_integers[slot]);            break;
+            default: break;
+        }
+    }
+
+    for (const auto & e: m_strings) {
+        writer.writeByte(static_cast<quint8>(e.id));
+        writer.writeUTF8(e.value);
+    }
+
+    for (const auto & e: m_binaries) {
+        writer.writeByte(static_cast<quint8>(e.id));
+        writer.writeBinaryData(e.value);
+    }
+
+    for (quint32 id: m_subscription_ids) {
+        writer.writeByte(static_cast<quint8>(PropertyId::SubscriptionIdentifier));
+        writer.writeVariableByteInteger(id);
+    }
+
+    for (const UserProperty & p: m_user) {
+        writer.writeByte(static_cast<quint8>(PropertyId::UserProperty));
+        writer.writeUTF8(p.first);
+        writer.writeUTF8(p.second);
+    }
+
+    writer.writeRaw(m_encoded);
+}
+
+// size of string or binary data with length prefix, 0 if it is truncated
+static qint64 prefixedSize(const quint8 * buf, qint64 length)
+{
+    if (length < 2)
+        return 0;
+    qint64 size = 2 + ((qint64(buf[0]) << 8) | buf[1]);
+    return (size <= length) ? size : 0;
+}
+
+// prefixed string must be well-formed UTF-8 without U+0000
+static inline bool isValidString(const quint8 * buf, qint64 size)
+{
+    return !(TextValidator::scanUtf8(reinterpret_cast<const char*>(buf + 2), size - 2) & (TextValidator::Malformed | TextValidator::Null));
+}
+
+bool Properties::read(const quint8 * buf, qint64 length, Decoding decoding)
+{
+    // bytes of properties which are kept encoded, usually they are contiguous
+    const quint8 * span = Q_NULLPTR;
+    qint64 span_len = 0;
+    QByteArray joined;
+    bool contiguous = true;
+
+    size_t len = 0;
+
+    while (length > 0)
+    {
+        const quint8 * property = buf;
+
+        const quint64 value = Decoder::decodeVariableByteInteger(buf, &length, &len);
+        if (len == 0 || value >= SCHEMA_SIZE)
+            return false;
+        buf += len;
+
+        const PropertyId id = static_cast<PropertyId>(value);
+        const PropertySchema & s = schema_table[value];
+
+        if (!s.multiple && contains(id))
+            return false;
+
+        qint64 size = 0;
+
+        switch (s.type)
+        {
+            case PropertyType::Byte:
+            case PropertyType::TwoByteInteger:
+            case PropertyType::FourByteInteger:
+            {
+                size = integerSize(s.type);
+                if (length < size)
+                    return false;
+                quint32 v = 0;
+                for (int i = 0; i < size; ++i)
+                    v = (v << 8) | buf[i];
+                setInteger(id, v);
+                buf += size; length -= size;
+                continue;
+            }
+            case PropertyType::VariableByteInteger:
+            {
+                quint64 v = Decoder::decodeVariableByteInteger(buf, &length, &len);
+                if (len == 0)
+                    return false;
+                m_subscription_ids.append(quint32(v));
+                buf += len;
+                continue;
+            }
+            case PropertyType::UTF8String:
+            {
+                size = prefixedSize(buf, length);
+                if (size == 0 || !isValidString(buf, size))
+                    return false;
+                break;
+            }
+            case PropertyType::BinaryData:
+            {
+                size = prefixedSize(buf, length);
+                if (size == 0)
+                    return false;
+                break;
+            }
+            case PropertyType::UTF8StringPair:
+            {
+                size = prefixedSize(buf, length);
+                qint64 second = (size != 0) ? prefixedSize(buf + size, length - size) : 0;
+                if (second == 0 || !isValidString(buf, size) || !isValidString(buf + size, second))
+                    return false;
+                size += second;
+                break;
+            }
+            default:
+                return false;
+        }
+
+        if (Decoding::Eager == decoding)
+        {
+            const char * data = reinterpret_cast<const char*>(buf);
+            switch (s.type)
+            {
+                case PropertyType::UTF8String: m_strings.append({ id, QString::fromUtf8(data + 2, int(size - 2)) });   break;
+                case PropertyType::BinaryData: m_binaries.append({ id, QByteArray(data + 2, int(size - 2)) });        break;
+                default: {
+                    int first = int(prefixedSize(buf, size));
+                    m_user.append(UserProperty(QString::fromUtf8(data + 2, first - 2), QString::fromUtf8(data + first + 2, int(size) - first - 2)));
+                    break;
+                }
+            }
+        }
+        else
+        {
+            const qint64 property_len = (buf - property) + size;
+            if (span == Q_NULLPTR) {
+                span = property;
+            } else if (contiguous && span + span_len != property) {
+                contiguous = false;
+                joined = QByteArray(reinterpret_cast<const char*>(span), int(span_len));
+            }
+            if (!contiguous)
+                joined.append(reinterpret_cast<const char*>(property), int(property_len));
+            span_len += property_len;
+            m_encoded_ids |= (quint64(1) << static_cast<int>(id));
+            ++m_encoded_count;
+        }
+
+        buf += size; length -= size;
+    }
+
+    if (span != Q_NULLPTR) {
+        if (!contiguous)
+            m_encoded = joined;
+        else if (Decoding::LazyShared == decoding)
+            m_encoded = QByteArray::fromRawData(reinterpret_cast<const char*>(span), int(span_len));
+        else
+            m_encoded = QByteArray(reinterpret_cast<const char*>(span), int(span_len));
+    }
+
+    return (length == 0);
+}
+
+void Properties::detach() const
+{
+    if (!m_encoded.isEmpty())
+        m_encoded = QByteArray(m_encoded.constData(), m_encoded.size());
+}
+
+void Properties::decodeEncoded() const
+{
+    if (m_encoded_count == 0)
+        return;
+
+    QByteArray encoded = m_encoded;
+    m_encoded.clear();
+    m_encoded_ids = 0;
+    m_encoded_count = 0;
+
+    // encoded bytes have been validated by read
+    const_cast<Properties*>(this)->read(reinterpret_cast<const quint8*>(encoded.constData()), encoded.size(), Decoding::Eager);
+}
@@ -0,0 +1,141 @@
+#ifndef MQTT_PROPERTIES_H
+#define MQTT_PROPERTIES_H
+
+#include "mqtt_enum_property_id.h"
+
+#include <QPair>
+#include <QString>
+#include <QVariant>
+#include <QByteArray>
+#include <QVarLengthArray>
+
+#include <initializer_list>
+
+namespace Mqtt
+{
+    class BufferWriter;
+
+    typedef QPair<QString, QString> UserProperty;
+    typedef QPair<PropertyId, QVariant> Property;
+
+    enum class PropertyType : quint8
+    {
+         Unknown
+        ,Byte
+        ,TwoByteInteger
+        ,FourByteInteger
+        ,VariableByteInteger
+        ,UTF8String
+        ,BinaryData
+        ,UTF8StringPair
+    };
+
+    class PropertySchema
+    {
+    public:
+        PropertyType type;
+        // fixed slot of integer property, -1 if property is stored otherwise
+        qint8 slot;
+        // property may be included more than once
+        bool multiple;
+    };
+
+    // MQTT 5 properties, integer properties are kept in fixed slots,
+    // strings, binary data, subscription identifiers and user properties in small inline arrays,
+    // lazily read strings, binary data and user properties stay encoded until first access
+    class Properties
+    {
+    public:
+        typedef QVarLengthArray<quint32, 2> SubscriptionIdentifiers;
+        typedef QVarLengthArray<UserProperty, 1> UserProperties;
+
+        enum { IntegerSlotsCount = 16 };
+
+        enum class Decoding : quint8
+        {
+             Eager
+            ,Lazy        /* strings, binary data and user properties are kept encoded till accessed */
+            ,LazyShared  /* same as Lazy, encoded bytes reference decoded buffer without copying */
+        };
+
+    public:
+        Properties();
+        Properties(std::initializer_list<Property> props);
+
+    public:
+        static const PropertySchema & schema(PropertyId id);
+        // bit per property id
+        static quint64 mask(std::initializer_list<PropertyId> ids);
+
+    public:
+        bool isEmpty() const;
+        int count() const;
+        void clear();
+
+        bool contains(PropertyId id) const;
+        // bit per id of contained properties
+        quint64 ids() const;
+        // value of first property with id
+        QVariant value(PropertyId id) const;
+        void append(const Property & property);
+        // replaces all properties with id
+        void set(PropertyId id, const QVariant & value);
+        void remove(PropertyId id);
+
+        quint32 integer(PropertyId id, quint32 defaultValue = 0) const;
+        void setInteger(PropertyId id, quint32 value);
+
+        const SubscriptionIdentifiers & subscriptionIdentifiers() const;
+        void addSubscriptionIdentifier(quint32 id);
+
+        const UserProperties & userProperties() const;
+
+        // properties in encoding order: integers, strings, binary data, subscription identifiers, user properties
+        Property at(int i) const;
+        Property operator[](int i) const;
+
+    public:
+        // size without length prefix
+        int encodedSize() const;
+        // writes length prefix and properties
+        void write(BufferWriter & writer, int size) const;
+        // validates all properties in one pass, fails on unknown property,
+        // truncated value or repeated property which may be included once
+        bool read(const quint8 * buf, qint64 length, Decoding decoding = Decoding::Eager);
+        // copies encoded bytes read by LazyShared decoding, so they don't reference decoded buffer anymore
+        void detach() const;
+
+    private:
+        template<typename T>
+        class Entry
+        {
+        public:
+            PropertyId id;
+            T value;
+        };
+
+        typedef QVarLengthArray<Entry<QString>, 1> Strings;
+        typedef QVarLengthArray<Entry<QByteArray>, 1> Binaries;
+
+        void decodeEncoded() const;
+
+        quint32                 m_integers[IntegerSlotsCount];
+        quint16                 m_present;
+        mutable Strings         m_strings;
+        mutable Binaries        m_binaries;
+        SubscriptionIdentifiers m_subscription_ids;
+        mutable UserProperties  m_user;
+        // not decoded strings, binary data and user properties as received
+        mutable QByteArray      m_encoded;
+        mutable quint64         m_encoded_ids;
+        mutable int             m_encoded_count;
+    };
+
+    inline bool Properties::isEmpty() const                                                  { return count() == 0;        }
+    inline Property Properties::operator[](int i) const                                      { return at(i);               }
+    inline void Properties::addSubscriptionIdentifier(quint32 id)                            { m_subscription_ids.append(id); }
+    inline const Properties::SubscriptionIdentifiers & Properties::subscriptionIdentifiers() const { return m_subscription_ids; }
+    inline const Properties::UserProperties & Properties::userProperties() const             { decodeEncoded(); return m_user; }
+}
+
+#endif // MQTT_PROPERTIES_H
@@ -0,0 +1,62 @@
+#include "mqtt_publish_frame_cache.h"
+#include "mqtt_codec.h"
+
+using namespace Mqtt;
+
+PublishFrameCache::PublishFrameCache()
+    :m_source(Q_NULLPTR)
+    ,m_entries()
+{
+
+}
+
+void PublishFrameCache::begin(const PublishPacket * source)
+{
+    m_entries.clear();
+    m_source = source;
+}
+
+void PublishFrameCache::end()
+{
+    m_entries.clear();
+    m_source = Q_NULLPTR;
+}
+
+QByteArray PublishFrameCache::frame(const PublishPacket & source, const PublishDelivery & delivery, Version version)
+{
+    static const std::vector<quint32> no_identifiers;
+
+    const quint8 flags = (static_cast<quint8>(delivery.qos) << 1) | (delivery.retain ? 1 : 0);
+    const std::vector<quint32> & identifiers = (delivery.identifiers != Q_NULLPTR) ? *delivery.identifiers : no_identifiers;
+
+    for (const Entry & entry: m_entries)
+        if (entry.version == version && entry.flags == flags && entry.identifiers == identifiers)
+            return entry.frame;
+
+    m_entries.push_back({ version, flags, identifiers, Codec::forVersion(version).serializeDelivery(source, delivery) });
+    return m_entries.back().frame;
+}
+
+void PublishFrameCache::setPacketId(QByteArray & frame, quint16 packetId, bool duplicate)
+{
+    char * p = frame.data();
+    const int size = frame.size();
+
+    p[0] = duplicate ? char(p[0] | 0x08) : char(p[0] & ~0x08);
+
+    // remaining length
+    int i = 1;
+    while (i < size && (quint8(p[i]) & 0x80))
+        ++i;
+    ++i;
+
+    // topic name
+    if (i + 2 > size)
+        return;
+    i += 2 + ((quint8(p[i]) << 8) | quint8(p[i + 1]));
+
+    if (i + 2 > size)
+        return;
+    p[i]     = char(packetId >> 8);
+    p[i + 1] = char(packetId & 0xFF);
+}
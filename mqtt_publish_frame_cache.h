@@ -0,0 +1,48 @@
+#ifndef MQTT_PUBLISH_FRAME_CACHE_H
+#define MQTT_PUBLISH_FRAME_CACHE_H
+
+#include "mqtt_publish_packet.h"
+
+#include <vector>
+
+namespace Mqtt
+{
+    // encoded frames of one message while it is fanned out to subscribers,
+    // subscribers with same protocol version, QoS, retain flag and subscription identifiers
+    // receive the same implicitly shared frame
+    class PublishFrameCache
+    {
+    public:
+        PublishFrameCache();
+
+    public:
+        void begin(const PublishPacket * source);
+        void end();
+        bool isBoundTo(const PublishPacket * packet) const;
+
+        // source is bound packet, delivery has subscriber's QoS, retain flag and identifiers,
+        // for QoS 1 and 2 frame contains packet id of delivery, it is replaced before sending
+        QByteArray frame(const PublishPacket & source, const PublishDelivery & delivery, Version version);
+
+        // sets packet id and DUP flag of encoded PUBLISH frame with QoS 1 or 2
+        static void setPacketId(QByteArray & frame, quint16 packetId, bool duplicate);
+
+    private:
+        class Entry
+        {
+        public:
+            Version version;
+            quint8 flags;
+            std::vector<quint32> identifiers;
+            QByteArray frame;
+        };
+
+        const PublishPacket * m_source;
+        // count of distinct frames per message is small
+        std::vector<Entry> m_entries;
+    };
+
+    inline bool PublishFrameCache::isBoundTo(const PublishPacket * packet) const { return (m_source != Q_NULLPTR && m_source == packet); }
+}
+
+#endif // MQTT_PUBLISH_FRAME_CACHE_H
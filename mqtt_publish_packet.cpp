@@ -1,7 +1,7 @@
 #include "mqtt_publish_packet.h"
 #include "mqtt_decoder.h"
 #include "mqtt_encoder.h"
-#include "mqtt_special_symbols.h"
+#include "mqtt_text_validator.h"
 #include "mqtt_constants.h"
 
 struct PublishFlags
@@ -85,70 +85,115 @@ void PublishPacket::setRetain(bool retain)
 
 QByteArray PublishPacket::serialize(Version protocolVersion) const
 {
-    QByteArray packet;
-
     switch (protocolVersion)
     {
         case Version::Ver_3_1:
-        case Version::Ver_3_1_1:
-        {
-            QByteArray topic = Encoder::encodeUTF8(m_header.topicName);
-
-            qint32 rlen = topic.length();
-            if (QoS() != Mqtt::QoS::Value_0)
-                rlen += 2; // packet id
-            rlen += m_payload.length();
+        case Version::Ver_3_1_1: return serialize<Version::Ver_3_1_1>();
+        case Version::Ver_5_0:   return serialize<Version::Ver_5_0>();
+        default: break;
+    }
+    return QByteArray();
+}
 
-            QByteArray remainlen = Encoder::encodeVariableByteInteger(rlen);
-            qint32 packlen = 1 + remainlen.length() + rlen;
+template <Version V>
+QByteArray PublishPacket::serialize() const
+{
+    return serialize<V>(PublishDelivery(*this));
+}
 
-            packet.reserve(packlen);
-            packet.append(reinterpret_cast<const char *>(&m_headerFix), 1);
-            packet.append(remainlen);
-            packet.append(topic);
-            if (QoS() != Mqtt::QoS::Value_0)
-                packet.append(Encoder::encodeTwoByteInteger(m_header.packetId));
-            packet.append(m_payload);
+template <Version V>
+QByteArray PublishPacket::serialize(const PublishDelivery & delivery) const
+{
+    // constant for each specialization, so v3 path has no properties code
+    const bool v5 = (Version::Ver_5_0 == V);
+    const bool with_id = (delivery.qos != Mqtt::QoS::Value_0);
+    const bool aliased = v5 && (delivery.topicAlias != 0);
+
+    const int topiclen = 2 + (aliased ? 0 : m_header.topicName.size());
+
+    int propslen = 0;
+    if (v5) {
+        propslen = propertiesSize(m_header.props);
+        if (delivery.identifiers != Q_NULLPTR)
+            for (quint32 id: *delivery.identifiers)
+                propslen += 1 + Encoder::variableByteIntegerSize(id);
+        if (aliased)
+            propslen += 3;
+    }
 
-            break;
+    qint32 rlen = topiclen;
+    if (with_id)
+        rlen += 2; // packet id
+    if (v5)
+        rlen += Encoder::variableByteIntegerSize(quint64(propslen)) + propslen;
+    rlen += m_payload.length();
+
+    QByteArray packet(1 + Encoder::variableByteIntegerSize(quint64(rlen)) + rlen, Qt::Uninitialized);
+
+    FixedHeader header = m_headerFix;
+    PublishFlags * flags = reinterpret_cast<PublishFlags*>(&header);
+    flags->qos    = static_cast<quint8>(delivery.qos);
+    flags->retain = delivery.retain;
+    if (!with_id)
+        flags->dup = 0;
+
+    BufferWriter writer(packet);
+    writer.writeRaw(reinterpret_cast<const char *>(&header), 1);
+    writer.writeVariableByteInteger(quint64(rlen));
+    if (aliased)
+        writer.writeTwoByteInteger(0);
+    else
+        writer.writeBinaryData(m_header.topicName.utf8());
+    if (with_id)
+        writer.writeTwoByteInteger(delivery.packetId);
+    if (v5) {
+        // length prefix covers recipient's properties written after source ones
+        writeProperties(writer, m_header.props, propslen);
+        if (delivery.identifiers != Q_NULLPTR) {
+            for (quint32 id: *delivery.identifiers) {
+                writer.writeByte(static_cast<quint8>(PropertyId::SubscriptionIdentifier));
+                writer.writeVariableByteInteger(id);
+            }
         }
-
-        case Version::Ver_5_0:
-        {
-            QByteArray topic = Encoder::encodeUTF8(m_header.topicName);
-            QByteArray props = serializeProperties(m_header.props);
-
-            qint32 rlen = topic.length();
-            if (QoS() != Mqtt::QoS::Value_0)
-                rlen += 2; // packet id
-            rlen += props.length();
-            rlen += m_payload.length();
-
-            QByteArray remainlen = Encoder::encodeVariableByteInteger(rlen);
-            qint32 packlen = 1 + remainlen.length() + rlen;
-
-            packet.reserve(packlen);
-            packet.append(reinterpret_cast<const char *>(&m_headerFix), 1);
-            packet.append(remainlen);
-            packet.append(topic);
-            if (QoS() != Mqtt::QoS::Value_0)
-                packet.append(Encoder::encodeTwoByteInteger(m_header.packetId));
-            packet.append(props);
-            packet.append(m_payload);
-
-            break;
+        if (aliased) {
+            writer.writeByte(static_cast<quint8>(PropertyId::TopicAlias));
+            writer.writeTwoByteInteger(delivery.topicAlias);
         }
-
-        default: break;
     }
+    writer.writeRaw(m_payload);
 
     return packet;
 }
 
 bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion)
+{
+    return (Version::Ver_5_0 == protocolVersion) ? unserialize<Version::Ver_5_0>(data, Q_NULLPTR)
+                                                 : unserialize<Version::Ver_3_1_1>(data, Q_NULLPTR);
+}
+
+bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion, const QByteArray & buffer)
+{
+    return (Version::Ver_5_0 == protocolVersion) ? unserialize<Version::Ver_5_0>(data, &buffer)
+                                                 : unserialize<Version::Ver_3_1_1>(data, &buffer);
+}
+
+void PublishPacket::detach() const
+{
+    if (m_buffer.isNull())
+        return;
+
+    // topic name is copied by decoder
+    m_payload = QByteArray(m_payload.constData(), m_payload.size());
+    m_header.props.detach();
+    m_buffer = QByteArray();
+}
+
+template <Version V>
+bool PublishPacket::unserialize(const QByteArray & data, const QByteArray * buffer)
 {
     m_header = Header();
     m_payload.clear();
+    m_buffer = (buffer != Q_NULLPTR) ? *buffer : QByteArray();
 
     size_t len = 0;
     qint64 remaining_length = ControlPacket::unserialize(data, &len);
@@ -170,10 +215,18 @@ bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion
                 return false;
             }
 
-            m_header.topicName = Decoder::decodeUTF8(buf, &remaining_length, &len); buf += len;
+            quint8 topic_flags = TextValidator::Valid;
+            const QByteArray topic_name = Decoder::decodeUTF8Bytes(buf, &remaining_length, &len, &topic_flags); buf += len;
+            m_header.topicName = TopicName(topic_name, topic_flags);
 
-            if (m_header.topicName.contains(Mqtt::SpecialSymbols::Plus)
-                    || m_header.topicName.contains(Mqtt::SpecialSymbols::Hash))
+            if (topic_flags & (TextValidator::Malformed | TextValidator::Null))
+            {
+                m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                m_unserializeReasonString = QStringLiteral("malformed packet: PUBLISH's topic is not valid UTF-8 string");
+                return false;
+            }
+
+            if (topic_flags & TextValidator::Wildcard)
             {
                 m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                 m_unserializeReasonString = QStringLiteral("PUBLISH's topic must not contain wildcars characters");
@@ -184,9 +237,17 @@ bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion
                 m_header.packetId = Decoder::decodeTwoByteInteger(buf, &remaining_length, &len); buf += len;
             }
 
-            if (Version::Ver_5_0 == protocolVersion) {
-                bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+            if (Version::Ver_5_0 == V) {
+                // forwarded as is, so only properties which broker uses are decoded
+                const Properties::Decoding decoding = (buffer != Q_NULLPTR) ? Properties::Decoding::LazyShared
+                                                                            : Properties::Decoding::Lazy;
+                bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props, decoding); buf += len;
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     if (ReasonCodeV5::Success == m_unserializeReasonCode) {
                         m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
@@ -196,9 +257,11 @@ bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion
                 }
             }
 
-            m_payload = (remaining_length > 0)
-                        ? QByteArray(reinterpret_cast<const char*>(buf), remaining_length)
-                        : QByteArray();
+            if (remaining_length > 0) {
+                m_payload = (buffer != Q_NULLPTR)
+                            ? QByteArray::fromRawData(reinterpret_cast<const char*>(buf), int(remaining_length))
+                            : QByteArray(reinterpret_cast<const char*>(buf), remaining_length);
+            }
 
             return true;
         }
@@ -212,78 +275,30 @@ bool PublishPacket::unserialize(const QByteArray & data, Version protocolVersion
 
 bool PublishPacket::isPropertiesValid(Properties & props)
 {
-    int payload_format_indicator_count = 0
-       ,message_expiry_interval_count = 0
-       ,topic_alias_count = 0
-       ,response_topic_count = 0
-       ,correlation_data_count = 0
-       ,content_type_count = 0;
-
-    for (int i = 0; i < props.count(); ++i)
-    {
-        switch (props[i].first)
-        {
-            case PropertyId::PayloadFormatIndicator:
-            {
-                ++payload_format_indicator_count;
-                if (payload_format_indicator_count > 1)
-                    return false;
-                break;
-            }
-            case PropertyId::MessageExpiryInterval:
-            {
-                ++message_expiry_interval_count;
-                if (message_expiry_interval_count > 1)
-                    return false;
-                break;
-            }
-            case PropertyId::TopicAlias:
-            {
-                ++topic_alias_count;
-                if (topic_alias_count > 1)
-                    return false;
-                quint16 ta = props[i].second.toUInt();
-                if (ta == 0 || ta > Constants::TopicAliasMaximum) {
-                    m_unserializeReasonCode = ReasonCodeV5::TopicAliasInvalid;
-                    return false;
-                }
-                break;
-            }
-            case PropertyId::ResponseTopic:
-            {
-                ++response_topic_count;
-                if (response_topic_count > 1)
-                    return false;
-                break;
-            }
-            case PropertyId::CorrelationData:
-            {
-                ++correlation_data_count;
-                if (correlation_data_count > 1)
-                    return false;
-                break;
-            }
-            case PropertyId::SubscriptionIdentifier:
-            {
-                quint32 id = props[i].second.toUInt();
-                if (id == 0 || id > Constants::MaxSubscriptionIdentifier)
-                    return false;
-                break;
-            }
-            case PropertyId::ContentType:
-            {
-                ++content_type_count;
-                if (content_type_count > 1)
-                    return false;
-                break;
-            }
-
-            case PropertyId::UserProperty: break;
+    // repeated properties are rejected by decoding
+    static const quint64 allowed = Properties::mask({ PropertyId::PayloadFormatIndicator
+                                                     ,PropertyId::MessageExpiryInterval
+                                                     ,PropertyId::TopicAlias
+                                                     ,PropertyId::ResponseTopic
+                                                     ,PropertyId::CorrelationData
+                                                     ,PropertyId::SubscriptionIdentifier
+                                                     ,PropertyId::ContentType
+                                                     ,PropertyId::UserProperty });
+    if (props.ids() & ~allowed)
+        return false;
 
-            default:                return false;
+    if (props.contains(PropertyId::TopicAlias)) {
+        quint32 ta = props.integer(PropertyId::TopicAlias);
+        if (ta == 0 || ta > Constants::TopicAliasMaximum) {
+            m_unserializeReasonCode = ReasonCodeV5::TopicAliasInvalid;
+            return false;
         }
     }
 
+    for (quint32 id: props.subscriptionIdentifiers())
+        if (id == 0 || id > Constants::MaxSubscriptionIdentifier)
+            return false;
+
     return true;
 }
 
@@ -309,48 +324,60 @@ PublishAnswerPacket::~PublishAnswerPacket()
 
 QByteArray PublishAnswerPacket::serialize(Version protocolVersion, qint32 maxPacketSize) const
 {
-    QByteArray packet;
-
     switch (protocolVersion)
     {
         case Version::Ver_3_1:
-        case Version::Ver_3_1_1:
-        {
-            packet.reserve(4);
-            packet.append(reinterpret_cast<const char *>(&m_headerFix), 1);
-            packet.append(Encoder::encodeVariableByteInteger(2));
-            packet.append(Encoder::encodeTwoByteInteger(m_header.packetId));
-            break;
-        }
-        case Version::Ver_5_0:
-        {
-            for (int i = 0; i < 2; ++i)
-            {
-                QByteArray props     = serializeProperties(m_header.props);
-                QByteArray remainlen = Encoder::encodeVariableByteInteger(props.length() + 3);
-                qint32 packlen       = remainlen.length() + props.length() + 4;
-                if (packlen > maxPacketSize && i == 0) {
-                    ControlPacket::removeProperty(m_header.props, PropertyId::ReasonString);
-                    ControlPacket::removeProperty(m_header.props, PropertyId::UserProperty);
-                    continue;
-                }
-                packet.reserve(packlen);
-                packet.append(reinterpret_cast<const char *>(&m_headerFix), 1);
-                packet.append(remainlen);
-                packet.append(Encoder::encodeTwoByteInteger(m_header.packetId));
-                packet.append(reinterpret_cast<const char*>(&m_header.reasonCodeV5), 1);
-                packet.append(props);
-                break;
-            }
-        }
-
+        case Version::Ver_3_1_1: return serialize<Version::Ver_3_1_1>(maxPacketSize);
+        case Version::Ver_5_0:   return serialize<Version::Ver_5_0>(maxPacketSize);
         default: break;
     }
+    return QByteArray();
+}
+
+template <Version V>
+QByteArray PublishAnswerPacket::serialize(qint32 maxPacketSize) const
+{
+    // reason code and properties may be omitted when reason code is success and there are no properties,
+    // so such v5 frame is the same as v3 one
+    if (Version::Ver_5_0 != V || (ReasonCodeV5::Success == m_header.reasonCodeV5 && m_header.props.isEmpty())) {
+        QByteArray packet(4, Qt::Uninitialized);
+        char * p = packet.data();
+        memcpy(p, &m_headerFix, 1);
+        p[1] = 2;
+        p[2] = char(m_header.packetId >> 8);
+        p[3] = char(m_header.packetId & 0xFF);
+        return packet;
+    }
+
+    int propslen = propertiesSize(m_header.props);
+    qint32 rlen = 3 + Encoder::variableByteIntegerSize(quint64(propslen)) + propslen;
+    if (1 + Encoder::variableByteIntegerSize(quint64(rlen)) + rlen > maxPacketSize) {
+        ControlPacket::removeProperty(m_header.props, PropertyId::ReasonString);
+        ControlPacket::removeProperty(m_header.props, PropertyId::UserProperty);
+        propslen = propertiesSize(m_header.props);
+        rlen = 3 + Encoder::variableByteIntegerSize(quint64(propslen)) + propslen;
+    }
+
+    QByteArray packet(1 + Encoder::variableByteIntegerSize(quint64(rlen)) + rlen, Qt::Uninitialized);
+
+    BufferWriter writer(packet);
+    writer.writeRaw(reinterpret_cast<const char *>(&m_headerFix), 1);
+    writer.writeVariableByteInteger(quint64(rlen));
+    writer.writeTwoByteInteger(m_header.packetId);
+    writer.writeByte(static_cast<quint8>(m_header.reasonCodeV5));
+    writeProperties(writer, m_header.props, propslen);
 
     return packet;
 }
 
 bool PublishAnswerPacket::unserialize(const QByteArray & data, Version protocolVersion)
+{
+    return (Version::Ver_5_0 == protocolVersion) ? unserialize<Version::Ver_5_0>(data)
+                                                 : unserialize<Version::Ver_3_1_1>(data);
+}
+
+template <Version V>
+bool PublishAnswerPacket::unserialize(const QByteArray & data)
 {
     m_header = Header();
 
@@ -370,13 +397,18 @@ bool PublishAnswerPacket::unserialize(const QByteArray & data, Version protocolV
         case PacketType::PUBCOMP:
         {
             m_header.packetId = Decoder::decodeTwoByteInteger(buf, &remaining_length, &len);   buf += len;
-            if (Version::Ver_5_0 == protocolVersion) {
+            if (Version::Ver_5_0 == V) {
                 if (remaining_length > 0) {
                     m_header.reasonCodeV5 = static_cast<ReasonCodeV5>(buf[0]);
                     ++buf; --remaining_length;
                 }
                 bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid properties");
@@ -417,3 +449,14 @@ bool PublishAnswerPacket::isPropertiesValid(Properties & props) const
 
     return true;
 }
+
+template QByteArray PublishPacket::serialize<Version::Ver_3_1_1>() const;
+template QByteArray PublishPacket::serialize<Version::Ver_5_0>() const;
+template QByteArray PublishPacket::serialize<Version::Ver_3_1_1>(const PublishDelivery & delivery) const;
+template QByteArray PublishPacket::serialize<Version::Ver_5_0>(const PublishDelivery & delivery) const;
+template bool PublishPacket::unserialize<Version::Ver_3_1_1>(const QByteArray & data, const QByteArray * buffer);
+template bool PublishPacket::unserialize<Version::Ver_5_0>(const QByteArray & data, const QByteArray * buffer);
+template QByteArray PublishAnswerPacket::serialize<Version::Ver_3_1_1>(qint32 maxPacketSize) const;
+template QByteArray PublishAnswerPacket::serialize<Version::Ver_5_0>(qint32 maxPacketSize) const;
+template bool PublishAnswerPacket::unserialize<Version::Ver_3_1_1>(const QByteArray & data);
+template bool PublishAnswerPacket::unserialize<Version::Ver_5_0>(const QByteArray & data);
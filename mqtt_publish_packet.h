@@ -2,10 +2,14 @@
 #define MQTT_PUBLISH_PACKET_H
 
 #include "mqtt_control_packet.h"
+#include "mqtt_topic_name.h"
 #include <QVariant>
+#include <vector>
 
 namespace Mqtt
 {
+    class PublishDelivery;
+
     class PublishPacket : public ControlPacket
     {
     public:
@@ -19,7 +23,7 @@ namespace Mqtt
             Header();
 
         public:
-            QString topicName;
+            TopicName topicName;
             quint16 packetId;
             Properties props;
         };
@@ -34,6 +38,9 @@ namespace Mqtt
         bool isRetained() const;
         void setRetain(bool retain);
 
+        const TopicName & topic() const;
+        void setTopic(const TopicName & topic);
+        // converted from/to UTF-8
         QString topicName() const;
         void setTopicName(const QString & topic);
 
@@ -48,22 +55,65 @@ namespace Mqtt
     public:
         QByteArray serialize(Version protocolVersion) const;
         bool unserialize(const QByteArray &data, Version protocolVersion);
+        // decodes without copying, payload references data located in buffer,
+        // buffer is kept by packet and its copies
+        bool unserialize(const QByteArray &data, Version protocolVersion, const QByteArray & buffer);
+        // copies payload and encoded properties which reference buffer and releases it,
+        // called for packet which is kept after delivery (retained, queued), value is not changed,
+        // so copies made after that share detached data
+        void detach() const;
+
+        // specialized for Ver_3_1_1 (used for Ver_3_1 too) and Ver_5_0, see Codec
+        template <Version V> QByteArray serialize() const;
+        template <Version V> QByteArray serialize(const PublishDelivery & delivery) const;
+        template <Version V> bool unserialize(const QByteArray &data, const QByteArray * buffer);
 
     private:
         bool isPropertiesValid(Properties & props);
 
     private:
         Header m_header;
-        QByteArray m_payload;
+        mutable QByteArray m_payload;
+        mutable QByteArray m_buffer;
+    };
+
+    inline const TopicName & PublishPacket::topic() const             { return m_header.topicName;             }
+    inline void PublishPacket::setTopic(const TopicName & topic)      { m_header.topicName = topic;            }
+    inline QString PublishPacket::topicName() const                   { return m_header.topicName.toString();  }
+    inline void PublishPacket::setTopicName(const QString & topic)    { m_header.topicName = TopicName(topic); }
+    inline quint16 PublishPacket::packetId() const                    { return m_header.packetId;              }
+    inline void PublishPacket::setPacketId(quint16 id)                { m_header.packetId = id;                }
+    inline Properties & PublishPacket::properties()                   { return m_header.props;                 }
+    inline QByteArray PublishPacket::payload() const                  { return m_payload;                      }
+    inline void PublishPacket::setPayload(const QByteArray & payload) { m_payload = payload;                   }
+
+
+    // recipient's overrides of shared source message, applied when message is encoded,
+    // so source packet is not copied for each recipient
+    class PublishDelivery
+    {
+    public:
+        explicit PublishDelivery(const PublishPacket & source);
+
+    public:
+        Mqtt::QoS qos;
+        bool retain;
+        quint16 packetId;
+        // topic name is omitted when alias is not 0
+        quint16 topicAlias;
+        // appended to properties of source, array must outlive encoding
+        const std::vector<quint32> * identifiers;
     };
 
-    inline QString PublishPacket::topicName() const                   { return m_header.topicName;  }
-    inline void PublishPacket::setTopicName(const QString & topic)    { m_header.topicName = topic; }
-    inline quint16 PublishPacket::packetId() const                    { return m_header.packetId;   }
-    inline void PublishPacket::setPacketId(quint16 id)                { m_header.packetId = id;     }
-    inline Properties & PublishPacket::properties()                   { return m_header.props;      }
-    inline QByteArray PublishPacket::payload() const                  { return m_payload;           }
-    inline void PublishPacket::setPayload(const QByteArray & payload) { m_payload = payload;        }
+    inline PublishDelivery::PublishDelivery(const PublishPacket & source)
+        :qos(source.QoS())
+        ,retain(source.isRetained())
+        ,packetId(source.packetId())
+        ,topicAlias(0)
+        ,identifiers(Q_NULLPTR)
+    {
+
+    }
 
 
     class PublishAnswerPacket : public ControlPacket
@@ -99,6 +149,10 @@ namespace Mqtt
         QByteArray serialize(Version protocolVersion, qint32 maxPacketSize) const;
         bool unserialize(const QByteArray &data, Version protocolVersion);
 
+        // specialized for Ver_3_1_1 (used for Ver_3_1 too) and Ver_5_0, see Codec
+        template <Version V> QByteArray serialize(qint32 maxPacketSize) const;
+        template <Version V> bool unserialize(const QByteArray &data);
+
     private:
         bool isPropertiesValid(Properties & props) const;
 
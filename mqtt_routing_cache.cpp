@@ -0,0 +1,145 @@
+#include "mqtt_routing_cache.h"
+
+using namespace Mqtt;
+
+RoutingCache::RoutingCache(int capacity)
+    :m_capacity(capacity > 0 ? capacity : 0)
+    ,m_hits(0)
+    ,m_misses(0)
+{
+
+}
+
+void RoutingCache::setCapacity(int capacity)
+{
+    m_capacity = (capacity > 0 ? capacity : 0);
+    while (m_index.count() > m_capacity)
+        erase(std::prev(m_entries.end()));
+}
+
+RoutingCacheEntry * RoutingCache::find(const TopicName & topicName)
+{
+    auto it = m_index.constFind(topicName);
+    if (it == m_index.constEnd()) {
+        ++m_misses;
+        return Q_NULLPTR;
+    }
+    ++m_hits;
+    Entries::iterator entry = *it;
+    if (entry != m_entries.begin())
+        m_entries.splice(m_entries.begin(), m_entries, entry);
+    return &(*entry);
+}
+
+RoutingCacheEntry * RoutingCache::insert(const TopicName & topicName, const Topic & topic)
+{
+    if (m_capacity == 0) {
+        m_uncached.subscribers.clear();
+        m_uncached.shared.clear();
+        return &m_uncached;
+    }
+
+    auto it = m_index.constFind(topicName);
+    if (it != m_index.constEnd())
+        erase(*it);
+
+    if (m_index.count() >= m_capacity)
+        erase(std::prev(m_entries.end()));
+
+    m_entries.emplace_front();
+    RoutingCacheEntry & entry = m_entries.front();
+    entry.topicName = topicName;
+    entry.path = TopicPath(topic);
+    m_index.insert(topicName, m_entries.begin());
+
+    Bucket & bucket = m_buckets[firstLevel(entry.path)];
+    entry.bucketPos = int(bucket.size());
+    bucket.push_back(m_entries.begin());
+
+    return &entry;
+}
+
+void RoutingCache::invalidate(const Topic & filter)
+{
+    static thread_local std::vector<Entries::iterator> matched;
+
+    if (filter.partsCount() == 0 || m_entries.empty())
+        return;
+
+    matched.clear();
+
+    const TopicLevelId first = filter.level(0);
+    if (TopicLevels::Plus == first || TopicLevels::Hash == first) {
+        // filter started with wildcard may match topic of any group
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+            if (matches(filter, (*it).path))
+                matched.push_back(it);
+    } else {
+        // level which is not interned is not a level of any cached topic
+        if (TopicLevels::Invalid == first)
+            return;
+        auto bucket = m_buckets.constFind(first);
+        if (bucket == m_buckets.constEnd())
+            return;
+        for (Entries::iterator it: *bucket)
+            if (matches(filter, (*it).path))
+                matched.push_back(it);
+    }
+
+    for (Entries::iterator it: matched)
+        erase(it);
+}
+
+void RoutingCache::clear()
+{
+    m_index.clear();
+    m_buckets.clear();
+    m_entries.clear();
+}
+
+void RoutingCache::erase(Entries::iterator entry)
+{
+    auto bucket_it = m_buckets.find(firstLevel((*entry).path));
+    if (bucket_it != m_buckets.end()) {
+        Bucket & bucket = *bucket_it;
+        // last entry of bucket takes place of erased one
+        const int pos = (*entry).bucketPos;
+        bucket[size_t(pos)] = bucket.back();
+        (*bucket[size_t(pos)]).bucketPos = pos;
+        bucket.pop_back();
+        if (bucket.empty())
+            m_buckets.erase(bucket_it);
+    }
+
+    m_index.remove((*entry).topicName);
+    m_entries.erase(entry);
+}
+
+TopicLevelId RoutingCache::firstLevel(const TopicPath & path)
+{
+    return (path.count() > 0 ? path.levels()[0] : TopicLevels::Invalid);
+}
+
+bool RoutingCache::matches(const Topic & filter, const TopicPath & path)
+{
+    const TopicLevelId * levels = path.levels();
+    const int count = path.count();
+
+    // topics started with '$' are not matched by filters started with wildcard
+    if (path.isSystem() && filter.partsCount() > 0
+            && (TopicLevels::Plus == filter.level(0) || TopicLevels::Hash == filter.level(0)))
+        return false;
+
+    int i = 0;
+    for ( ; i < filter.partsCount(); ++i) {
+        TopicLevelId level = filter.level(i);
+        if (TopicLevels::Hash == level)
+            return (i < count);
+        if (i >= count)
+            return false;
+        if (TopicLevels::Plus != level && levels[i] != level)
+            return false;
+    }
+
+    return (i == count);
+}
@@ -0,0 +1,85 @@
+#ifndef MQTT_ROUTING_CACHE_H
+#define MQTT_ROUTING_CACHE_H
+
+#include "mqtt_subscriptions_shared.h"
+#include "mqtt_session.h"
+#include "mqtt_constants.h"
+
+#include <QHash>
+#include <list>
+
+namespace Mqtt
+{
+    typedef std::vector<quint32> SubscriptionIdentifiersArray;
+
+    // subscribers resolved for one topic name
+    class RoutingCacheEntry
+    {
+    public:
+        class Subscriber
+        {
+        public:
+            SessionWPtr session;
+            // options of subscription with maximum QoS among all session's matching subscriptions
+            SubscribeOptions options;
+            SubscriptionIdentifiersArray identifiers;
+        };
+
+    public:
+        TopicName topicName;
+        TopicPath path;
+        std::vector<Subscriber> subscribers;
+        SharedSubscriptions::List shared;
+        // position in bucket of entries with the same first level
+        int bucketPos = -1;
+    };
+
+    // LRU cache of resolved subscribers by topic name,
+    // entries are invalidated by topic filter when its subscriptions are changed,
+    // entries are grouped by first level, so filter is checked against topics of its group only
+    class RoutingCache
+    {
+    public:
+        explicit RoutingCache(int capacity = Constants::DefaultRoutingCacheSize);
+
+    public:
+        int capacity() const;
+        void setCapacity(int capacity);
+        int count() const;
+        quint64 hits() const;
+        quint64 misses() const;
+
+        // counts hit or miss
+        RoutingCacheEntry * find(const TopicName & topicName);
+        // returns empty entry, if cache is disabled entry is valid till next insert
+        RoutingCacheEntry * insert(const TopicName & topicName, const Topic & topic);
+        // removes all entries which topic name matches with topic filter
+        void invalidate(const Topic & filter);
+        void clear();
+
+    private:
+        typedef std::list<RoutingCacheEntry> Entries;
+        typedef std::vector<Entries::iterator> Bucket;
+
+        void erase(Entries::iterator entry);
+        static TopicLevelId firstLevel(const TopicPath & path);
+        static bool matches(const Topic & filter, const TopicPath & path);
+
+    private:
+        int m_capacity;
+        quint64 m_hits;
+        quint64 m_misses;
+        // most recently used first
+        Entries m_entries;
+        QHash<TopicName, Entries::iterator> m_index;
+        QHash<TopicLevelId, Bucket> m_buckets;
+        RoutingCacheEntry m_uncached;
+    };
+
+    inline int RoutingCache::capacity() const   { return m_capacity;       }
+    inline int RoutingCache::count() const      { return m_index.count();  }
+    inline quint64 RoutingCache::hits() const   { return m_hits;           }
+    inline quint64 RoutingCache::misses() const { return m_misses;         }
+}
+
+#endif // MQTT_ROUTING_CACHE_H
@@ -4,6 +4,7 @@
 #include "mqtt_store_publish_container.h"
 #include "mqtt_encoder.h"
 #include "mqtt_decoder.h"
+#include "mqtt_text_validator.h"
 #include <QUuid>
 #include <QTimer>
 
@@ -33,6 +34,7 @@ Session::Session(QObject * parent)
     ,m_topic_alias_maximum(Constants::TopicAliasMaximum)
     ,m_conn()
     ,m_conn_packet(*kEmptyConnectPacket())
+    ,m_codec(&Codec::forVersion(m_conn_packet->protocolVersion()))
     ,m_data_controller()
     ,m_subscriptions()
     ,m_timer(Q_NULLPTR)
@@ -92,6 +94,7 @@ void Session::setConnectPacket(ConnectPacketPtr connectPacket)
 
     m_conn_packet = connectPacket.isNull() ? *kEmptyConnectPacket() : connectPacket;
     m_is_conn_packet_expects = connectPacket.isNull();
+    m_codec = &Codec::forVersion(protocolVersion());
     m_keep_alive_interval = this->connectPacket().keepAliveInterval() * 2; // 2 intervals in secs
 
     m_data_controller.setTimeout(m_keep_alive_interval);
@@ -134,11 +137,23 @@ void Session::clearConnection()
     cancelAllInFligthPackets();
 }
 
-void Session::addPendingPacket(const PublishPacket & packet)
+void Session::addPendingPacket(const PublishPacket & source, const PublishDelivery & delivery)
 {
     if (!hasBeenExpired()) {
         static thread_local QString fake_client_id;
-        m_pending_packets.add(m_pending_packets.nextOrderedKey(), fake_client_id, packet);
+        m_pending_packets.add(m_pending_packets.nextOrderedKey(), fake_client_id, source, delivery);
+    }
+}
+
+void Session::addPendingPacket(const PublishPacket & source, const PublishDelivery & delivery, Version version, const QByteArray & frame)
+{
+    if (!hasBeenExpired()) {
+        static thread_local QString fake_client_id;
+        const QString key = m_pending_packets.nextOrderedKey();
+        m_pending_packets.add(key, fake_client_id, source, delivery);
+        auto it = m_pending_packets.find(key);
+        if (it != m_pending_packets.end())
+            (*it).setFrame(version, frame);
     }
 }
 
@@ -243,14 +258,13 @@ QByteArray Session::serialize() const
     data.append(Encoder::encodeVariableByteInteger(m_ban_duration));
     data.append(Encoder::encodeVariableByteInteger(m_ban_timeout));
     // suscriptions with identifiers
-    auto nodes = m_subscriptions.toTopicNodeList();
-    data.append(Encoder::encodeFourByteInteger(nodes.count()));
+    data.append(Encoder::encodeFourByteInteger(quint32(m_subscriptions.count())));
     union { quint8 b; SubscribeOptions o = {}; } options;
-    for (auto & node: nodes) {
-        data.append(Encoder::encodeUTF8(node->topic()));
-        SessionSubscriptionData * d = dynamic_cast<SessionSubscriptionData*>(node->data());
-        data.append(Encoder::encodeFourByteInteger(d->identifier()));
-        options.o = d->options();
+    for (auto node: m_subscriptions) {
+        data.append(Encoder::encodeBinaryData(node->topic().utf8()));
+        const SessionSubscriptionData & d = node->data();
+        data.append(Encoder::encodeFourByteInteger(d.identifier()));
+        options.o = d.options();
         data.append(reinterpret_cast<const char*>(&options.b), sizeof(options.b));
     }
     data.append(m_conn_packet->serialize());
@@ -271,15 +285,16 @@ void Session::unserialize(const QByteArray & dataHex)
     quint32 topics_count = Decoder::decodeFourByteInteger(buf, &rl, &bc);     buf += bc;
     union { quint8 b; SubscribeOptions o = {}; } options;
     for (quint32 i = 0; i < topics_count; ++i) {
-        Topic   topic   (Decoder::decodeUTF8(buf, &rl, &bc));                 buf += bc;
+        quint8  flags  = TextValidator::Valid;
+        Topic   topic   (Decoder::decodeUTF8(buf, &rl, &bc, &flags));         buf += bc;
         quint32 sub_id = Decoder::decodeFourByteInteger(buf, &rl, &bc);       buf += bc;
         options.b      = *buf;                                              ++buf; --rl;
-        SubscriptionNode * node = m_subscriptions.provide(topic);
-        if (node->data() == Q_NULLPTR)
-            node->data() = new SessionSubscriptionData();
-        auto data = dynamic_cast<SessionSubscriptionData*>(node->data());
-        data->setOptions(options.o);
-        data->setIdentifier(sub_id);
+        // damaged record is skipped, following ones are still readable
+        if (flags & (TextValidator::Malformed | TextValidator::Null))
+            continue;
+        SessionSubscriptionData & data = m_subscriptions.provide(topic)->data();
+        data.setOptions(options.o);
+        data.setIdentifier(sub_id);
     }
 
     ConnectPacketPtr conn_packet(new ConnectPacket());
@@ -337,17 +352,17 @@ bool Session::processBrokerAlias(PublishPacket & pub)
 
         if (it == m_broker_aliases.end())
         {
-            if (pub.topicName().isEmpty())
+            if (pub.topic().isEmpty())
                 return false;
 
-            m_broker_aliases.insert(alias, pub.topicName());
+            m_broker_aliases.insert(alias, pub.topic());
         }
         else
         {
-            if (pub.topicName().isEmpty())
-                pub.setTopicName(*it);
+            if (pub.topic().isEmpty())
+                pub.setTopic(*it);
             else
-                *it = pub.topicName();
+                *it = pub.topic();
         }
 
         ControlPacket::removeProperty(pub.properties(), PropertyId::TopicAlias);
@@ -356,34 +371,32 @@ bool Session::processBrokerAlias(PublishPacket & pub)
     return true;
 }
 
-bool Session::processClientAlias(PublishPacket & pub)
+bool Session::processClientAlias(const TopicName & topic, quint16 * alias)
 {
-    auto it = m_client_aliases.find(pub.topicName());
+    auto it = m_client_aliases.find(topic);
 
     if (it == m_client_aliases.end())
     {
         if (m_client_aliases.count() == m_topic_alias_maximum)
             return false;
 
-        quint16 alias = m_client_aliases.count() + 1;
+        const quint16 new_alias = m_client_aliases.count() + 1;
 
-        PublishPacket packet = pub;
-        packet.setPayload(QByteArray());
+        PublishPacket packet;
+        packet.setTopic(topic);
         packet.setQoS(QoS::Value_0);
-        packet.setRetain(false);
-        packet.properties().clear();
-        packet.properties().append(Property { PropertyId::TopicAlias, alias });
+        packet.properties().append(Property { PropertyId::TopicAlias, new_alias });
 
-        QByteArray data = packet.serialize(protocolVersion());
+        QByteArray data = codec().serializePublish(packet);
         if (data.size() > maxPacketSize())
             return false;
 
-        it = m_client_aliases.insert(pub.topicName(), alias);
+        it = m_client_aliases.insert(topic, new_alias);
 
         connection().write(data);
     }
 
-    ControlPacket::setProperty(pub.properties(), PropertyId::TopicAlias, *it);
+    *alias = *it;
 
     return true;
 }
@@ -3,6 +3,7 @@
 
 #include "network_client.h"
 #include "mqtt_connect_packet.h"
+#include "mqtt_codec.h"
 #include "mqtt_chunk_data_controller.h"
 #include "mqtt_subscriptions_session.h"
 #include "mqtt_store_publish_container.h"
@@ -38,8 +39,8 @@ namespace Mqtt
     public:
         static constexpr quint32 FlowControlWindowSize = 5;
         typedef QMap<quint16, QString> InFligthContainer;
-        typedef QMap<quint16, QString> BrokerAliasContainer;
-        typedef QMap<QString, quint16> ClientAliasContainer;
+        typedef QMap<quint16, TopicName> BrokerAliasContainer;
+        typedef QHash<TopicName, quint16> ClientAliasContainer;
 
     public:
         void beforeDelete();
@@ -47,6 +48,8 @@ namespace Mqtt
 
         const QString & clientId() const;
         Version protocolVersion() const;
+        // selected by protocol version of connect packet
+        const Codec & codec() const;
         bool isClean() const;
 
         bool expectsConnectPacket() const;
@@ -81,11 +84,14 @@ namespace Mqtt
         quint16 receiveMaximum() const;
 
         bool hasQuota();
+        // count of QoS 1 and QoS 2 messages sent and not acknowledged yet
+        quint16 inFlightCount() const;
 
         bool hasPendingPacketsStorer() const;
         void setPendingPacketsStorer(Store::IStorer * storer);
         Store::IStorer * pendingPacketsStorer();
-        void addPendingPacket(const PublishPacket & packet);
+        void addPendingPacket(const PublishPacket & source, const PublishDelivery & delivery);
+        void addPendingPacket(const PublishPacket & source, const PublishDelivery & delivery, Version version, const QByteArray & frame);
 
         void removeAllStoredPackets();
         void cancelAllInFligthPackets();
@@ -116,7 +122,8 @@ namespace Mqtt
         void syncBanDuration(const Session & other);
 
         bool processBrokerAlias(PublishPacket & pub);
-        bool processClientAlias(PublishPacket & pub);
+        // sends alias announcement for new topic, alias is set when topic has it
+        bool processClientAlias(const TopicName & topic, quint16 * alias);
 
     private:
         void startTimer();
@@ -144,6 +151,7 @@ namespace Mqtt
 
         Network::ServerClient   m_conn;
         ConnectPacketPtr        m_conn_packet;
+        const Codec           * m_codec;
         ChunkDataController     m_data_controller;
         SessionSubscriptions    m_subscriptions;
         Store::PublishContainer m_pending_packets;
@@ -167,6 +175,7 @@ namespace Mqtt
     inline bool Session::hasBeenExpired() const                                       { return ((Constants::ForeverSessionInterval == m_expiry_interval) ? false : (elapsed() >= m_expiry_interval)); }
     inline const QString & Session::clientId() const                                  { return m_conn_packet->clientId(); }
     inline Version Session::protocolVersion() const                                   { return m_conn_packet->protocolVersion(); }
+    inline const Codec & Session::codec() const                                       { return *m_codec; }
     inline bool Session::isClean() const                                              { return m_conn_packet->cleanSession(); }
     inline bool Session::expectsConnectPacket() const                                 { return m_is_conn_packet_expects; }
     inline Network::ServerClient & Session::connection()                              { return m_conn; }
@@ -189,6 +198,7 @@ namespace Mqtt
     inline qint32 Session::maxPacketSize() const                                      { return m_packet_size_max; }
     inline quint16 Session::receiveMaximum() const                                    { return m_receive_maximum; }
     inline bool Session::hasQuota()                                                   { return m_quota > 0; }
+    inline quint16 Session::inFlightCount() const                                     { return m_receive_maximum - m_quota; }
     inline void Session::decreaseQuota()                                              { --m_quota; }
     inline void Session::increaseQuota()                                              { if (m_quota < m_receive_maximum) ++m_quota; }
     inline bool Session::hasPendingPacketsStorer() const                              { return m_pending_packets.hasStorer(); }
@@ -161,6 +161,8 @@ bool SessionsContainer::load(const QString & key)
     SessionContainerBase::insert(session->clientId(), session);
     setSessionPacketsStorer(session.data());
 
+    emit sessionLoaded(session);
+
     return true;
 }
 
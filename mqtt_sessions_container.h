@@ -19,6 +19,7 @@ namespace Mqtt
     signals:
         void sessionExpired(Session * session);
         void sessionBeforeDelete(Session * session);
+        void sessionLoaded(SessionPtr session);
 
     private slots:
         void expired();
@@ -65,6 +65,7 @@ PublishContainer::~PublishContainer()
 PublishContainer::size_type PublishContainer::remove(const QString & key)
 {
     scheduleSync(key);
+    m_paths.remove(key);
     return BaseContainer::remove(key);
 }
 
@@ -72,8 +73,24 @@ void PublishContainer::add(const QString & key, const QString & clientId, const
 {
     if (packet.payload().isEmpty())
         remove(key);
-    else
+    else {
+        // kept packet must not reference receive buffer of connection
+        packet.detach();
         operator[](key) = std::move(PublishUnit(key, clientId, packet));
+    }
+}
+
+void PublishContainer::add(const QString & key, const QString & clientId, const PublishPacket & source, const PublishDelivery & delivery)
+{
+    if (source.payload().isEmpty()) {
+        remove(key);
+    } else {
+        // unit is built in place, so source is copied only once
+        source.detach();
+        PublishUnit & unit = operator[](key);
+        unit = PublishUnit(key, clientId);
+        unit.setPacket(source, delivery);
+    }
 }
 
 PublishUnit & PublishContainer::operator[](const QString & key)
@@ -88,6 +105,7 @@ PublishUnit & PublishContainer::operator[](const QString & key)
 void PublishContainer::clear()
 {
     m_sync.clear();
+    m_paths.clear();
     BaseContainer::clear();
 }
 
@@ -109,6 +127,7 @@ void PublishContainer::preload()
 BaseContainer::iterator PublishContainer::erase(iterator it)
 {
     scheduleSync(it.key());
+    m_paths.remove(it.key());
     return BaseContainer::erase(it);
 }
 
@@ -137,6 +156,14 @@ QString PublishContainer::nextOrderedKey() const
     return QString::asprintf("%010d", index);
 }
 
+const TopicPath & PublishContainer::topicPath(const QString & key)
+{
+    auto it = m_paths.find(key);
+    if (it == m_paths.end())
+        it = m_paths.insert(key, TopicPath(Topic(key)));
+    return *it;
+}
+
 bool PublishContainer::hasStorer() const
 {
     return  (m_storer != kEmptyStorer);
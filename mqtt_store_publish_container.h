@@ -2,8 +2,10 @@
 #define MQTT_STORE_PUBLISH_CONTAINER_H
 
 #include "mqtt_store_publish_unit.h"
+#include "mqtt_topic.h"
 #include <QMap>
 #include <QSet>
+#include <QHash>
 
 namespace Mqtt
 {
@@ -38,6 +40,7 @@ namespace Mqtt
         public:
             PublishUnit & operator[](const QString & key);
             void add(const QString & key, const QString & clientId, const PublishPacket & packet);
+            void add(const QString & key, const QString & clientId, const PublishPacket & source, const PublishDelivery & delivery);
             size_type remove(const QString & key);
             void syncAll();
             void sync(const QString & key);
@@ -46,6 +49,8 @@ namespace Mqtt
             BaseContainer::iterator insert(const_iterator pos, const QString & key, const PublishUnit & value);
             void removeAll();
             QString nextOrderedKey() const;
+            // for containers keyed by topic name (retained messages), interned levels of key are cached
+            const TopicPath & topicPath(const QString & key);
 
         public:
             bool hasStorer() const;
@@ -82,6 +87,7 @@ namespace Mqtt
             IStorer * m_storer  = Q_NULLPTR;
             int m_sync_timer_id = 0;
             UniqueOrderedQueue<QString> m_sync;
+            QHash<QString, TopicPath> m_paths;
         };
 
         inline IStorer * PublishContainer::storer() { return m_storer; }
@@ -5,6 +5,17 @@
 using namespace Mqtt;
 using namespace Mqtt::Store;
 
+PublishUnit::PublishUnit(const QString & key, const QString & clientId)
+    :m_loaded(true)
+    ,m_expiry_interval(0)
+    ,m_initial_time(QDateTime::currentSecsSinceEpoch())
+    ,m_client_id(clientId)
+    ,m_key(key)
+    ,m_packet()
+{
+
+}
+
 PublishUnit::PublishUnit(const QString & key, const QString & clientId, const PublishPacket & packet)
     :m_loaded(true)
     ,m_expiry_interval(0)
@@ -23,17 +34,33 @@ PublishUnit::~PublishUnit()
 
 void PublishUnit::setPacket(const PublishPacket & packet)
 {
+    // unit outlives delivery, so it must not keep receive buffer of connection,
+    // source is detached once and shared by units of all its subscribers
+    packet.detach();
     m_packet = packet;
+    m_frame.clear();
     QVariant v = ControlPacket::property(m_packet.properties(), PropertyId::MessageExpiryInterval);
     if (v.isValid()) {
         m_expiry_interval = v.toLongLong();
     }
 }
 
+void PublishUnit::setPacket(const PublishPacket & source, const PublishDelivery & delivery)
+{
+    setPacket(source);
+    m_packet.setQoS(delivery.qos);
+    m_packet.setRetain(delivery.retain);
+    if (delivery.identifiers != Q_NULLPTR)
+        for (quint32 id: *delivery.identifiers)
+            m_packet.properties().addSubscriptionIdentifier(id);
+}
+
 void PublishUnit::beforeSend()
 {
     QVariant v = ControlPacket::property(m_packet.properties(), PropertyId::MessageExpiryInterval);
     if (v.isValid()) {
+        if (elapsed() != 0)
+            m_frame.clear();
         v = (m_expiry_interval - elapsed());
         ControlPacket::setProperty(m_packet.properties(), PropertyId::MessageExpiryInterval, v);
     }
@@ -72,6 +99,7 @@ void PublishUnit::unserialize(const QByteArray & hex)
 void PublishUnit::unload()
 {
     m_packet = PublishPacket();
+    m_frame.clear();
     setLoaded(false);
 }
 
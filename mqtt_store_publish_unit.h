@@ -13,6 +13,7 @@ namespace Mqtt
         {
         public:
             PublishUnit() = default;
+            PublishUnit(const QString & key, const QString & clientId);
             PublishUnit(const QString & key, const QString & clientId, const PublishPacket & packet);
             ~PublishUnit();
 
@@ -22,10 +23,15 @@ namespace Mqtt
             qint64 elapsed() const;
             const PublishPacket & packet() const;
             void setPacket(const PublishPacket & packet);
+            // copy of source with recipient's QoS, retain flag and subscription identifiers
+            void setPacket(const PublishPacket & source, const PublishDelivery & delivery);
             const QString & clientId() const;
             const QString & key() const;
             void setKey(const QString & key);
             void beforeSend();
+            // encoded packet prepared on fan-out, valid while packet is not changed
+            QByteArray frame(Version version) const;
+            void setFrame(Version version, const QByteArray & frame);
             QByteArray serialize() const;
             void unserialize(const QByteArray & data);
             bool isLoaded();
@@ -39,6 +45,8 @@ namespace Mqtt
             QString       m_client_id;
             QString       m_key;
             PublishPacket m_packet;
+            Version       m_frame_version   = Version::Ver_5_0;
+            QByteArray    m_frame;
         };
 
         inline QoS PublishUnit::QoS() const                              { return m_packet.QoS(); }
@@ -48,6 +56,8 @@ namespace Mqtt
         inline bool PublishUnit::isLoaded()                              { return m_loaded;       }
         inline void PublishUnit::setLoaded(bool loaded)                  { m_loaded = loaded;     }
         inline const PublishPacket & PublishUnit::packet() const         { return m_packet;       }
+        inline QByteArray PublishUnit::frame(Version version) const      { return (version == m_frame_version) ? m_frame : QByteArray(); }
+        inline void PublishUnit::setFrame(Version version, const QByteArray & frame) { m_frame_version = version; m_frame = frame; }
         inline bool PublishUnit::expired() const                         { return (m_expiry_interval != 0 && (elapsed() >= m_expiry_interval)); }
         inline qint64 PublishUnit::elapsed() const                       { return (QDateTime::currentSecsSinceEpoch() - m_initial_time);        }
     }
@@ -1,6 +1,7 @@
 #include "mqtt_subscribe_packet.h"
 #include "mqtt_encoder.h"
 #include "mqtt_decoder.h"
+#include "mqtt_text_validator.h"
 #include "mqtt_special_symbols.h"
 
 using namespace Mqtt;
@@ -71,7 +72,12 @@ bool SubscribePacket::unserialize(const QByteArray & data, Version protocolVersi
             if (Version::Ver_5_0 == protocolVersion && remaining_length > 0)
             {
                 bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid properties");
@@ -82,7 +88,13 @@ bool SubscribePacket::unserialize(const QByteArray & data, Version protocolVersi
             QList<QPair<QString, SubscribeOptions> > topics;
 
             while (remaining_length > 0) {
-                QString topic = Decoder::decodeUTF8(buf, &remaining_length, &len); buf += len;
+                quint8  flags = TextValidator::Valid;
+                QString topic = Decoder::decodeUTF8(buf, &remaining_length, &len, &flags); buf += len;
+                if (flags & (TextValidator::Malformed | TextValidator::Null)) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: SUBSCRIBE's topic filter is not valid UTF-8 string");
+                    return false;
+                }
                 if (topic.isEmpty()) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid topic filter (is empty) in SUBSCRIBE packet");
@@ -206,7 +218,12 @@ bool UnsubscribePacket::unserialize(const QByteArray & data, Version protocolVer
             if (Version::Ver_5_0 == protocolVersion && remaining_length > 0)
             {
                 bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-                if ( ok) { ok = isPropertiesValid(m_header.props); }
+                if (!ok) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+                    return false;
+                }
+                ok = isPropertiesValid(m_header.props);
                 if (!ok) {
                     m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
                     m_unserializeReasonString = QStringLiteral("protocol error: invalid properties");
@@ -217,7 +234,13 @@ bool UnsubscribePacket::unserialize(const QByteArray & data, Version protocolVer
             QStringList topics;
 
             while (remaining_length > 0) {
-                topics << Decoder::decodeUTF8(buf, &remaining_length, &len); buf += len;
+                quint8 flags = TextValidator::Valid;
+                topics << Decoder::decodeUTF8(buf, &remaining_length, &len, &flags); buf += len;
+                if (flags & (TextValidator::Malformed | TextValidator::Null)) {
+                    m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+                    m_unserializeReasonString = QStringLiteral("malformed packet: UNSUBSCRIBE's topic filter is not valid UTF-8 string");
+                    return false;
+                }
             }
 
             m_topics = topics;
@@ -386,7 +409,12 @@ bool SubscribeAckPacket::unserialize(const QByteArray & data, Version protocolVe
     if (Version::Ver_5_0 == protocolVersion && remaining_length > 0)
     {
         bool ok = unserializeProperties(buf, &remaining_length, &len, m_header.props); buf += len;
-        if ( ok) { ok = isPropertiesValid(m_header.props); }
+        if (!ok) {
+            m_unserializeReasonCode = ReasonCodeV5::MalformedPacket;
+            m_unserializeReasonString = QStringLiteral("malformed packet: properties can't be decoded");
+            return false;
+        }
+        ok = isPropertiesValid(m_header.props);
         if (!ok) {
             m_unserializeReasonCode = ReasonCodeV5::ProtocolError;
             m_unserializeReasonString = QStringLiteral("protocol error: invalid properties");
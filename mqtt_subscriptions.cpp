@@ -1,96 +1,135 @@
 #include "mqtt_subscriptions.h"
 #include "mqtt_enum_qos.h"
 
-using namespace Mqtt;
-
-SubscriptionNodeData::~SubscriptionNodeData()
-{
+#include <algorithm>
 
-}
+using namespace Mqtt;
 
 SubscriptionNode::SubscriptionNode()
     :m_parent(Q_NULLPTR)
+    ,m_plus(Q_NULLPTR)
+    ,m_hash(Q_NULLPTR)
     ,m_children()
-    ,m_part()
-    ,m_data(Q_NULLPTR)
+    ,m_level(TopicLevels::Invalid)
+    ,m_wildcards(0)
+    ,m_filter(false)
+    ,m_prev_filter(Q_NULLPTR)
+    ,m_next_filter(Q_NULLPTR)
 {
 
 }
 
 SubscriptionNode::~SubscriptionNode()
 {
-    removeData();
-    qDeleteAll(m_children);
+    delete m_plus;
+    delete m_hash;
+    for (auto child: m_children)
+        delete child;
+    TopicLevels::release(m_level);
 }
 
-SubscriptionNode * SubscriptionNode::provideNode(const TopicPart & part)
+SubscriptionNode * SubscriptionNode::provideNode(const TopicPart & part, Factory factory)
 {
-    auto it = m_children.find(QString::fromRawData(part.data(), part.length()));
-    if (it == m_children.end()) {
-        SubscriptionNode * node = new SubscriptionNode();
-        node->m_parent  = this;
-        node->m_part    = part.toString();
-        it = m_children.insert(node->m_part, node);
+    TopicLevelId level = TopicLevels::find(part);
+
+    SubscriptionNode * node = findNode(level);
+    if (node != Q_NULLPTR)
+        return node;
+
+    node = factory();
+    node->m_parent = this;
+    node->m_level  = TopicLevels::acquire(part);
+
+    switch (node->m_level)
+    {
+        case TopicLevels::Plus: m_plus = node;                          break;
+        case TopicLevels::Hash: m_hash = node;                          break;
+        default:                m_children.insert(node->m_level, node); break;
     }
-    return *it;
+
+    return node;
 }
 
 SubscriptionNode * SubscriptionNode::findNode(const TopicPart & part) const
 {
-    auto it = m_children.find(QString::fromRawData(part.data(), part.length()));
-    if (it != m_children.end())
-        return *it;
-    return Q_NULLPTR;
+    return findNode(TopicLevels::find(part));
 }
 
-void SubscriptionNode::remove(SubscriptionNode *& node)
+SubscriptionNode * SubscriptionNode::findNode(TopicLevelId level) const
 {
-    auto it = std::find(m_children.begin(), m_children.end(), node);
-    if (it != m_children.end()) {
-        delete (*it);
-        m_children.erase(it);
-        node = Q_NULLPTR;
+    switch (level)
+    {
+        case TopicLevels::Invalid: return Q_NULLPTR;
+        case TopicLevels::Plus:    return m_plus;
+        case TopicLevels::Hash:    return m_hash;
+        default: break;
     }
+    return m_children.value(level);
 }
 
-void SubscriptionNode::removeData()
+void SubscriptionNode::remove(SubscriptionNode *& node)
 {
-    if (m_data != Q_NULLPTR) {
-        delete m_data;
-        m_data = Q_NULLPTR;
+    if (node == Q_NULLPTR || node->m_parent != this)
+        return;
+
+    if (node == m_plus) {
+        m_plus = Q_NULLPTR;
+    } else if (node == m_hash) {
+        m_hash = Q_NULLPTR;
+    } else if (m_children.take(node->m_level) != node) {
+        return;
     }
+
+    delete node;
+    node = Q_NULLPTR;
 }
 
-void SubscriptionNode::matchingNodes(const TopicPart & part, List * result) const
+void SubscriptionNode::matchingWildcardNodes(TopicLevelId level, Matches & result) const
 {
-    static thread_local QString PLUS { QChar { SpecialSymbols::Plus } };
-    static thread_local QString HASH { QChar { SpecialSymbols::Hash } };
+    if (level != TopicLevels::Invalid) {
+        SubscriptionNode * node = m_children.value(level);
+        if (node != Q_NULLPTR && node->m_wildcards != 0)
+            result.append(node);
+    }
 
-    auto it = m_children.find(QString::fromRawData(part.data(), part.length()));
-    if (it != m_children.end())
-        result->push_back(*it);
+    if (m_plus != Q_NULLPTR && m_plus->m_wildcards != 0)
+        result.append(m_plus);
 
-    it = m_children.find(PLUS);
-    if (it != m_children.end())
-        result->push_back(*it);
+    if (m_hash != Q_NULLPTR && m_hash->m_wildcards != 0)
+        result.append(m_hash);
+}
 
-    it = m_children.find(HASH);
-    if (it != m_children.end())
-        result->push_back(*it);
+bool SubscriptionNode::hasPath(const TopicLevelId * levels, int count) const
+{
+    const SubscriptionNode * n = this;
+    while (count > 0 && n->m_parent != Q_NULLPTR) {
+        if (n->m_level != levels[--count])
+            return false;
+        n = n->m_parent;
+    }
+    return (count == 0 && n->m_parent == Q_NULLPTR);
 }
 
 bool SubscriptionNode::matchesWith(const Topic & topic) const
 {
-    static thread_local SubscriptionNode::ConstList nodes;
+    return matchesWith(topic.levels(), topic.partsCount(), Topic::System == topic.destination());
+}
+
+bool SubscriptionNode::matchesWith(const TopicPath & path) const
+{
+    return matchesWith(path.levels(), path.count(), path.isSystem());
+}
 
-    if (m_data == Q_NULLPTR)
+bool SubscriptionNode::matchesWith(const TopicLevelId * levels, int count, bool system) const
+{
+    if (!m_filter)
         return false;
 
-    nodes.clear();
+    QVarLengthArray<const SubscriptionNode*, 16> nodes;
 
     const SubscriptionNode * n = this;
     while (n->parent() != Q_NULLPTR) {
-        nodes.push_back(n);
+        nodes.append(n);
         n = n->parent();
     }
 
@@ -98,40 +137,40 @@ bool SubscriptionNode::matchesWith(const Topic & topic) const
     auto r_it = nodes.rbegin();
     auto r_e_it = nodes.rend();
 
-    if (Topic::System == topic.destination()) {
-        if ((*r_it)->part() != topic[0])
+    if (system) {
+        if ((*r_it)->level() != levels[0])
             return false;
         ++r_it; ++i;
     }
 
-    while (r_it != r_e_it && i != topic.partsCount()) {
-        const QString & node_part = (*r_it)->part();
-        if (node_part == SpecialSymbols::Hash)
+    while (r_it != r_e_it && i != count) {
+        TopicLevelId node_level = (*r_it)->level();
+        if (node_level == TopicLevels::Hash)
             return true;
-        if (node_part != SpecialSymbols::Plus && node_part != topic[i])
+        if (node_level != TopicLevels::Plus && node_level != levels[i])
             return false;
         ++r_it; ++i;
     }
 
-    return ((r_it == r_e_it) && (i == topic.partsCount()));
+    return ((r_it == r_e_it) && (i == count));
 }
 
-QString SubscriptionNode::topic() const
+TopicName SubscriptionNode::topic() const
 {
     static thread_local SubscriptionNode::ConstList nodes;
     nodes.clear();
 
-    size_t topiclen = 0;
+    int topiclen = 0;
 
     const SubscriptionNode * n = this;
     while(n->parent() != Q_NULLPTR) {
-        topiclen += n->part().length();
+        topiclen += n->part().size();
         ++topiclen;
         nodes.push_back(n);
         n = n->parent();
     } --topiclen;
 
-    QString topic;
+    QByteArray topic;
     topic.reserve(topiclen);
 
     auto r_it = nodes.rbegin();
@@ -144,41 +183,52 @@ QString SubscriptionNode::topic() const
         ++r_it;
     }
 
-    return topic;
+    return TopicName(topic);
 }
 
-Subscriptions::Subscriptions()
+SubscriptionsTree::SubscriptionsTree(SubscriptionNode::Factory factory)
+    :m_factory(factory)
+    ,m_node_root()
+    ,m_exact()
+    ,m_first_filter(Q_NULLPTR)
+    ,m_last_filter(Q_NULLPTR)
+    ,m_count(0)
 {
 
 }
 
-Subscriptions::~Subscriptions()
+SubscriptionsTree::~SubscriptionsTree()
 {
 
 }
 
-SubscriptionNode * Subscriptions::findNode(const Topic & topic)
+SubscriptionNode * SubscriptionsTree::findNode(const Topic & topic)
 {
     SubscriptionNode * n = &m_node_root;
     for (int i = 0; i < topic.partsCount(); ++i)
-        n = n ? n->findNode(topic[i]) : Q_NULLPTR;
+        n = n ? n->findNode(topic.level(i)) : Q_NULLPTR;
     return n;
 }
 
-SubscriptionNode * Subscriptions::provide(const Topic & topic)
+SubscriptionNode * SubscriptionsTree::provide(const Topic & topic, bool * created)
 {
     SubscriptionNode * n = &m_node_root;
     for (int i = 0; i < topic.partsCount(); ++i)
-        n = n->provideNode(topic[i]);
+        n = n->provideNode(topic[i], m_factory);
+    if (created != Q_NULLPTR)
+        *created = !n->m_filter;
+    if (!n->m_filter)
+        registerFilter(n);
     return n;
 }
 
-void Subscriptions::remove(SubscriptionNode * n)
+void SubscriptionsTree::remove(SubscriptionNode * n)
 {
     if (n == Q_NULLPTR)
         return;
 
-    n->removeData();
+    if (n->m_filter)
+        unregisterFilter(n);
 
     if (n->hasChildren())
         return;
@@ -186,88 +236,150 @@ void Subscriptions::remove(SubscriptionNode * n)
     while (n->parent()) {
         SubscriptionNode * p = n->parent();
         p->remove(n);
-        if (p->hasChildren())
+        // parent stays while it is prefix of other filters or filter itself
+        if (p->hasChildren() || p->m_filter)
             break;
         n = p;
     }
 }
 
-bool Subscriptions::has(const Topic & topic) const
+uint SubscriptionsTree::levelsHash(const TopicLevelId * levels, int count)
 {
-    static thread_local SubscriptionNode::List nodes;
-    static thread_local SubscriptionNode::List matching;
+    return qHashBits(levels, size_t(count) * sizeof(TopicLevelId));
+}
 
-    m_nodes_found.clear();
+// returns true if filter contains wildcards
+static bool filterLevels(const SubscriptionNode * node, std::vector<TopicLevelId> & levels)
+{
+    levels.clear();
 
-    nodes.clear();
-    matching.clear();
+    bool wildcard = false;
+    for (const SubscriptionNode * n = node; n->parent() != Q_NULLPTR; n = n->parent()) {
+        if (TopicLevels::Plus == n->level() || TopicLevels::Hash == n->level())
+            wildcard = true;
+        levels.push_back(n->level());
+    }
+    std::reverse(levels.begin(), levels.end());
 
-    int i = 0;
+    return wildcard;
+}
 
-    if (Topic::System == topic.destination()) {
-        SubscriptionNode * node = m_node_root.findNode(topic[0]);
-        if (node == Q_NULLPTR)
-            return false;
-        nodes.push_back(node); ++i;
+void SubscriptionsTree::registerFilter(SubscriptionNode * node)
+{
+    static thread_local std::vector<TopicLevelId> levels;
+    bool wildcard = filterLevels(node, levels);
+
+    node->m_filter = true;
+
+    node->m_prev_filter = m_last_filter;
+    node->m_next_filter = Q_NULLPTR;
+    if (m_last_filter != Q_NULLPTR)
+        m_last_filter->m_next_filter = node;
+    else
+        m_first_filter = node;
+    m_last_filter = node;
+    ++m_count;
+
+    if (wildcard) {
+        for (SubscriptionNode * n = node; n != Q_NULLPTR; n = n->m_parent)
+            ++n->m_wildcards;
     } else {
-        nodes.push_back(const_cast<SubscriptionNode*>(&m_node_root));
+        m_exact.insert(levelsHash(levels.data(), int(levels.size())), node);
     }
+}
 
-    for ( ; i < topic.partsCount(); ++i) {
-        for (auto node: nodes) {
-            if (node->part() == SpecialSymbols::Hash) {
-                matching.push_back(node);
-            } else {
-                node->matchingNodes(topic[i], const_cast<SubscriptionNode::List*>(&matching));
-            }
-        }
-        std::swap(nodes, matching);
-        matching.clear();
+void SubscriptionsTree::unregisterFilter(SubscriptionNode * node)
+{
+    static thread_local std::vector<TopicLevelId> levels;
+    bool wildcard = filterLevels(node, levels);
+
+    node->m_filter = false;
+
+    if (node->m_prev_filter != Q_NULLPTR)
+        node->m_prev_filter->m_next_filter = node->m_next_filter;
+    else
+        m_first_filter = node->m_next_filter;
+    if (node->m_next_filter != Q_NULLPTR)
+        node->m_next_filter->m_prev_filter = node->m_prev_filter;
+    else
+        m_last_filter = node->m_prev_filter;
+    node->m_prev_filter = node->m_next_filter = Q_NULLPTR;
+    --m_count;
+
+    if (wildcard) {
+        for (SubscriptionNode * n = node; n != Q_NULLPTR; n = n->m_parent)
+            --n->m_wildcards;
+    } else {
+        m_exact.remove(levelsHash(levels.data(), int(levels.size())), node);
     }
-
-    if (m_nodes_found.capacity() < nodes.size())
-        m_nodes_found.reserve(nodes.size());
-
-    for (auto node: nodes)
-        if (node->data() != Q_NULLPTR)
-            m_nodes_found.push_back(node);
-
-    return (m_nodes_found.size() != 0);
 }
 
-size_t countFinalNodes(const SubscriptionNode * node)
+SubscriptionNode * SubscriptionsTree::findExact(const Topic & topic) const
 {
-    size_t c = 0;
-    for (auto n: node->children()) {
-        if (n->data() != Q_NULLPTR)
-            ++c;
-        c += countFinalNodes(n);
+    if (m_exact.isEmpty())
+        return Q_NULLPTR;
+
+    const uint hash = levelsHash(topic.levels(), topic.partsCount());
+    auto it = m_exact.constFind(hash);
+    while (it != m_exact.constEnd() && it.key() == hash) {
+        if (it.value()->hasPath(topic.levels(), topic.partsCount()))
+            return it.value();
+        ++it;
     }
-    return c;
+
+    return Q_NULLPTR;
 }
 
-size_t Subscriptions::count() const
+bool SubscriptionsTree::has(const Topic & topic) const
 {
-    return ::countFinalNodes(&m_node_root);
+    SubscriptionNode::Matches nodes;
+    return (match(topic, nodes) != 0);
 }
 
-void collectFinalNodes(const SubscriptionNode * node, std::vector<SubscriptionNode*> & nodes)
+int SubscriptionsTree::match(const Topic & topic, SubscriptionNode::Matches & result) const
 {
-    for (auto n: node->children()) {
-        if (n->data() != Q_NULLPTR)
-            nodes.push_back(n);
-        collectFinalNodes(n, nodes);
+    const int initial_count = result.count();
+
+    SubscriptionNode * exact = findExact(topic);
+    if (exact != Q_NULLPTR)
+        result.append(exact);
+
+    if (m_node_root.m_wildcards == 0)
+        return (result.count() - initial_count);
+
+    // current and next levels frontiers, swapped by pointers
+    SubscriptionNode::Matches frontiers[2];
+    SubscriptionNode::Matches * nodes = &frontiers[0];
+    SubscriptionNode::Matches * matching = &frontiers[1];
+
+    int i = 0;
+
+    if (Topic::System == topic.destination()) {
+        SubscriptionNode * node = m_node_root.findNode(topic.level(0));
+        if (node == Q_NULLPTR || node->m_wildcards == 0)
+            return (result.count() - initial_count);
+        nodes->append(node); ++i;
+    } else {
+        nodes->append(const_cast<SubscriptionNode*>(&m_node_root));
     }
-}
 
-QList<SubscriptionNode*> Subscriptions::toTopicNodeList() const
-{
-    static thread_local std::vector<SubscriptionNode*> nodes;
-    nodes.clear();
-    ::collectFinalNodes(&m_node_root, nodes);
-    QList<SubscriptionNode*> list;
-    list.reserve(nodes.size());
-    for (auto n: nodes)
-        list.append(n);
-    return list;
+    for ( ; i < topic.partsCount() && !nodes->isEmpty(); ++i) {
+        TopicLevelId level = topic.level(i);
+        for (auto node: *nodes) {
+            if (TopicLevels::Hash == node->level()) {
+                matching->append(node);
+            } else {
+                node->matchingWildcardNodes(level, *matching);
+            }
+        }
+        std::swap(nodes, matching);
+        matching->clear();
+    }
+
+    // exact filter is reached by tree walk when deeper filters with wildcards exist
+    for (auto node: *nodes)
+        if (node->m_filter && node != exact)
+            result.append(node);
+
+    return (result.count() - initial_count);
 }
@@ -2,96 +2,259 @@
 #define MQTT_SUBSCRIPTIONS_H
 
 #include "mqtt_topic.h"
+#include "mqtt_topic_level_map.h"
 #include "mqtt_special_symbols.h"
 #include "mqtt_enum_qos.h"
 #include <vector>
 #include <QVariant>
+#include <QMultiHash>
+#include <QVarLengthArray>
 
 namespace Mqtt
 {
-    class Subscriptions;
-
-    class SubscriptionNodeData
-    {
-    public:
-        SubscriptionNodeData() = default;
-        virtual ~SubscriptionNodeData();
-    };
+    class SubscriptionsTree;
 
+    // node of topic filters tree, payload is stored inline by SubscriptionDataNode
     class SubscriptionNode
     {
     public:
         using List = std::vector<SubscriptionNode*>;
         using ConstList = std::vector<const SubscriptionNode*>;
+        // caller-owned buffer for matching results, usually doesn't allocate
+        using Matches = QVarLengthArray<SubscriptionNode*, 16>;
 
-        using Map = QMap<QString, SubscriptionNode*>;
+        using Map = TopicLevelMap<SubscriptionNode>;
+        using Factory = SubscriptionNode * (*)();
 
     public:
         SubscriptionNode();
-        ~SubscriptionNode();
+        virtual ~SubscriptionNode();
 
     public:
+        // node was provided as topic filter (not only as prefix of other filters)
+        bool isFilter() const;
+        // next filter of tree in insertion order
+        SubscriptionNode * nextFilter() const;
         bool hasChildren() const;
         SubscriptionNode * parent() const;
-        const QString & part() const;
+        TopicLevelId level() const;
+        QByteArray part() const;
 
-        SubscriptionNode * provideNode(const TopicPart & part);
         SubscriptionNode * findNode(const TopicPart & part) const;
-        void remove(SubscriptionNode *& node);
-        void removeData();
         bool matchesWith(const Topic & topic) const;
+        bool matchesWith(const TopicPath & path) const;
+        // children without wildcards, see plusChild() and hashChild()
         const Map & children() const;
-        QString topic() const;
-
-    public:
-        SubscriptionNodeData *& data();
+        SubscriptionNode * plusChild() const;
+        SubscriptionNode * hashChild() const;
+        TopicName topic() const;
 
     private:
-        void matchingNodes(const TopicPart & part, List * result) const;
+        SubscriptionNode * provideNode(const TopicPart & part, Factory factory);
+        void remove(SubscriptionNode *& node);
+        SubscriptionNode * findNode(TopicLevelId level) const;
+        bool hasPath(const TopicLevelId * levels, int count) const;
+        bool matchesWith(const TopicLevelId * levels, int count, bool system) const;
+        void matchingWildcardNodes(TopicLevelId level, Matches & result) const;
 
     private:
         SubscriptionNode * m_parent;
+        SubscriptionNode * m_plus;
+        SubscriptionNode * m_hash;
         Map m_children;
-        QString m_part;
-        SubscriptionNodeData * m_data;
+        TopicLevelId m_level;
+        // count of filters with wildcards in subtree (including node itself)
+        quint32 m_wildcards;
+        // node was provided as topic filter
+        bool m_filter;
+        // filters of tree are linked in insertion order
+        SubscriptionNode * m_prev_filter;
+        SubscriptionNode * m_next_filter;
 
     private:
-        friend class Subscriptions;
+        friend class SubscriptionsTree;
     };
 
-    inline bool SubscriptionNode::hasChildren() const                        { return (m_children.size() != 0); }
+    inline bool SubscriptionNode::isFilter() const                           { return m_filter;   }
+    inline SubscriptionNode * SubscriptionNode::nextFilter() const           { return m_next_filter; }
+    inline bool SubscriptionNode::hasChildren() const                        { return (!m_children.isEmpty() || m_plus != Q_NULLPTR || m_hash != Q_NULLPTR); }
     inline SubscriptionNode * SubscriptionNode::parent() const               { return m_parent;   }
-    inline const QString & SubscriptionNode::part() const                    { return m_part;     }
+    inline TopicLevelId SubscriptionNode::level() const                      { return m_level;    }
+    inline QByteArray SubscriptionNode::part() const                         { return TopicLevels::value(m_level); }
     inline const SubscriptionNode::Map & SubscriptionNode::children() const  { return m_children; }
-    inline SubscriptionNodeData *& SubscriptionNode::data()                  { return m_data;     }
+    inline SubscriptionNode * SubscriptionNode::plusChild() const            { return m_plus;     }
+    inline SubscriptionNode * SubscriptionNode::hashChild() const            { return m_hash;     }
 
 
-    class Subscriptions
+    template <typename T>
+    class SubscriptionDataNode : public SubscriptionNode
     {
     public:
-        Subscriptions();
-        ~Subscriptions();
+        T & data();
+        const T & data() const;
+        void resetData();
+
+    private:
+        T m_data;
+    };
 
+    template <typename T> inline T & SubscriptionDataNode<T>::data()             { return m_data; }
+    template <typename T> inline const T & SubscriptionDataNode<T>::data() const { return m_data; }
+    template <typename T> inline void SubscriptionDataNode<T>::resetData()       { m_data = T();  }
+
+
+    // untyped part of Subscriptions<T>,
+    // filters without wildcards are found by single lookup in hash table of whole filters,
+    // tree is walked only through branches which contain filters with wildcards
+    class SubscriptionsTree
+    {
     public:
-        SubscriptionNode * findNode(const Topic & topic);
-        SubscriptionNode * provide(const Topic & topic);
-        void remove(SubscriptionNode * node);
-        void remove(const Topic & topic);
+        explicit SubscriptionsTree(SubscriptionNode::Factory factory);
+        ~SubscriptionsTree();
+
+    public:
+        // matching doesn't change tree and uses no shared state,
+        // so it is reentrant and can run from several threads while tree is not modified
         bool has(const Topic & topic) const;
-        // for use after "has" method
-        const SubscriptionNode::List & nodes() const;
         const SubscriptionNode * const rootNode() const;
+        // count of filters, maintained on provide/remove
         size_t count() const;
-        QList<SubscriptionNode *> toTopicNodeList() const;
+
+    protected:
+        SubscriptionNode * findNode(const Topic & topic);
+        // created is set to true if node was not provided before as topic filter
+        SubscriptionNode * provide(const Topic & topic, bool * created);
+        void remove(SubscriptionNode * node);
+        // appends filter nodes which match with topic, returns count of appended nodes
+        int match(const Topic & topic, SubscriptionNode::Matches & result) const;
+        SubscriptionNode * firstFilter() const;
+
+    private:
+        static uint levelsHash(const TopicLevelId * levels, int count);
+        SubscriptionNode * findExact(const Topic & topic) const;
+        void registerFilter(SubscriptionNode * node);
+        void unregisterFilter(SubscriptionNode * node);
 
     private:
+        SubscriptionNode::Factory m_factory;
         SubscriptionNode m_node_root;
-        mutable SubscriptionNode::List m_nodes_found;
+        QMultiHash<uint, SubscriptionNode*> m_exact;
+        SubscriptionNode * m_first_filter;
+        SubscriptionNode * m_last_filter;
+        size_t m_count;
+    };
+
+    inline const SubscriptionNode * const SubscriptionsTree::rootNode() const   { return &m_node_root;    }
+    inline size_t SubscriptionsTree::count() const                              { return m_count;         }
+    inline SubscriptionNode * SubscriptionsTree::firstFilter() const            { return m_first_filter;  }
+
+
+    // subscriptions tree with payload of type T stored inline in its nodes
+    template <typename T>
+    class Subscriptions : public SubscriptionsTree
+    {
+    public:
+        using Node    = SubscriptionDataNode<T>;
+        using List    = std::vector<Node*>;
+        using Matches = QVarLengthArray<Node*, 16>;
+
+        // iterates filter nodes without collecting them,
+        // current node may be removed after iterator is advanced past it
+        class iterator
+        {
+        public:
+            explicit iterator(SubscriptionNode * node) : m_node(node) { }
+            Node * operator *() const                   { return static_cast<Node*>(m_node); }
+            iterator & operator ++()                    { m_node = m_node->nextFilter(); return *this; }
+            bool operator ==(const iterator & o) const  { return m_node == o.m_node; }
+            bool operator !=(const iterator & o) const  { return m_node != o.m_node; }
+
+        private:
+            SubscriptionNode * m_node;
+        };
+
+    public:
+        Subscriptions();
+
+    public:
+        Node * findNode(const Topic & topic);
+        Node * provide(const Topic & topic, bool * created = Q_NULLPTR);
+        void remove(Node * node);
+        void remove(const Topic & topic);
+        int match(const Topic & topic, Matches & result) const;
+        template <typename Visitor>
+        void forEachMatch(const Topic & topic, Visitor visitor) const;
+        iterator begin() const;
+        iterator end() const;
+
+    private:
+        static SubscriptionNode * createNode();
     };
 
-    inline void Subscriptions::remove(const Topic & topic)                  { return remove(findNode(topic)); }
-    inline const SubscriptionNode::List & Subscriptions::nodes() const      { return m_nodes_found;           }
-    inline const SubscriptionNode * const Subscriptions::rootNode() const   { return &m_node_root;            }
+    template <typename T>
+    Subscriptions<T>::Subscriptions()
+        :SubscriptionsTree(&Subscriptions<T>::createNode)
+    {
+
+    }
+
+    template <typename T>
+    SubscriptionNode * Subscriptions<T>::createNode()
+    {
+        return new Node();
+    }
+
+    template <typename T>
+    inline typename Subscriptions<T>::Node * Subscriptions<T>::findNode(const Topic & topic)
+    {
+        return static_cast<Node*>(SubscriptionsTree::findNode(topic));
+    }
+
+    template <typename T>
+    inline typename Subscriptions<T>::Node * Subscriptions<T>::provide(const Topic & topic, bool * created)
+    {
+        return static_cast<Node*>(SubscriptionsTree::provide(topic, created));
+    }
+
+    template <typename T>
+    void Subscriptions<T>::remove(Node * node)
+    {
+        if (node == Q_NULLPTR)
+            return;
+        node->resetData();
+        SubscriptionsTree::remove(node);
+    }
+
+    template <typename T>
+    inline void Subscriptions<T>::remove(const Topic & topic)
+    {
+        remove(findNode(topic));
+    }
+
+    template <typename T>
+    int Subscriptions<T>::match(const Topic & topic, Matches & result) const
+    {
+        SubscriptionNode::Matches nodes;
+        SubscriptionsTree::match(topic, nodes);
+        for (auto node: nodes)
+            result.append(static_cast<Node*>(node));
+        return nodes.count();
+    }
+
+    template <typename T>
+    template <typename Visitor>
+    void Subscriptions<T>::forEachMatch(const Topic & topic, Visitor visitor) const
+    {
+        SubscriptionNode::Matches nodes;
+        SubscriptionsTree::match(topic, nodes);
+        for (auto node: nodes)
+            visitor(static_cast<Node*>(node));
+    }
+
+    template <typename T>
+    inline typename Subscriptions<T>::iterator Subscriptions<T>::begin() const { return iterator(firstFilter()); }
+    template <typename T>
+    inline typename Subscriptions<T>::iterator Subscriptions<T>::end() const   { return iterator(Q_NULLPTR);     }
 }
 
 #endif // MQTT_SUBSCRIPTIONS_H
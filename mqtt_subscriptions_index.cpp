@@ -0,0 +1,15 @@
+#include "mqtt_subscriptions_index.h"
+
+using namespace Mqtt;
+
+void IndexSubscriptionData::add(SessionPtr session, SessionSubscriptionData * data)
+{
+    SubscriberData & subscriber = m_subscribers[session.data()];
+    subscriber.session = session.toWeakRef();
+    subscriber.data    = data;
+}
+
+int IndexSubscriptionData::remove(Session * session)
+{
+    return m_subscribers.remove(session);
+}
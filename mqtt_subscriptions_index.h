@@ -0,0 +1,40 @@
+#ifndef MQTT_SUBSCRIPTIONS_INDEX_H
+#define MQTT_SUBSCRIPTIONS_INDEX_H
+
+#include "mqtt_subscriptions_session.h"
+#include "mqtt_session.h"
+
+#include <QHash>
+
+namespace Mqtt
+{
+    class SubscriberData
+    {
+    public:
+        SessionWPtr session;
+        // owned by the node of the session's own subscriptions tree
+        SessionSubscriptionData * data = Q_NULLPTR;
+    };
+
+    typedef QHash<Session*, SubscriberData> SubscribersList;
+
+    // broker-wide subscriptions tree, each final node holds all sessions subscribed with this topic filter
+    class IndexSubscriptionData
+    {
+    public:
+        void add(SessionPtr session, SessionSubscriptionData * data);
+        int remove(Session * session);
+        const SubscribersList & subscribers() const;
+        bool isEmpty() const;
+
+    private:
+        SubscribersList m_subscribers;
+    };
+
+    typedef Subscriptions<IndexSubscriptionData> SubscriptionsIndex;
+
+    inline const SubscribersList & IndexSubscriptionData::subscribers() const { return m_subscribers;           }
+    inline bool IndexSubscriptionData::isEmpty() const                        { return m_subscribers.isEmpty(); }
+}
+
+#endif // MQTT_SUBSCRIPTIONS_INDEX_H
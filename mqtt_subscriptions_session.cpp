@@ -1,8 +0,0 @@
-#include "mqtt_subscriptions_session.h"
-
-using namespace Mqtt;
-
-SessionSubscriptionData::~SessionSubscriptionData()
-{
-
-}
@@ -6,12 +6,8 @@
 
 namespace Mqtt
 {
-    class SessionSubscriptionData : public SubscriptionNodeData
+    class SessionSubscriptionData
     {
-    public:
-        SessionSubscriptionData() = default;
-        ~SessionSubscriptionData() override;
-
     public:
         const SubscribeOptions & options() const;
         SubscribeOptions & options();
@@ -40,7 +36,7 @@ namespace Mqtt
     inline bool SessionSubscriptionData::isNew() const                             { return m_new;                  }
     inline void SessionSubscriptionData::setNew(bool value)                        { m_new = value;                 }
 
-    typedef Subscriptions SessionSubscriptions;
+    typedef Subscriptions<SessionSubscriptionData> SessionSubscriptions;
 }
 
 #endif // MQTT_SUBSCRIPTIONS_SESSION_H
@@ -2,49 +2,165 @@
 
 using namespace Mqtt;
 
-SharedSubscriptionData::~SharedSubscriptionData()
+static int indexOfMember(const SharedSubscriptionMembersList & members, Session * session)
 {
+    for (int i = 0; i < members.count(); ++i)
+        if (members.at(i).key == session)
+            return i;
+    return -1;
+}
 
+void SharedSubscriptionGroup::add(SessionPtr session, SubscribeOptions options, quint32 subscriptionId)
+{
+    for (SharedSubscriptionMembersList * members: { &m_connected, &m_disconnected }) {
+        int i = indexOfMember(*members, session.data());
+        if (i >= 0) {
+            (*members)[i].data = { options, subscriptionId };
+            return;
+        }
+    }
+
+    SharedSubscriptionMembersList & members = session->isConnected() ? m_connected : m_disconnected;
+    members.append({ session.data(), session.toWeakRef(), qHash(session->clientId()), { options, subscriptionId } });
 }
 
-void SharedSubscriptionData::add(const QString & consumer, SessionPtr session, SubscribeOptions options, quint32 subscriptionId)
+int SharedSubscriptionGroup::remove(Session * session)
+{
+    int count = 0;
+    for (SharedSubscriptionMembersList * members: { &m_connected, &m_disconnected }) {
+        auto it = members->begin();
+        while (it != members->end()) {
+            if ((*it).key == session || (*it).session.isNull()) {
+                it = members->erase(it);
+                ++count;
+                continue;
+            } ++it;
+        }
+    }
+    return count;
+}
+
+void SharedSubscriptionGroup::setConnected(Session * session, bool connected)
+{
+    SharedSubscriptionMembersList & from = connected ? m_disconnected : m_connected;
+    SharedSubscriptionMembersList & to   = connected ? m_connected    : m_disconnected;
+    int i = indexOfMember(from, session);
+    if (i >= 0)
+        to.append(from.takeAt(i));
+}
+
+int SharedSubscriptionGroup::leastInFlightIndex() const
+{
+    int result = -1;
+    quint16 least = 0;
+    const int count = m_connected.count();
+    // starts from next member, so members with equal load take turns
+    for (int n = 0; n < count; ++n) {
+        int i = (m_connected_next + n) % count;
+        SessionPtr session = m_connected.at(i).session.toStrongRef();
+        if (session.isNull() || !session->isConnected())
+            return i;
+        quint16 in_flight = session->inFlightCount();
+        if (result < 0 || in_flight < least) {
+            result = i;
+            least = in_flight;
+            if (least == 0)
+                break;
+        }
+    }
+    return result;
+}
+
+static quint64 stickyWeight(uint clientHash, uint topicHash)
+{
+    // murmur3 finalizer, weights of one client are independent for different topics
+    quint64 k = (quint64(clientHash) << 32) | topicHash;
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= Q_UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+int SharedSubscriptionGroup::stickyIndex(const SharedSubscriptionMembersList & members, uint topicHash)
 {
-    SharedSubscriptionSessionsList & sessions = m_consumers[consumer];
-    auto it = sessions.begin();
-    while (it != sessions.end()) {
-        auto & p = (*it);
-        SessionPtr s = p.session.toStrongRef();
-        if (s.isNull()) {
-            it = sessions.erase(it);
+    int result = -1;
+    quint64 best = 0;
+    for (int i = 0; i < members.count(); ++i) {
+        const quint64 weight = stickyWeight(members.at(i).clientHash, topicHash);
+        if (result < 0 || weight > best) {
+            result = i;
+            best = weight;
+        }
+    }
+    return result;
+}
+
+SharedSubscriptionSessionData SharedSubscriptionGroup::select(SharedStrategy strategy, uint topicHash)
+{
+    while (!m_connected.isEmpty())
+    {
+        int i = 0;
+        switch (strategy)
+        {
+            case SharedStrategy::RoundRobin:    i = m_connected_next % m_connected.count();           break;
+            case SharedStrategy::LeastInFlight: i = leastInFlightIndex();                             break;
+            case SharedStrategy::StickyTopic:   i = stickyIndex(m_connected, topicHash);              break;
+        }
+
+        const SharedSubscriptionMember & member = m_connected.at(i);
+        SessionPtr session = member.session.toStrongRef();
+        if (!session.isNull() && session->isConnected()) {
+            m_connected_next = (i + 1) % m_connected.count();
+            return { member.session, member.data };
+        }
+
+        // connection state has been changed without notification, fix placing of member
+        if (!session.isNull())
+            m_disconnected.append(member);
+        m_connected.removeAt(i);
+    }
+
+    while (!m_disconnected.isEmpty())
+    {
+        int i = m_disconnected_next % m_disconnected.count();
+        const SharedSubscriptionMember & member = m_disconnected.at(i);
+        SessionPtr session = member.session.toStrongRef();
+        if (session.isNull()) {
+            m_disconnected.removeAt(i);
             continue;
         }
-        if (s == session) {
-            p.data.options    = options;
-            p.data.identifier = subscriptionId;
-            return;
-        } ++it;
+        if (session->isConnected()) {
+            m_connected.append(m_disconnected.takeAt(i));
+            return { m_connected.last().session, m_connected.last().data };
+        }
+        m_disconnected_next = (i + 1) % m_disconnected.count();
+        return { member.session, member.data };
     }
-    sessions.push_back({ session.toWeakRef(), { options, subscriptionId } });
+
+    return SharedSubscriptionSessionData();
+}
+
+void SharedSubscriptionData::add(const QString & consumer, SessionPtr session, SubscribeOptions options, quint32 subscriptionId)
+{
+    m_consumers[consumer].add(session, options, subscriptionId);
 }
 
-int SharedSubscriptionData::remove(const QString & consumer, SessionPtr session)
+int SharedSubscriptionData::remove(const QString & consumer, Session * session)
 {
     auto consumer_it = m_consumers.find(consumer);
     if (consumer_it == m_consumers.end())
         return 0;
-    int count = 0;
-    SharedSubscriptionSessionsList & sessions = *consumer_it;
-    auto it = sessions.begin();
-    while (it != sessions.end()) {
-        auto & p = (*it);
-        SessionPtr s = p.session.toStrongRef();
-        if (s.isNull() || s == session) {
-            it = sessions.erase(it);
-            ++count;
-            continue;
-        } ++it;
-    }
-    if (sessions.size() == 0)
+    int count = (*consumer_it).remove(session);
+    if ((*consumer_it).isEmpty())
         m_consumers.erase(consumer_it);
     return count;
 }
+
+void SharedSubscriptionData::setConnected(const QString & consumer, Session * session, bool connected)
+{
+    auto consumer_it = m_consumers.find(consumer);
+    if (consumer_it != m_consumers.end())
+        (*consumer_it).setConnected(session, connected);
+}
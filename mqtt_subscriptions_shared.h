@@ -4,25 +4,12 @@
 #include "mqtt_subscriptions.h"
 #include "mqtt_subscribe_packet.h"
 #include "mqtt_session.h"
+#include "mqtt_enum_shared_strategy.h"
+
+#include <QSet>
 
 namespace Mqtt
 {
-    template <typename T>
-    class RoundRobinList : public QList<T>
-    {
-    public:
-        // prevent QList<->RoundRobinList swaps
-        inline void swap(RoundRobinList<T> &other) noexcept { QList<T>::swap(other); std::swap(head_index, other.head_index); }
-        inline void swap(int i, int j) { QList<T>::swapItemsAt(i, j); }
-
-        inline T &head()             { return QList<T>::operator [](head_index); }
-        inline const T &head() const { return QList<T>::at(head_index); }
-        inline void selectNext()     { head_index++; if (head_index >= QList<T>::size()) { head_index = QList<T>::size() <= 0 ? -1 : 0; } }
-
-    private:
-        qint32 head_index = -1;
-    };
-
     class SubscriptionOptionsSubscriptionIdPair
     {
     public:
@@ -41,28 +28,80 @@ namespace Mqtt
         SubscriptionOptionsSubscriptionIdPair data;
     };
 
-    typedef RoundRobinList<SharedSubscriptionSessionData> SharedSubscriptionSessionsList;
-    typedef QMap<QString, SharedSubscriptionSessionsList> SharedConsumersSessionsList;
+    class SharedSubscriptionMember
+    {
+    public:
+        // identifies member without locking of weak pointer
+        Session * key;
+        SessionWPtr session;
+        // hash of client id, stable weight key of sticky selection
+        uint clientHash;
+        SubscriptionOptionsSubscriptionIdPair data;
+    };
+
+    typedef QList<SharedSubscriptionMember> SharedSubscriptionMembersList;
 
-    class SharedSubscriptionData: public SubscriptionNodeData
+    // members of one consumer group, connected and disconnected members are kept in separate lists,
+    // which are updated when member connects or disconnects
+    class SharedSubscriptionGroup
     {
     public:
-        SharedSubscriptionData() = default;
-        ~SharedSubscriptionData() override;
+        void add(SessionPtr session, SubscribeOptions options, quint32 subscriptionId);
+        // removes session (and expired sessions) by pointer, session may be already released
+        int remove(Session * session);
+        void setConnected(Session * session, bool connected);
 
+        // selects connected member by strategy, if there are no connected members
+        // selects disconnected one (message is stored and sent when it becomes possible)
+        SharedSubscriptionSessionData select(SharedStrategy strategy, uint topicHash);
+
+        const SharedSubscriptionMembersList & connected() const;
+        const SharedSubscriptionMembersList & disconnected() const;
+        int count() const;
+        bool isEmpty() const;
+
+        // rendezvous (highest random weight) choice, member with maximum weight of (client, topic) wins,
+        // so adding or removing member moves only topics which it wins or has won
+        static int stickyIndex(const SharedSubscriptionMembersList & members, uint topicHash);
+
+    private:
+        int leastInFlightIndex() const;
+
+    private:
+        SharedSubscriptionMembersList m_connected;
+        SharedSubscriptionMembersList m_disconnected;
+        int m_connected_next = 0;
+        int m_disconnected_next = 0;
+    };
+
+    inline const SharedSubscriptionMembersList & SharedSubscriptionGroup::connected() const     { return m_connected;    }
+    inline const SharedSubscriptionMembersList & SharedSubscriptionGroup::disconnected() const  { return m_disconnected; }
+    inline int SharedSubscriptionGroup::count() const           { return m_connected.count() + m_disconnected.count();     }
+    inline bool SharedSubscriptionGroup::isEmpty() const        { return m_connected.isEmpty() && m_disconnected.isEmpty(); }
+
+    typedef QMap<QString, SharedSubscriptionGroup> SharedConsumersGroups;
+
+    class SharedSubscriptionData
+    {
+    public:
         void add(const QString & consumer, SessionPtr session, SubscribeOptions options, quint32 subscriptionId);
-        int remove(const QString & consumer, SessionPtr session);
-        SharedConsumersSessionsList & consumers();
+        int remove(const QString & consumer, Session * session);
+        void setConnected(const QString & consumer, Session * session, bool connected);
+        SharedConsumersGroups & consumers();
         bool isEmpty() const;
 
     private:
-        SharedConsumersSessionsList m_consumers;
+        SharedConsumersGroups m_consumers;
     };
 
-    typedef Subscriptions SharedSubscriptions;
+    typedef Subscriptions<SharedSubscriptionData> SharedSubscriptions;
+
+    // topic filter (without share name) and consumer name of session's shared subscription
+    typedef QPair<QString, QString> SharedSubscriptionMembership;
+    typedef QSet<SharedSubscriptionMembership> SharedSubscriptionMemberships;
 
-    inline SharedConsumersSessionsList & SharedSubscriptionData::consumers() { return m_consumers;           }
-    inline bool SharedSubscriptionData::isEmpty() const                      { return m_consumers.isEmpty(); }
+    inline SharedConsumersGroups & SharedSubscriptionData::consumers()  { return m_consumers;           }
+    inline bool SharedSubscriptionData::isEmpty() const                 { return m_consumers.isEmpty(); }
 }
 
 #endif // MQTT_SUBSCRIPTIONS_SHARED_H
@@ -0,0 +1,155 @@
+#include "mqtt_text_validator.h"
+#include "mqtt_special_symbols.h"
+
+// MQTT_TEXT_VALIDATOR_SCALAR disables vector code, so tests check scalar code on the same cases
+#if defined(__AVX2__) && !defined(MQTT_TEXT_VALIDATOR_SCALAR)
+#  include <immintrin.h>
+#  define MQTT_TEXT_VALIDATOR_AVX2
+#endif
+
+#if (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)) && !defined(MQTT_TEXT_VALIDATOR_SCALAR)
+#  include <emmintrin.h>
+#  define MQTT_TEXT_VALIDATOR_SSE2
+#endif
+
+using namespace Mqtt;
+
+static inline quint8 asciiFlags(quint8 c)
+{
+    if (c == SpecialSymbols::Null)
+        return TextValidator::Null;
+    if (c < 0x20 || c == 0x7F)
+        return TextValidator::Control;
+    if (c == SpecialSymbols::Plus || c == SpecialSymbols::Hash)
+        return TextValidator::Wildcard;
+    return TextValidator::Valid;
+}
+
+static inline bool isContinuation(quint8 b)
+{
+    return ((b & 0xC0) == 0x80);
+}
+
+// checks one code point, returns position after it or Q_NULLPTR if sequence is malformed
+static inline const quint8 * utf8Step(const quint8 * p, const quint8 * end, quint8 * flags)
+{
+    const quint8 c = p[0];
+
+    if (c < 0x80) {
+        *flags |= asciiFlags(c);
+        return p + 1;
+    }
+
+    *flags |= TextValidator::NonAscii;
+
+    if (c < 0xC2)
+        return Q_NULLPTR;
+
+    if (c < 0xE0) {
+        if (end - p < 2 || !isContinuation(p[1]))
+            return Q_NULLPTR;
+        // U+0080..U+009F
+        if (c == 0xC2 && p[1] < 0xA0)
+            *flags |= TextValidator::Control;
+        return p + 2;
+    }
+
+    if (c < 0xF0) {
+        if (end - p < 3 || !isContinuation(p[1]) || !isContinuation(p[2]))
+            return Q_NULLPTR;
+        // overlong form and surrogates
+        if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] >= 0xA0))
+            return Q_NULLPTR;
+        // U+FDD0..U+FDEF, U+FFFE and U+FFFF
+        if (c == 0xEF && ((p[1] == 0xB7 && p[2] >= 0x90 && p[2] < 0xB0) || (p[1] == 0xBF && p[2] >= 0xBE)))
+            *flags |= TextValidator::NonCharacter;
+        return p + 3;
+    }
+
+    if (c < 0xF5) {
+        if (end - p < 4 || !isContinuation(p[1]) || !isContinuation(p[2]) || !isContinuation(p[3]))
+            return Q_NULLPTR;
+        // overlong form and code points above U+10FFFF
+        if ((c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] >= 0x90))
+            return Q_NULLPTR;
+        // U+xFFFE and U+xFFFF of supplementary planes
+        if ((p[1] & 0x0F) == 0x0F && p[2] == 0xBF && p[3] >= 0xBE)
+            *flags |= TextValidator::NonCharacter;
+        return p + 4;
+    }
+
+    return Q_NULLPTR;
+}
+
+quint8 TextValidator::scanUtf8(const char * data, qint64 size)
+{
+    const quint8 * p   = reinterpret_cast<const quint8*>(data);
+    const quint8 * end = p + size;
+    quint8 flags = Valid;
+
+#ifdef MQTT_TEXT_VALIDATOR_AVX2
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i plus = _mm256_set1_epi8(char(SpecialSymbols::Plus));
+        const __m256i hash = _mm256_set1_epi8(char(SpecialSymbols::Hash));
+        const __m256i space = _mm256_set1_epi8(0x20);
+        const __m256i del   = _mm256_set1_epi8(0x7F);
+
+        while (end - p >= 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            if (_mm256_movemask_epi8(v) == 0) {
+                const int nulls = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+                if (nulls)
+                    flags |= Null;
+                // bytes are below 0x80 here, so signed compare is enough
+                if ((_mm256_movemask_epi8(_mm256_cmpgt_epi8(space, v)) & ~nulls) || _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, del)))
+                    flags |= Control;
+                if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, plus), _mm256_cmpeq_epi8(v, hash))))
+                    flags |= Wildcard;
+                p += 32;
+                continue;
+            }
+            // block has multibyte sequences, last of them may end in next block
+            const quint8 * block_end = p + 32;
+            while (p < block_end)
+                if ((p = utf8Step(p, end, &flags)) == Q_NULLPTR)
+                    return (flags | Malformed);
+        }
+    }
+#endif
+
+#ifdef MQTT_TEXT_VALIDATOR_SSE2
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i plus = _mm_set1_epi8(char(SpecialSymbols::Plus));
+        const __m128i hash = _mm_set1_epi8(char(SpecialSymbols::Hash));
+        const __m128i space = _mm_set1_epi8(0x20);
+        const __m128i del   = _mm_set1_epi8(0x7F);
+
+        while (end - p >= 16) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            if (_mm_movemask_epi8(v) == 0) {
+                const int nulls = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+                if (nulls)
+                    flags |= Null;
+                if ((_mm_movemask_epi8(_mm_cmplt_epi8(v, space)) & ~nulls) || _mm_movemask_epi8(_mm_cmpeq_epi8(v, del)))
+                    flags |= Control;
+                if (_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, plus), _mm_cmpeq_epi8(v, hash))))
+                    flags |= Wildcard;
+                p += 16;
+                continue;
+            }
+            const quint8 * block_end = p + 16;
+            while (p < block_end)
+                if ((p = utf8Step(p, end, &flags)) == Q_NULLPTR)
+                    return (flags | Malformed);
+        }
+    }
+#endif
+
+    while (p < end)
+        if ((p = utf8Step(p, end, &flags)) == Q_NULLPTR)
+            return (flags | Malformed);
+
+    return flags;
+}
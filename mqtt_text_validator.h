@@ -0,0 +1,29 @@
+#ifndef MQTT_TEXT_VALIDATOR_H
+#define MQTT_TEXT_VALIDATOR_H
+
+#include <QtGlobal>
+
+namespace Mqtt
+{
+    // checks MQTT strings in one pass: UTF-8 well-formedness, U+0000, control, non-characters and wildcard characters,
+    // ASCII blocks are checked by SSE2/AVX2 when available, other bytes by scalar code
+    class TextValidator
+    {
+    public:
+        enum Flags : quint8
+        {
+             Valid        = 0x00
+            ,Malformed    = 0x01 /* ill-formed UTF-8, surrogate code point or code point above U+10FFFF */
+            ,Null         = 0x02 /* U+0000 */
+            ,Wildcard     = 0x04 /* '+' or '#' */
+            ,NonAscii     = 0x08 /* informational, string has characters above U+007F */
+            ,Control      = 0x10 /* U+0001..U+001F or U+007F..U+009F, receiver may treat as malformed */
+            ,NonCharacter = 0x20 /* U+FDD0..U+FDEF or U+xFFFE, U+xFFFF, receiver may treat as malformed */
+        };
+
+        // scanning stops at first malformed sequence
+        static quint8 scanUtf8(const char * data, qint64 size);
+    };
+}
+
+#endif // MQTT_TEXT_VALIDATOR_H
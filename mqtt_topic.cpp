@@ -1,40 +1,57 @@
 #include "mqtt_topic.h"
 #include "mqtt_special_symbols.h"
+#include "mqtt_text_validator.h"
 
 using namespace Mqtt;
 
-Topic::Topic(const QString & topic)
+Topic::Topic(const TopicName & topic)
     :m_destination(All)
     ,m_consumer()
     ,m_value(topic)
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-    ,m_parts(m_value.splitRef(QChar(SpecialSymbols::Slash), Qt::KeepEmptyParts, Qt::CaseSensitive))
-#else
-    ,m_parts(QStringView{m_value}.split(QChar(SpecialSymbols::Slash), Qt::KeepEmptyParts, Qt::CaseSensitive))
-#endif
+    ,m_parts()
 {
-    if (!m_parts.isEmpty() && m_parts[0] == QStringLiteral("$share")) {
+    const char * begin = m_value.constData();
+    const char * end   = begin + m_value.size();
+    for (const char * p = begin; ; ++p) {
+        if (p == end || *p == char(SpecialSymbols::Slash)) {
+            m_parts.append(TopicPart(begin, int(p - begin)));
+            if (p == end)
+                break;
+            begin = p + 1;
+        }
+    }
+
+    if (m_parts[0] == "$share") {
         m_destination = Shared;
-        m_parts.erase(m_parts.begin());
+        m_parts.remove(0);
         if (!m_parts.isEmpty()) {
-            m_consumer = m_parts[0].toString();
-            m_parts.erase(m_parts.begin());
+            m_consumer = m_parts[0];
+            m_parts.remove(0);
         }
     }
-    else if (m_value.startsWith(SpecialSymbols::Dollar)) {
+    else if (m_value.startsWith("$")) {
         m_destination = System;
     }
+
+    m_levels.resize(m_parts.count());
+    TopicLevels::find(m_parts.constData(), m_parts.count(), m_levels.data());
+}
+
+Topic::Topic(const QString & topic)
+    :Topic(TopicName(topic))
+{
+
 }
 
 bool Topic::isValidForSubscribe() const
 {
-    if (m_value.isEmpty() || m_value.contains(SpecialSymbols::Null))
+    if (m_value.isEmpty() || (m_value.textFlags() & (TextValidator::Malformed | TextValidator::Null)))
         return false;
 
     if (Shared == m_destination) {
         if (m_consumer.isEmpty()
-              || m_consumer.contains(SpecialSymbols::Hash)
-                || m_consumer.contains(SpecialSymbols::Plus))
+              || memchr(m_consumer.data(), SpecialSymbols::Hash, size_t(m_consumer.size()))
+                || memchr(m_consumer.data(), SpecialSymbols::Plus, size_t(m_consumer.size())))
             return false;
         if (m_parts.isEmpty() || (m_parts[0].isEmpty() && m_parts.count() == 1))
             return false;
@@ -42,22 +59,69 @@ bool Topic::isValidForSubscribe() const
 
     int hash_count = 0;
     for (auto & p: m_parts)
-        if (p == SpecialSymbols::Hash)
+        if (p == "#")
             ++hash_count;
 
-    return (hash_count == 0 || (hash_count == 1 && m_parts.last() == SpecialSymbols::Hash));
+    return (hash_count == 0 || (hash_count == 1 && m_parts.last() == "#"));
 }
 
 bool Topic::isValidForPublish() const
 {
-    if (m_value.isEmpty()
-          || m_value.startsWith(QStringLiteral("$share"))
-            || m_value.contains(SpecialSymbols::Null))
+    if (m_value.isEmpty() || m_value.startsWith("$share"))
         return false;
 
-    for (auto & p: m_parts)
-        if (p == SpecialSymbols::Hash || p == SpecialSymbols::Plus)
-            return false;
+    // name decoded from packet keeps flags of decoder's scan, so it is not scanned again
+    return !(m_value.textFlags() & (TextValidator::Malformed | TextValidator::Null | TextValidator::Wildcard));
+}
+
+
+TopicPath::TopicPath()
+    :m_system(false)
+    ,m_levels()
+{
+
+}
 
-    return true;
+TopicPath::TopicPath(const Topic & topic)
+    :m_system(Topic::System == topic.destination())
+    ,m_levels()
+{
+    m_levels.reserve(topic.partsCount());
+    for (int i = 0; i < topic.partsCount(); ++i)
+        m_levels.push_back(TopicLevels::acquire(topic[i]));
+}
+
+TopicPath::TopicPath(const TopicPath & other)
+    :m_system(other.m_system)
+    ,m_levels(other.m_levels)
+{
+    acquire();
+}
+
+TopicPath & TopicPath::operator=(const TopicPath & other)
+{
+    if (this != &other) {
+        release();
+        m_system = other.m_system;
+        m_levels = other.m_levels;
+        acquire();
+    }
+    return *this;
+}
+
+TopicPath::~TopicPath()
+{
+    release();
+}
+
+void TopicPath::acquire()
+{
+    for (auto id: m_levels)
+        TopicLevels::acquire(id);
+}
+
+void TopicPath::release()
+{
+    for (auto id: m_levels)
+        TopicLevels::release(id);
 }
@@ -1,28 +1,20 @@
 #ifndef MQTT_TOPIC_H
 #define MQTT_TOPIC_H
 
-#include <QString>
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-#include <QStringRef>
-#else
-#include <QStringView>
-#endif
-#include <QVector>
+#include "mqtt_topic_levels.h"
+#include "mqtt_topic_name.h"
+
+#include <QVarLengthArray>
+#include <vector>
 
 namespace Mqtt
 {
-
-#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
-    typedef QStringRef TopicPart;
-    typedef QVector<TopicPart> TopicPartArray;
-#else
-    typedef QStringView TopicPart;
-    typedef QList<TopicPart> TopicPartArray;
-#endif
-
+    // topic name or filter split into levels, parts reference bytes of shared name and are kept inline,
+    // so parsing of topic with up to 16 levels doesn't allocate
     class Topic
     {
     public:
+        explicit Topic(const TopicName & topic);
         explicit Topic(const QString & topic);
 
     public:
@@ -36,24 +28,66 @@ namespace Mqtt
     public:
         int partsCount() const;
         const TopicPart & operator[](int i) const;
+        // interned level ids are resolved once at construction,
+        // level which is not interned yet has TopicLevels::Invalid id
+        TopicLevelId level(int i) const;
+        const TopicLevelId * levels() const;
 
+        const TopicName & name() const;
+        uint hash() const;
         Destination destination() const;
-        const QString & consumer() const;
+        // share name of shared subscription
+        QString consumer() const;
         bool isValidForSubscribe() const;
         bool isValidForPublish() const;
 
     private:
         Destination m_destination;
-        QString m_consumer;
-        QString m_value;
+        TopicPart m_consumer;
+        TopicName m_value;
+        // parts reference bytes of m_value
         TopicPartArray m_parts;
+        QVarLengthArray<TopicLevelId, 16> m_levels;
     };
 
-    inline Topic::Destination Topic::destination() const      { return m_destination;   }
-    inline const QString & Topic::consumer() const            { return m_consumer;      }
-    inline int Topic::partsCount() const                      { return m_parts.count(); }
-    inline const TopicPart & Topic::operator [](int i) const  { return m_parts[i];      }
+    inline const TopicName & Topic::name() const              { return m_value;              }
+    inline uint Topic::hash() const                           { return m_value.hash();       }
+    inline Topic::Destination Topic::destination() const      { return m_destination;        }
+    inline QString Topic::consumer() const                    { return m_consumer.toString(); }
+    inline int Topic::partsCount() const                      { return m_parts.count();      }
+    inline const TopicPart & Topic::operator [](int i) const  { return m_parts[i];           }
+    inline TopicLevelId Topic::level(int i) const             { return m_levels[i];          }
+    inline const TopicLevelId * Topic::levels() const         { return m_levels.constData(); }
+
+
+    // topic name stored as sequence of interned levels, levels are acquired for path's lifetime,
+    // so its ids stay valid and can be kept for a long time (e.g. by retained messages store)
+    class TopicPath
+    {
+    public:
+        TopicPath();
+        explicit TopicPath(const Topic & topic);
+        TopicPath(const TopicPath & other);
+        TopicPath & operator=(const TopicPath & other);
+        ~TopicPath();
+
+    public:
+        bool isSystem() const;
+        int count() const;
+        const TopicLevelId * levels() const;
+
+    private:
+        void acquire();
+        void release();
+
+    private:
+        bool m_system;
+        std::vector<TopicLevelId> m_levels;
+    };
 
+    inline bool TopicPath::isSystem() const                   { return m_system;             }
+    inline int TopicPath::count() const                       { return int(m_levels.size()); }
+    inline const TopicLevelId * TopicPath::levels() const     { return m_levels.data();      }
 }
 
 #endif // MQTT_TOPIC_H
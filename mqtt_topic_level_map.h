@@ -0,0 +1,153 @@
+#ifndef MQTT_TOPIC_LEVEL_MAP_H
+#define MQTT_TOPIC_LEVEL_MAP_H
+
+#include "mqtt_topic_levels.h"
+
+namespace Mqtt
+{
+    // open addressing (linear probing) hash map from interned topic level to pointer,
+    // keys are small integers, so single multiplication is enough for hashing
+    template <typename T>
+    class TopicLevelMap
+    {
+    public:
+        TopicLevelMap() = default;
+        TopicLevelMap(const TopicLevelMap & other) = delete;
+        TopicLevelMap & operator=(const TopicLevelMap & other) = delete;
+        ~TopicLevelMap() { delete [] m_slots; }
+
+    private:
+        class Slot
+        {
+        public:
+            TopicLevelId key;
+            T * value;
+        };
+
+    public:
+        class const_iterator
+        {
+        public:
+            const_iterator(const Slot * slot, const Slot * end) : m_slot(slot), m_end(end) { skipEmpty(); }
+            TopicLevelId key() const                            { return m_slot->key;   }
+            T * value() const                                   { return m_slot->value; }
+            T * operator *() const                              { return m_slot->value; }
+            const_iterator & operator ++()                      { ++m_slot; skipEmpty(); return *this; }
+            bool operator ==(const const_iterator & o) const    { return m_slot == o.m_slot; }
+            bool operator !=(const const_iterator & o) const    { return m_slot != o.m_slot; }
+
+        private:
+            void skipEmpty() { while (m_slot != m_end && m_slot->key == TopicLevels::Invalid) ++m_slot; }
+
+        private:
+            const Slot * m_slot;
+            const Slot * m_end;
+        };
+
+    public:
+        quint32 size() const           { return m_size;      }
+        bool isEmpty() const           { return m_size == 0; }
+        const_iterator begin() const   { return const_iterator(m_slots, m_slots + m_capacity);              }
+        const_iterator end() const     { return const_iterator(m_slots + m_capacity, m_slots + m_capacity); }
+
+        T * value(TopicLevelId key) const
+        {
+            if (m_size == 0)
+                return Q_NULLPTR;
+            for (quint32 i = index(key); ; i = (i + 1) & (m_capacity - 1)) {
+                const Slot & s = m_slots[i];
+                if (s.key == key)
+                    return s.value;
+                if (s.key == TopicLevels::Invalid)
+                    return Q_NULLPTR;
+            }
+        }
+
+        // key must not be present in map
+        void insert(TopicLevelId key, T * value)
+        {
+            if ((m_size + 1) * 4 > m_capacity * 3)
+                rehash(m_capacity == 0 ? 4 : m_capacity * 2);
+            place(key, value);
+            ++m_size;
+        }
+
+        T * take(TopicLevelId key)
+        {
+            if (m_size == 0)
+                return Q_NULLPTR;
+
+            const quint32 mask = m_capacity - 1;
+
+            quint32 i = index(key);
+            while (m_slots[i].key != key) {
+                if (m_slots[i].key == TopicLevels::Invalid)
+                    return Q_NULLPTR;
+                i = (i + 1) & mask;
+            }
+
+            T * result = m_slots[i].value;
+
+            // backward shift deletion, keeps probe sequences without tombstones
+            for (quint32 j = (i + 1) & mask; m_slots[j].key != TopicLevels::Invalid; j = (j + 1) & mask) {
+                quint32 k = index(m_slots[j].key);
+                bool between = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+                if (!between) {
+                    m_slots[i] = m_slots[j];
+                    i = j;
+                }
+            }
+            m_slots[i] = { TopicLevels::Invalid, Q_NULLPTR };
+
+            if (--m_size == 0) {
+                delete [] m_slots;
+                m_slots = Q_NULLPTR;
+                m_capacity = 0;
+                m_shift = 32;
+            }
+
+            return result;
+        }
+
+    private:
+        quint32 index(TopicLevelId key) const
+        {
+            return (m_shift < 32) ? ((key * 2654435769u) >> m_shift) : 0;
+        }
+
+        void place(TopicLevelId key, T * value)
+        {
+            quint32 i = index(key);
+            while (m_slots[i].key != TopicLevels::Invalid)
+                i = (i + 1) & (m_capacity - 1);
+            m_slots[i] = { key, value };
+        }
+
+        void rehash(quint32 capacity)
+        {
+            Slot * old_slots = m_slots;
+            quint32 old_capacity = m_capacity;
+
+            m_slots = new Slot[capacity];
+            for (quint32 i = 0; i < capacity; ++i)
+                m_slots[i] = { TopicLevels::Invalid, Q_NULLPTR };
+            m_capacity = capacity;
+            m_shift = 32;
+            while (capacity > 1) { capacity >>= 1; --m_shift; }
+
+            for (quint32 i = 0; i < old_capacity; ++i)
+                if (old_slots[i].key != TopicLevels::Invalid)
+                    place(old_slots[i].key, old_slots[i].value);
+
+            delete [] old_slots;
+        }
+
+    private:
+        Slot *  m_slots    = Q_NULLPTR;
+        quint32 m_capacity = 0;
+        quint32 m_size     = 0;
+        quint32 m_shift    = 32;
+    };
+}
+
+#endif // MQTT_TOPIC_LEVEL_MAP_H
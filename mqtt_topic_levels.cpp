@@ -0,0 +1,165 @@
+#include "mqtt_topic_levels.h"
+#include "mqtt_special_symbols.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <vector>
+
+using namespace Mqtt;
+
+class TopicLevelsTable
+{
+public:
+    TopicLevelsTable();
+
+public:
+    TopicLevelId acquire(const TopicPart & part);
+    TopicLevelId acquire(TopicLevelId id);
+    void release(TopicLevelId id);
+    TopicLevelId find(const TopicPart & part) const;
+    void find(const TopicPart * parts, int count, TopicLevelId * ids) const;
+    QByteArray value(TopicLevelId id) const;
+    int count() const;
+
+private:
+    TopicLevelId insert(const QByteArray & value);
+
+private:
+    class Level
+    {
+    public:
+        QByteArray value;
+        quint32 refs;
+    };
+
+    mutable QReadWriteLock    lock;
+    // keys reference bytes of levels values, so lookup by part doesn't allocate
+    QHash<TopicPart, TopicLevelId> ids;
+    std::vector<Level>        levels;
+    std::vector<TopicLevelId> released;
+};
+
+TopicLevelsTable::TopicLevelsTable()
+{
+    levels.push_back({ QByteArray(), 0 });
+    insert(QByteArray(1, char(SpecialSymbols::Plus)));
+    insert(QByteArray(1, char(SpecialSymbols::Hash)));
+}
+
+TopicLevelId TopicLevelsTable::insert(const QByteArray & value)
+{
+    TopicLevelId id = TopicLevels::Invalid;
+    if (released.empty()) {
+        id = TopicLevelId(levels.size());
+        levels.push_back({ value, 1 });
+    } else {
+        id = released.back();
+        released.pop_back();
+        levels[id] = { value, 1 };
+    }
+    ids.insert(TopicPart(value.constData(), int(value.size())), id);
+    return id;
+}
+
+TopicLevelId TopicLevelsTable::acquire(const TopicPart & part)
+{
+    QWriteLocker locker(&lock);
+    auto it = ids.constFind(part);
+    if (it != ids.constEnd()) {
+        ++levels[*it].refs;
+        return *it;
+    }
+    return insert(part.toByteArray());
+}
+
+TopicLevelId TopicLevelsTable::acquire(TopicLevelId id)
+{
+    if (id <= TopicLevels::Hash)
+        return id;
+
+    QWriteLocker locker(&lock);
+    ++levels[id].refs;
+    return id;
+}
+
+void TopicLevelsTable::release(TopicLevelId id)
+{
+    // wildcards are never released
+    if (id <= TopicLevels::Hash)
+        return;
+
+    QWriteLocker locker(&lock);
+    Level & level = levels[id];
+    if (--level.refs == 0) {
+        ids.remove(TopicPart(level.value.constData(), int(level.value.size())));
+        level.value = QByteArray();
+        released.push_back(id);
+    }
+}
+
+TopicLevelId TopicLevelsTable::find(const TopicPart & part) const
+{
+    QReadLocker locker(&lock);
+    return ids.value(part, TopicLevels::Invalid);
+}
+
+void TopicLevelsTable::find(const TopicPart * parts, int count, TopicLevelId * result) const
+{
+    QReadLocker locker(&lock);
+    for (int i = 0; i < count; ++i)
+        result[i] = ids.value(parts[i], TopicLevels::Invalid);
+}
+
+QByteArray TopicLevelsTable::value(TopicLevelId id) const
+{
+    QReadLocker locker(&lock);
+    return (id < levels.size()) ? levels[id].value : QByteArray();
+}
+
+int TopicLevelsTable::count() const
+{
+    QReadLocker locker(&lock);
+    return ids.count();
+}
+
+Q_GLOBAL_STATIC(TopicLevelsTable, kTopicLevels)
+
+constexpr TopicLevelId TopicLevels::Invalid;
+constexpr TopicLevelId TopicLevels::Plus;
+constexpr TopicLevelId TopicLevels::Hash;
+
+TopicLevelId TopicLevels::acquire(const TopicPart & part)
+{
+    return kTopicLevels->acquire(part);
+}
+
+TopicLevelId TopicLevels::acquire(TopicLevelId id)
+{
+    return kTopicLevels->acquire(id);
+}
+
+void TopicLevels::release(TopicLevelId id)
+{
+    if (!kTopicLevels.isDestroyed())
+        kTopicLevels->release(id);
+}
+
+TopicLevelId TopicLevels::find(const TopicPart & part)
+{
+    return kTopicLevels->find(part);
+}
+
+void TopicLevels::find(const TopicPart * parts, int count, TopicLevelId * ids)
+{
+    kTopicLevels->find(parts, count, ids);
+}
+
+QByteArray TopicLevels::value(TopicLevelId id)
+{
+    return kTopicLevels->value(id);
+}
+
+int TopicLevels::count()
+{
+    return kTopicLevels->count();
+}
@@ -0,0 +1,63 @@
+#ifndef MQTT_TOPIC_LEVELS_H
+#define MQTT_TOPIC_LEVELS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+#include <QHash>
+#include <cstring>
+
+namespace Mqtt
+{
+    // level of UTF-8 topic name, references bytes of topic
+    class TopicPart
+    {
+    public:
+        TopicPart() : m_data(Q_NULLPTR), m_size(0) { }
+        TopicPart(const char * data, int size) : m_data(data), m_size(size) { }
+
+    public:
+        const char * data() const       { return m_data;                            }
+        int size() const                { return m_size;                            }
+        bool isEmpty() const            { return m_size == 0;                       }
+        QByteArray toByteArray() const  { return QByteArray(m_data, m_size);        }
+        QString toString() const        { return QString::fromUtf8(m_data, m_size); }
+
+        bool operator ==(const TopicPart & o) const { return m_size == o.m_size && (m_size == 0 || memcmp(m_data, o.m_data, size_t(m_size)) == 0); }
+        bool operator ==(const char * s) const      { return operator ==(TopicPart(s, int(strlen(s)))); }
+
+    private:
+        const char * m_data;
+        int m_size;
+    };
+
+    inline uint qHash(const TopicPart & part, uint seed = 0) { return uint(qHashBits(part.data(), size_t(part.size()), seed)); }
+
+    typedef QVarLengthArray<TopicPart, 16> TopicPartArray;
+
+    typedef quint32 TopicLevelId;
+
+    // process-wide table of interned topic levels,
+    // each distinct level string is stored once and referred by compact integer id
+    class TopicLevels
+    {
+    public:
+        static constexpr TopicLevelId Invalid = 0;
+        static constexpr TopicLevelId Plus    = 1;
+        static constexpr TopicLevelId Hash    = 2;
+
+    public:
+        // interns level (if needed) and increases its reference counter
+        static TopicLevelId acquire(const TopicPart & part);
+        // increases reference counter of already interned level
+        static TopicLevelId acquire(TopicLevelId id);
+        static void release(TopicLevelId id);
+        // returns Invalid if level has not been interned, table is not changed
+        static TopicLevelId find(const TopicPart & part);
+        static void find(const TopicPart * parts, int count, TopicLevelId * ids);
+        static QByteArray value(TopicLevelId id);
+        static int count();
+    };
+}
+
+#endif // MQTT_TOPIC_LEVELS_H
@@ -0,0 +1,41 @@
+#include "mqtt_topic_name.h"
+#include "mqtt_text_validator.h"
+
+using namespace Mqtt;
+
+TopicName::TopicName()
+    :m_utf8()
+    ,m_hash(uint(qHash(QByteArray())))
+    ,m_text_flags(TextValidator::Valid)
+{
+
+}
+
+TopicName::TopicName(const QByteArray & utf8)
+    :m_utf8(utf8)
+    ,m_hash(uint(qHash(utf8)))
+    ,m_text_flags(NotScanned)
+{
+
+}
+
+TopicName::TopicName(const QByteArray & utf8, quint8 textFlags)
+    :m_utf8(utf8)
+    ,m_hash(uint(qHash(utf8)))
+    ,m_text_flags(textFlags)
+{
+
+}
+
+TopicName::TopicName(const QString & topic)
+    :TopicName(topic.toUtf8())
+{
+
+}
+
+quint8 TopicName::textFlags() const
+{
+    if (m_text_flags != NotScanned)
+        return m_text_flags;
+    return TextValidator::scanUtf8(m_utf8.constData(), m_utf8.size());
+}
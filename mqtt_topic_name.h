@@ -0,0 +1,58 @@
+#ifndef MQTT_TOPIC_NAME_H
+#define MQTT_TOPIC_NAME_H
+
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+
+namespace Mqtt
+{
+    // topic name kept in UTF-8 as it is transferred, hash is computed once,
+    // copies share bytes, so it is cheap to pass and to use as key
+    class TopicName
+    {
+    public:
+        TopicName();
+        explicit TopicName(const QByteArray & utf8);
+        // name which is already scanned by TextValidator (e.g. by decoder), flags are kept with it
+        TopicName(const QByteArray & utf8, quint8 textFlags);
+        explicit TopicName(const QString & topic);
+
+    public:
+        bool isEmpty() const;
+        int size() const;
+        const char * constData() const;
+        const QByteArray & utf8() const;
+        QString toString() const;
+        uint hash() const;
+        bool startsWith(const char * prefix) const;
+        // TextValidator flags, name which has not been scanned yet is scanned by each call
+        quint8 textFlags() const;
+
+        bool operator ==(const TopicName & other) const;
+        bool operator !=(const TopicName & other) const;
+        bool operator <(const TopicName & other) const;
+
+    private:
+        QByteArray m_utf8;
+        uint m_hash;
+        quint8 m_text_flags;
+
+        static constexpr quint8 NotScanned = 0x80;
+    };
+
+    inline bool TopicName::isEmpty() const                        { return m_utf8.isEmpty();                        }
+    inline int TopicName::size() const                            { return int(m_utf8.size());                      }
+    inline const char * TopicName::constData() const              { return m_utf8.constData();                      }
+    inline const QByteArray & TopicName::utf8() const             { return m_utf8;                                  }
+    inline QString TopicName::toString() const                    { return QString::fromUtf8(m_utf8);               }
+    inline uint TopicName::hash() const                           { return m_hash;                                  }
+    inline bool TopicName::startsWith(const char * prefix) const  { return m_utf8.startsWith(prefix);               }
+    inline bool TopicName::operator ==(const TopicName & o) const { return m_hash == o.m_hash && m_utf8 == o.m_utf8; }
+    inline bool TopicName::operator !=(const TopicName & o) const { return !operator ==(o);                          }
+    inline bool TopicName::operator <(const TopicName & o) const  { return m_utf8 < o.m_utf8;                       }
+
+    inline uint qHash(const TopicName & topic, uint seed = 0)     { return topic.hash() ^ seed;                     }
+}
+
+#endif // MQTT_TOPIC_NAME_H
@@ -129,13 +129,13 @@ ServerClient::~ServerClient()
 void ServerClient::close() const
 {
     Q_ASSERT(server != Q_NULLPTR);
-    QCoreApplication::postEvent(server, new Event::CloseConnection(this->id()), Qt::HighEventPriority);
+    server->closeConnection(this->id());
 }
 
 void ServerClient::write(const QByteArray & data) const
 {
     Q_ASSERT(server != Q_NULLPTR);
-    QCoreApplication::postEvent(server, new Event::Data(this->id(), data), Qt::HighEventPriority);
+    server->clientWriteData(this->id(), data);
 }
 
 ServerClientSocket::ServerClientSocket()
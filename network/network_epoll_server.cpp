@@ -0,0 +1,546 @@
+#include "network_epoll_server.h"
+#include "network_server.h"
+#include "network_listen_socket.h"
+#include <QSocketNotifier>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include <logger.h>
+
+using namespace Network;
+
+static constexpr int MaxEvents      = 256;
+static constexpr int ReadBufferSize = 64 * 1024;
+static constexpr int MaxIoVectors   = 64;
+// bytes read from one connection per pass, rest is read on next pass, so busy peer doesn't hold others
+static constexpr int MaxReadPerPass = 4 * ReadBufferSize;
+// blocks kept for reading per thread, when all are referenced data is copied from stack buffer
+static constexpr int MaxReadBlocks  = 16;
+// accepting is retried after this interval when descriptors are exhausted, or when connection is closed
+static constexpr int AcceptRetryInterval = 500;
+
+// connection ids are never reused, so data queued for closed connection can't reach new one,
+// counter is shared by all listeners, because broker keeps connections of all of them in one place,
+// (ids of TcpServer are addresses of sockets, which are never that small)
+static std::atomic<quintptr> lastConnectionId {0};
+
+class EpollServer::Connection
+{
+public:
+    quintptr     id      = 0;
+    int          fd      = -1;
+    quint16      port    = 0;
+    bool         dirty   = false;
+    bool         closing = false;
+    bool         ready   = false;
+    bool         hangup  = false;
+    QHostAddress ip;
+    // frames waiting for socket, first one is sent up to offset
+    std::deque<QByteArray> out;
+    int          offset  = 0;
+    qint64       pending = 0;
+};
+
+EpollServer::EpollServer(Server * parent, QHostAddress listenIp, quint16 listenPort, bool reusePort)
+    :QObject(parent)
+    ,m_server(parent)
+    ,m_ip(listenIp)
+    ,m_port(listenPort)
+    ,m_reuse_port(reusePort)
+    ,m_listen_fd(-1)
+    ,m_epoll_fd(-1)
+    ,m_write_delay(0)
+    ,m_write_buffer_limit(0)
+    ,m_close_timeout(0)
+    ,m_notifier(Q_NULLPTR)
+    ,m_flush_timer(new QTimer(this))
+    ,m_accept_paused(false)
+    ,m_accept_timer(new QTimer(this))
+    ,m_ready_timer(new QTimer(this))
+{
+    m_flush_timer->setSingleShot(true);
+    m_flush_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_flush_timer, &QTimer::timeout, this, &EpollServer::flush);
+    m_accept_timer->setSingleShot(true);
+    m_accept_timer->setInterval(AcceptRetryInterval);
+    connect(m_accept_timer, &QTimer::timeout, this, &EpollServer::resumeAccepting);
+    m_ready_timer->setSingleShot(true);
+    m_ready_timer->setInterval(0);
+    connect(m_ready_timer, &QTimer::timeout, this, &EpollServer::processEvents);
+    m_read_blocks.reserve(MaxReadBlocks);
+    QTimer::singleShot(0, this, &EpollServer::initialize);
+}
+
+EpollServer::~EpollServer()
+{
+    for (Connection * connection: m_connections) {
+        ListenSocket::close(connection->fd);
+        delete connection;
+    }
+    m_connections.clear();
+    m_dirty.clear();
+    m_ready.clear();
+    deleteReleased();
+
+    if (m_epoll_fd >= 0)
+        ListenSocket::close(m_epoll_fd);
+    if (m_listen_fd >= 0)
+        ListenSocket::close(m_listen_fd);
+}
+
+void EpollServer::initialize()
+{
+    QString error;
+
+#ifdef Q_OS_LINUX
+    m_listen_fd = ListenSocket::open(m_ip, m_port, m_reuse_port, &error);
+
+    if (m_listen_fd >= 0) {
+        m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = Q_NULLPTR; // listening socket
+        if (m_epoll_fd < 0 || ::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &ev) != 0) {
+            error = qt_error_string(errno);
+            ListenSocket::close(m_listen_fd);
+            m_listen_fd = -1;
+        }
+    }
+
+    if (m_listen_fd >= 0) {
+        // epoll descriptor is readable while it has events, so it is served by event loop of thread
+        m_notifier = new QSocketNotifier(m_epoll_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &EpollServer::processEvents);
+
+        const quint16 port = ListenSocket::localPort(m_listen_fd);
+        log_important << printString(QStringLiteral("interface(%1:%2), socket=%3, \"listening\"")
+                                  .arg(m_ip.toString())
+                                  .arg(port)
+                                  .arg(m_listen_fd)
+                                  )
+                      << "[" << SecureMode::NonSecured << "] [epoll]"
+                      << end_log;
+        emit listeningStarted(m_ip, port);
+        return;
+    }
+#else
+    error = QStringLiteral("epoll is not supported on this platform");
+#endif
+
+    log_important << printString(QStringLiteral("interface(%1:%2), can't start listening, %3")
+                              .arg(m_ip.toString())
+                              .arg(m_port)
+                              .arg(error)
+                              )
+                  << "[" << SecureMode::NonSecured << "] [epoll]"
+                  << end_log;
+    emit cantStartListening(error);
+}
+
+void EpollServer::setWriteDelay(int msecs)
+{
+    m_write_delay = qMax(0, msecs);
+}
+
+void EpollServer::setWriteBufferLimit(qint64 bytes)
+{
+    m_write_buffer_limit = qMax(Q_INT64_C(0), bytes);
+}
+
+void EpollServer::setCloseTimeout(int msecs)
+{
+    m_close_timeout = qMax(0, msecs);
+}
+
+ServerClient EpollServer::client(const Connection * connection) const
+{
+    return ServerClient { ConnectionType::TCP, SecureMode::NonSecured, connection->ip, connection->port, connection->id, m_server };
+}
+
+void EpollServer::processEvents()
+{
+#ifdef Q_OS_LINUX
+    // connections which have reached read limit on previous pass
+    if (!m_ready.empty()) {
+        std::vector<Connection*> ready;
+        ready.swap(m_ready);
+        for (Connection * connection: ready) {
+            connection->ready = false;
+            if (connection->fd >= 0)
+                readConnection(connection);
+        }
+    }
+
+    epoll_event events[MaxEvents];
+    int count = 0;
+
+    do {
+        count = ::epoll_wait(m_epoll_fd, events, MaxEvents, 0);
+
+        for (int i = 0; i < count; ++i)
+        {
+            Connection * connection = static_cast<Connection*>(events[i].data.ptr);
+
+            if (connection == Q_NULLPTR) {
+                acceptConnections();
+                continue;
+            }
+
+            // closed by previous event of this batch
+            if (connection->fd < 0)
+                continue;
+
+            const quint32 e = events[i].events;
+            if (e & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                connection->hangup = true;
+            if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                readConnection(connection);
+            if (connection->fd >= 0 && (e & EPOLLOUT))
+                sendPending(connection);
+        }
+    } while (count == MaxEvents);
+
+    deleteReleased();
+
+    // edge triggered socket isn't reported again, so rest of its data is read on next pass
+    if (!m_ready.empty() && !m_ready_timer->isActive())
+        m_ready_timer->start();
+#endif
+}
+
+void EpollServer::acceptConnections()
+{
+#ifdef Q_OS_LINUX
+    for (;;)
+    {
+        sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        const int fd = ::accept4(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            const int error = errno;
+            if (error == EAGAIN || error == EWOULDBLOCK)
+                return;
+            log_warning << printString(QStringLiteral("interface(%1:%2), can't accept connection, %3").arg(m_ip.toString()).arg(m_port).arg(qt_error_string(error))) << end_log;
+            // listening socket is level triggered, so pending connection would be reported again at once
+            if (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM)
+                pauseAccepting();
+            return;
+        }
+
+        const int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+
+        Connection * connection = new Connection();
+        connection->id = ++lastConnectionId;
+        connection->fd = fd;
+        connection->ip = ListenSocket::peerAddress(&addr, &connection->port);
+
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = connection;
+        if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            log_warning << printString(QStringLiteral("can't watch socket (%1): %2").arg(fd).arg(qt_error_string(errno))) << end_log;
+            ListenSocket::close(fd);
+            delete connection;
+            continue;
+        }
+
+        m_connections.insert(connection->id, connection);
+
+        log_note << client(connection) << "new client connected" << end_log;
+
+        m_server->clientConnected(client(connection));
+    }
+#endif
+}
+
+void EpollServer::pauseAccepting()
+{
+#ifdef Q_OS_LINUX
+    if (m_accept_paused)
+        return;
+
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, m_listen_fd, Q_NULLPTR);
+    m_accept_paused = true;
+    m_accept_timer->start();
+
+    log_warning << printString(QStringLiteral("interface(%1:%2), accepting is paused").arg(m_ip.toString()).arg(m_port)) << end_log;
+#endif
+}
+
+void EpollServer::resumeAccepting()
+{
+#ifdef Q_OS_LINUX
+    if (!m_accept_paused)
+        return;
+
+    m_accept_timer->stop();
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = Q_NULLPTR; // listening socket
+    if (::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &ev) != 0) {
+        m_accept_timer->start();
+        return;
+    }
+    m_accept_paused = false;
+#endif
+}
+
+QByteArray * EpollServer::readBlock()
+{
+    for (QByteArray & block: m_read_blocks) {
+        // data passed on before has been processed, reads of consumer thread precede writes to block
+        if (block.isDetached()) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            block.resize(ReadBufferSize);
+            return &block;
+        }
+    }
+
+    if (m_read_blocks.size() < size_t(MaxReadBlocks)) {
+        QByteArray block;
+        // reserved capacity is kept when block is shrunk to size of read data
+        block.reserve(ReadBufferSize);
+        block.resize(ReadBufferSize);
+        m_read_blocks.push_back(std::move(block));
+        return &m_read_blocks.back();
+    }
+
+    return Q_NULLPTR;
+}
+
+void EpollServer::readConnection(Connection * connection)
+{
+#ifdef Q_OS_LINUX
+    static thread_local char buffer[ReadBufferSize];
+
+    const quintptr id = connection->id;
+    qint64 total = 0;
+
+    for (;;)
+    {
+        QByteArray * block = readBlock();
+        const ssize_t n = ::read(connection->fd, (block != Q_NULLPTR) ? block->data() : buffer, ReadBufferSize);
+
+        if (n > 0) {
+            QByteArray data;
+            if (block != Q_NULLPTR) {
+                block->resize(int(n));
+                data = *block;
+            } else {
+                data = QByteArray(buffer, int(n));
+            }
+            m_server->increaseReceived(int(n));
+            log_trace_1 << "<<" << client(connection) << printByteArrayPartly(data, 60) << end_log;
+            m_server->clientReadData(id, data);
+            // with edge trigger short read means socket is drained, unless peer has closed it
+            if (n < ReadBufferSize && !connection->hangup)
+                return;
+            total += n;
+            if (total >= MaxReadPerPass && connection->fd >= 0) {
+                if (!connection->ready) {
+                    connection->ready = true;
+                    m_ready.push_back(connection);
+                }
+                return;
+            }
+            continue;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        // closed by peer or failed
+        release(connection);
+        return;
+    }
+#else
+    Q_UNUSED(connection)
+#endif
+}
+
+void EpollServer::sendPending(Connection * connection)
+{
+#ifdef Q_OS_LINUX
+    while (!connection->out.empty())
+    {
+        iovec iov[MaxIoVectors];
+        int count = 0;
+        for (auto it = connection->out.begin(); it != connection->out.end() && count < MaxIoVectors; ++it, ++count) {
+            const int skip = (count == 0) ? connection->offset : 0;
+            iov[count].iov_base = const_cast<char*>(it->constData() + skip);
+            iov[count].iov_len  = size_t(it->size() - skip);
+        }
+
+        msghdr msg;
+        std::memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = size_t(count);
+
+        // writev without SIGPIPE
+        const ssize_t n = ::sendmsg(connection->fd, &msg, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            // rest is sent on EPOLLOUT
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            release(connection);
+            return;
+        }
+
+        m_server->increaseSent(int(n));
+        connection->pending -= n;
+
+        qint64 sent = n;
+        while (sent > 0) {
+            const qint64 rest = connection->out.front().size() - connection->offset;
+            if (sent >= rest) {
+                sent -= rest;
+                connection->out.pop_front();
+                connection->offset = 0;
+            } else {
+                connection->offset += int(sent);
+                sent = 0;
+            }
+        }
+    }
+
+    if (connection->closing)
+        release(connection);
+#else
+    Q_UNUSED(connection)
+#endif
+}
+
+void EpollServer::release(Connection * connection)
+{
+    if (connection->fd < 0)
+        return;
+
+#ifdef Q_OS_LINUX
+    ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, connection->fd, Q_NULLPTR);
+#endif
+    ListenSocket::close(connection->fd);
+    connection->fd = -1;
+    connection->out.clear();
+    connection->pending = 0;
+
+    if (connection->dirty) {
+        m_dirty.erase(std::remove(m_dirty.begin(), m_dirty.end(), connection), m_dirty.end());
+        connection->dirty = false;
+    }
+    if (connection->ready) {
+        m_ready.erase(std::remove(m_ready.begin(), m_ready.end(), connection), m_ready.end());
+        connection->ready = false;
+    }
+
+    const quintptr id = connection->id;
+    m_connections.remove(id);
+    m_released.push_back(connection);
+
+    log_trace << client(connection) << "removed" << end_log;
+    m_server->clientDisconnected(id);
+
+    // freed descriptor may be enough for waiting connection
+    resumeAccepting();
+}
+
+void EpollServer::deleteReleased()
+{
+    for (Connection * connection: m_released)
+        delete connection;
+    m_released.clear();
+}
+
+void EpollServer::writeData(quintptr connectionId, const QByteArray & data)
+{
+    Connection * connection = m_connections.value(connectionId, Q_NULLPTR);
+    // nothing is written after close
+    if (connection == Q_NULLPTR || connection->closing || data.isEmpty())
+        return;
+
+    // frame which is written to empty queue is always accepted, so limit does not restrict packet size
+    if (m_write_buffer_limit > 0 && connection->pending > 0 && connection->pending + data.size() > m_write_buffer_limit) {
+        log_warning << client(connection) << "client doesn't read data, pending" << connection->pending
+                    << "bytes exceed limit of" << m_write_buffer_limit << "bytes -> connection dropped" << end_log;
+        release(connection);
+        deleteReleased();
+        return;
+    }
+
+    log_trace_1 << ">>" << client(connection) << printByteArrayPartly(data, 60) << end_log;
+
+    connection->pending += data.size();
+    connection->out.push_back(data);
+    if (!connection->dirty) {
+        connection->dirty = true;
+        m_dirty.push_back(connection);
+    }
+
+    if (m_write_delay > 0 && !m_flush_timer->isActive())
+        m_flush_timer->start(m_write_delay);
+}
+
+void EpollServer::flush()
+{
+    m_flush_timer->stop();
+
+    // sending may release connection, which changes dirty ones
+    std::vector<Connection*> dirty;
+    dirty.swap(m_dirty);
+
+    for (Connection * connection: dirty) {
+        connection->dirty = false;
+        if (connection->fd >= 0)
+            sendPending(connection);
+    }
+
+    deleteReleased();
+}
+
+void EpollServer::closeConnection(quintptr connectionId)
+{
+    Connection * connection = m_connections.value(connectionId, Q_NULLPTR);
+    if (connection == Q_NULLPTR)
+        return;
+
+    if (connection->closing)
+        return;
+
+    // data written before close is sent first, connection is closed when it is sent
+    connection->closing = true;
+    sendPending(connection);
+
+    // peer which doesn't read is given limited time, ids are never reused, so timer can keep id
+    if (connection->fd >= 0 && m_close_timeout > 0) {
+        QTimer::singleShot(m_close_timeout, this, [this, connectionId] () {
+            Connection * connection = m_connections.value(connectionId, Q_NULLPTR);
+            if (connection == Q_NULLPTR)
+                return;
+            log_warning << client(connection) << "pending data hasn't been sent in" << m_close_timeout << "ms -> connection dropped" << end_log;
+            release(connection);
+            deleteReleased();
+        });
+    }
+
+    deleteReleased();
+}
@@ -0,0 +1,94 @@
+#ifndef NETWORK_EPOLL_SERVER_H
+#define NETWORK_EPOLL_SERVER_H
+
+#include "network_client.h"
+
+#include <QObject>
+#include <QHash>
+#include <deque>
+#include <vector>
+
+class QSocketNotifier;
+class QTimer;
+
+namespace Network
+{
+    class Server;
+
+    // plain TCP listener on edge-triggered epoll (Linux only), replaces TcpServer for
+    // non-secured listeners: no QTcpSocket per connection, one notifier per thread,
+    // reads go to recycled blocks which are passed on without copying,
+    // gathered frames are sent by one writev, websocket upgrade is not supported
+    class EpollServer : public QObject
+    {
+        Q_OBJECT
+    private:
+        EpollServer(Server * parent, QHostAddress listenIp, quint16 listenPort, bool reusePort);
+        ~EpollServer();
+
+    signals:
+        void listeningStarted(QHostAddress address, quint16 port);
+        void cantStartListening(QString error);
+
+    private slots:
+        void initialize();
+        void processEvents();
+
+    public:
+        int writeDelay() const { return m_write_delay; }
+        void setWriteDelay(int msecs);
+        void setWriteBufferLimit(qint64 bytes);
+        void setCloseTimeout(int msecs);
+
+    private:
+        class Connection;
+
+        void acceptConnections();
+        void pauseAccepting();
+        void resumeAccepting();
+        void readConnection(Connection * connection);
+        QByteArray * readBlock();
+        void sendPending(Connection * connection);
+        void release(Connection * connection);
+        void deleteReleased();
+        ServerClient client(const Connection * connection) const;
+
+        void writeData(quintptr connectionId, const QByteArray & data);
+        void flush();
+        void closeConnection(quintptr connectionId);
+
+    private:
+        Server       * m_server;
+        QHostAddress   m_ip;
+        quint16        m_port;
+        bool           m_reuse_port;
+        int            m_listen_fd;
+        int            m_epoll_fd;
+        int            m_write_delay;
+        qint64         m_write_buffer_limit;
+        int            m_close_timeout;
+        QSocketNotifier * m_notifier;
+        QTimer       * m_flush_timer;
+        // listening socket is out of epoll while descriptors are exhausted
+        bool           m_accept_paused;
+        QTimer       * m_accept_timer;
+        // next pass serves connections which have reached read limit
+        QTimer       * m_ready_timer;
+
+        // by connection id, epoll events refer to connection itself
+        QHash<quintptr, Connection*> m_connections;
+        // connections with frames written since last flush
+        std::vector<Connection*> m_dirty;
+        // closed connections are deleted when their pending epoll events are processed
+        std::vector<Connection*> m_released;
+        // connections with data left in socket after read limit
+        std::vector<Connection*> m_ready;
+        // blocks which received data is read to, block is reused when nobody references it
+        std::vector<QByteArray> m_read_blocks;
+
+    private:
+        friend class Server;
+    };
+}
+
+#endif // NETWORK_EPOLL_SERVER_H
@@ -17,6 +17,7 @@ namespace Network
             ,ConnectionEstablished
             ,CloseConnection
             ,WillUpgraded
+            ,Wakeup
         };
 
         class Data : public QEvent
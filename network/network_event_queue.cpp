@@ -0,0 +1,88 @@
+#include "network_event_queue.h"
+#include <QCoreApplication>
+#include <QThread>
+
+using namespace Network::Event;
+
+Queue::Queue(QObject * consumer)
+    :m_consumer(consumer)
+    ,m_messages()
+    ,m_wakeup_pending(false)
+{
+
+}
+
+Queue::~Queue()
+{
+    Message message;
+    while (m_messages.pop(message)) {
+        delete message.event;
+        message.event = Q_NULLPTR;
+    }
+}
+
+void Queue::push(quintptr connectionId, const QByteArray & data)
+{
+    Message message;
+    message.connectionId = connectionId;
+    message.data = data;
+    m_messages.push(std::move(message));
+    wakeup();
+}
+
+void Queue::push(QEvent * event)
+{
+    Message message;
+    message.event = event;
+    m_messages.push(std::move(message));
+    wakeup();
+}
+
+void Queue::wakeup()
+{
+    if (!m_wakeup_pending.exchange(true))
+        QCoreApplication::postEvent(m_consumer, new Wakeup(this), Qt::HighEventPriority);
+}
+
+Wakeup::Wakeup(Queue * queue)
+    :QEvent(static_cast<QEvent::Type>(Event::Type::Wakeup))
+    ,queue(queue)
+{
+
+}
+
+Wakeup::~Wakeup()
+{
+
+}
+
+Dispatcher::Dispatcher(QObject * handler)
+    :QObject(Q_NULLPTR)
+    ,m_handler(handler)
+    ,m_queue(this)
+{
+    moveToThread(handler->thread());
+}
+
+Dispatcher::~Dispatcher()
+{
+
+}
+
+bool Dispatcher::event(QEvent * event)
+{
+    if (static_cast<Event::Type>(event->type()) != Event::Type::Wakeup)
+        return QObject::event(event);
+
+    event->accept();
+    m_queue.consume([this](Message & message) {
+        if (message.event != Q_NULLPTR) {
+            QCoreApplication::sendEvent(m_handler, message.event);
+        } else {
+            // handler gets the same event as posted one, but without allocation
+            Data data(message.connectionId, message.data);
+            QCoreApplication::sendEvent(m_handler, &data);
+        }
+    });
+    return true;
+}
@@ -0,0 +1,193 @@
+#ifndef NETWORK_EVENT_QUEUE_H
+#define NETWORK_EVENT_QUEUE_H
+
+#include "network_event.h"
+#include <QObject>
+#include <atomic>
+
+namespace Network
+{
+    namespace Event
+    {
+        // unbounded single producer, single consumer queue without locks,
+        // items are kept in ring of fixed segments, consumed segment is reused by producer
+        template <class T, int SegmentSize = 256>
+        class SpscQueue
+        {
+        public:
+            SpscQueue();
+            ~SpscQueue();
+
+            SpscQueue(const SpscQueue &) = delete;
+            SpscQueue & operator =(const SpscQueue &) = delete;
+
+        public:
+            // producer thread only
+            void push(T && value);
+            // consumer thread only
+            bool pop(T & value);
+
+        private:
+            class Segment
+            {
+            public:
+                T items[SegmentSize];
+                std::atomic<int> written {0};
+                int read = 0;
+                std::atomic<Segment*> next {Q_NULLPTR};
+            };
+
+            Segment * m_head; // consumer
+            Segment * m_tail; // producer
+            std::atomic<Segment*> m_spare;
+        };
+
+        // data or rare event (connection, disconnection), event is owned by queue until it is consumed
+        class Message
+        {
+        public:
+            quintptr connectionId = 0;
+            QByteArray data;
+            QEvent * event = Q_NULLPTR;
+        };
+
+        // messages from one thread to object of other thread,
+        // consumer gets one Wakeup event per batch instead of event per message
+        class Queue
+        {
+        public:
+            explicit Queue(QObject * consumer);
+            ~Queue();
+
+        public:
+            void push(quintptr connectionId, const QByteArray & data);
+            void push(QEvent * event);
+
+            // called by consumer on Wakeup event, handler takes Message &, event is deleted after it,
+            // handler may reenter (nested event loop), every message is handled once
+            template <class Handler>
+            void consume(Handler handler);
+
+        private:
+            void wakeup();
+
+        private:
+            QObject * m_consumer;
+            SpscQueue<Message> m_messages;
+            std::atomic<bool> m_wakeup_pending;
+        };
+
+        class Wakeup : public QEvent
+        {
+        public:
+            Wakeup(Queue * queue);
+            ~Wakeup();
+
+        public:
+            Queue * queue;
+        };
+
+        // lives in thread of handler and delivers messages of its queue to handler as usual events
+        class Dispatcher : public QObject
+        {
+        public:
+            explicit Dispatcher(QObject * handler);
+            ~Dispatcher() override;
+
+        public:
+            Queue & queue();
+
+        protected:
+            bool event(QEvent * event) override;
+
+        private:
+            QObject * m_handler;
+            Queue m_queue;
+        };
+
+        inline Queue & Dispatcher::queue() { return m_queue; }
+
+
+        template <class T, int SegmentSize>
+        SpscQueue<T, SegmentSize>::SpscQueue()
+            :m_head(new Segment())
+            ,m_tail(m_head)
+            ,m_spare(Q_NULLPTR)
+        {
+
+        }
+
+        template <class T, int SegmentSize>
+        SpscQueue<T, SegmentSize>::~SpscQueue()
+        {
+            while (m_head != Q_NULLPTR) {
+                Segment * next = m_head->next.load();
+                delete m_head;
+                m_head = next;
+            }
+            delete m_spare.load();
+        }
+
+        template <class T, int SegmentSize>
+        void SpscQueue<T, SegmentSize>::push(T && value)
+        {
+            Segment * s = m_tail;
+            int i = s->written.load(std::memory_order_relaxed);
+
+            if (i == SegmentSize) {
+                Segment * n = m_spare.exchange(Q_NULLPTR, std::memory_order_acquire);
+                if (n == Q_NULLPTR)
+                    n = new Segment();
+                s->next.store(n, std::memory_order_release);
+                m_tail = s = n;
+                i = 0;
+            }
+
+            s->items[i] = std::move(value);
+            s->written.store(i + 1, std::memory_order_release);
+        }
+
+        template <class T, int SegmentSize>
+        bool SpscQueue<T, SegmentSize>::pop(T & value)
+        {
+            Segment * s = m_head;
+
+            if (s->read == SegmentSize) {
+                // producer does not touch segment after it has linked next one
+                Segment * n = s->next.load(std::memory_order_acquire);
+                if (n == Q_NULLPTR)
+                    return false;
+                m_head = n;
+                s->read = 0;
+                s->written.store(0, std::memory_order_relaxed);
+                s->next.store(Q_NULLPTR, std::memory_order_relaxed);
+                delete m_spare.exchange(s, std::memory_order_release);
+                s = n;
+            }
+
+            if (s->read == s->written.load(std::memory_order_acquire))
+                return false;
+
+            value = std::move(s->items[s->read]);
+            s->items[s->read] = T();
+            ++s->read;
+            return true;
+        }
+
+        template <class Handler>
+        void Queue::consume(Handler handler)
+        {
+            // messages pushed after this point wake consumer up again
+            m_wakeup_pending.store(false);
+
+            Message message;
+            while (m_messages.pop(message)) {
+                handler(message);
+                delete message.event;
+                message.event = Q_NULLPTR;
+            }
+        }
+    }
+}
+
+#endif // NETWORK_EVENT_QUEUE_H
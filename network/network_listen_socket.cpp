@@ -0,0 +1,116 @@
+#include "network_listen_socket.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace Network;
+
+int ListenSocket::open(const QHostAddress & ip, quint16 port, bool reusePort, QString * error)
+{
+#ifdef Q_OS_LINUX
+    const bool any = (ip == QHostAddress::Any);
+    const bool v6  = (any || ip.protocol() == QAbstractSocket::IPv6Protocol);
+
+    int fd = ::socket(v6 ? AF_INET6 : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        *error = qt_error_string(errno);
+        return -1;
+    }
+
+    const int on = 1, off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reusePort)
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+
+    sockaddr_storage addr;
+    std::memset(&addr, 0, sizeof(addr));
+    socklen_t addr_len = 0;
+
+    if (v6) {
+        // dual stack as QTcpServer listens on QHostAddress::Any
+        if (any)
+            ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 * a = reinterpret_cast<sockaddr_in6*>(&addr);
+        a->sin6_family = AF_INET6;
+        a->sin6_port = htons(port);
+        const Q_IPV6ADDR ip6 = ip.toIPv6Address();
+        std::memcpy(&a->sin6_addr, &ip6, sizeof(a->sin6_addr));
+        a->sin6_scope_id = ip.scopeId().toUInt();
+        addr_len = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in * a = reinterpret_cast<sockaddr_in*>(&addr);
+        a->sin_family = AF_INET;
+        a->sin_port = htons(port);
+        a->sin_addr.s_addr = htonl(ip.toIPv4Address());
+        addr_len = sizeof(sockaddr_in);
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), addr_len) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        *error = qt_error_string(errno);
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    Q_UNUSED(ip) Q_UNUSED(port) Q_UNUSED(reusePort)
+    *error = QStringLiteral("native listening is not supported on this platform");
+    return -1;
+#endif
+}
+
+QHostAddress ListenSocket::peerAddress(const void * sockaddrStorage, quint16 * port)
+{
+#ifdef Q_OS_LINUX
+    const sockaddr * sa = static_cast<const sockaddr*>(sockaddrStorage);
+    if (sa->sa_family == AF_INET6) {
+        const sockaddr_in6 * a = static_cast<const sockaddr_in6*>(sockaddrStorage);
+        *port = ntohs(a->sin6_port);
+        QHostAddress address(reinterpret_cast<const quint8*>(&a->sin6_addr));
+        // as QTcpSocket reports clients of dual stack listener
+        bool mapped = false;
+        const quint32 v4 = address.toIPv4Address(&mapped);
+        return mapped ? QHostAddress(v4) : address;
+    }
+    if (sa->sa_family == AF_INET) {
+        const sockaddr_in * a = static_cast<const sockaddr_in*>(sockaddrStorage);
+        *port = ntohs(a->sin_port);
+        return QHostAddress(ntohl(a->sin_addr.s_addr));
+    }
+#else
+    Q_UNUSED(sockaddrStorage)
+#endif
+    *port = 0;
+    return QHostAddress();
+}
+
+quint16 ListenSocket::localPort(int fd)
+{
+#ifdef Q_OS_LINUX
+    sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addr_len) == 0) {
+        quint16 port = 0;
+        peerAddress(&addr, &port);
+        return port;
+    }
+#else
+    Q_UNUSED(fd)
+#endif
+    return 0;
+}
+
+void ListenSocket::close(int fd)
+{
+#ifdef Q_OS_LINUX
+    ::close(fd);
+#else
+    Q_UNUSED(fd)
+#endif
+}
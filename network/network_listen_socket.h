@@ -0,0 +1,22 @@
+#ifndef NETWORK_LISTEN_SOCKET_H
+#define NETWORK_LISTEN_SOCKET_H
+
+#include <QHostAddress>
+#include <QString>
+
+namespace Network
+{
+    // native listening sockets, Linux only
+    class ListenSocket
+    {
+    public:
+        // creates non-blocking socket listening on address, with reusePort several sockets
+        // may listen on the same address (SO_REUSEPORT), returns -1 and error on failure
+        static int open(const QHostAddress & ip, quint16 port, bool reusePort, QString * error);
+        static QHostAddress peerAddress(const void * sockaddrStorage, quint16 * port);
+        static quint16 localPort(int fd);
+        static void close(int fd);
+    };
+}
+
+#endif // NETWORK_LISTEN_SOCKET_H
@@ -1,5 +1,6 @@
 #include "network_server.h"
 #include "network_event.h"
+#include "network_epoll_server.h"
 #include <QTimer>
 #include <QCoreApplication>
 
@@ -7,6 +8,9 @@
 
 using namespace Network;
 
+static constexpr qint64 DefaultWriteBufferLimit = 256 * 1024 * 1024;
+static constexpr int    DefaultCloseTimeout     = 10000;
+
 Server::Statistics::Statistics()
 {
     br.load().valuesReserve(3);
@@ -18,18 +22,40 @@ Server::Statistics::Statistics()
     bs.load().valueAppend(60);
     bs.load().valueAppend(300);
     bs.load().valueAppend(900);
+
+    ws.load().valuesReserve(3);
+    ws.load().valueAppend(60);
+    ws.load().valueAppend(300);
+    ws.load().valueAppend(900);
 }
 
-Server::Server(SecureMode type, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols)
+Server::Server(SecureMode type, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols, int ioThreads)
     :QThread(Q_NULLPTR)
     ,m_tcp_server(Q_NULLPTR)
+    ,m_epoll_server(Q_NULLPTR)
+    ,m_handler(Q_NULLPTR)
+    ,m_dispatcher(Q_NULLPTR)
+    ,m_outgoing(this)
     ,m_timer(Q_NULLPTR)
     ,m_secure(type)
     ,m_ip(listenIp)
     ,m_port(listenPort)
     ,m_server_name(serverName)
     ,m_subprotocols(supportedSubprotocols)
+    ,m_io_threads(qMax(1, ioThreads))
+    ,m_reuse_port(false)
+    ,m_write_delay(0)
+    ,m_write_buffer_limit(DefaultWriteBufferLimit)
+    ,m_close_timeout(DefaultCloseTimeout)
+    ,m_backend(Backend::Qt)
 {
+#ifndef Q_OS_LINUX
+    if (m_io_threads > 1) {
+        log_warning << "several I/O threads per listener are supported on Linux only, listener uses one" << end_log;
+        m_io_threads = 1;
+    }
+#endif
+    m_reuse_port = (m_io_threads > 1);
     moveToThread(this);
 }
 
@@ -37,29 +63,98 @@ Server::~Server()
 {
     exit();
     wait(60000);
+    if (m_dispatcher)
+        m_dispatcher->deleteLater();
+}
+
+void Server::setNetworkEventsHandler(QObject * handler)
+{
+    if (m_dispatcher)
+        m_dispatcher->deleteLater();
+    m_handler = handler;
+    m_dispatcher = new Event::Dispatcher(handler);
 }
 
 void Server::initialize()
 {
-    m_tcp_server = new TcpServer(this, m_secure, m_ip, m_port, m_server_name, m_subprotocols);
+#ifdef Q_OS_LINUX
+    const bool epoll = (Backend::Epoll == m_backend && SecureMode::NonSecured == m_secure);
+#else
+    const bool epoll = false;
+#endif
+    if (Backend::Epoll == m_backend && !epoll)
+        log_warning << "epoll backend is supported for plain TCP listeners on Linux only, listener uses Qt" << end_log;
+
+    if (epoll) {
+        m_epoll_server = new EpollServer(this, m_ip, m_port, m_reuse_port);
+        m_epoll_server->setWriteDelay(m_write_delay);
+        m_epoll_server->setWriteBufferLimit(m_write_buffer_limit);
+        m_epoll_server->setCloseTimeout(m_close_timeout);
+        // other threads bind to the port when it is known, so listener with port 0 is sharded too
+        if (m_io_threads > 1)
+            connect(m_epoll_server, &EpollServer::listeningStarted, this, &Server::startWorkers);
+        connect(m_epoll_server, &EpollServer::listeningStarted, this, &Server::listeningStarted);
+        connect(m_epoll_server, &EpollServer::cantStartListening, this, &Server::cantStartListening);
+    } else {
+        m_tcp_server = new TcpServer(this, m_secure, m_ip, m_port, m_server_name, m_subprotocols, m_reuse_port);
+        m_tcp_server->setWriteDelay(m_write_delay);
+        m_tcp_server->setWriteBufferLimit(m_write_buffer_limit);
+        m_tcp_server->setCloseTimeout(m_close_timeout);
 #ifndef QT_NO_OPENSSL
-    m_tcp_server->setSslConfiguration(m_ssl);
+        m_tcp_server->setSslConfiguration(m_ssl);
 #endif
-    connect(m_tcp_server, &TcpServer::listeningStarted, this, &Server::listeningStarted);
-    connect(m_tcp_server, &TcpServer::cantStartListening, this, &Server::cantStartListening);
+        if (m_io_threads > 1)
+            connect(m_tcp_server, &TcpServer::listeningStarted, this, &Server::startWorkers);
+        connect(m_tcp_server, &TcpServer::listeningStarted, this, &Server::listeningStarted);
+        connect(m_tcp_server, &TcpServer::cantStartListening, this, &Server::cantStartListening);
+    }
 
     m_timer = new QTimer(this);
     connect(m_timer, &QTimer::timeout, this, &Server::oneSecondTimer);
     m_timer->start(1000);
 }
 
+void Server::startWorkers(QHostAddress address, quint16 port)
+{
+    Q_UNUSED(address)
+
+    QMutexLocker lock(&m_workers_lock);
+    for (int i = 1; i < m_io_threads; ++i)
+    {
+        Server * worker = new Server(m_secure, m_ip, port, m_server_name, m_subprotocols);
+        worker->m_reuse_port = true;
+        worker->setNetworkEventsHandler(m_handler);
+        worker->m_write_delay = m_write_delay;
+        worker->m_write_buffer_limit = m_write_buffer_limit;
+        worker->m_close_timeout = m_close_timeout;
+        worker->m_backend = m_backend;
+#ifndef QT_NO_OPENSSL
+        worker->m_ssl = m_ssl;
+#endif
+        connect(worker, &Server::cantStartListening, this, &Server::cantStartListening);
+        m_workers.append(worker);
+        worker->start();
+    }
+}
+
 void Server::deinitialize()
 {
+    {
+        QMutexLocker lock(&m_workers_lock);
+        qDeleteAll(m_workers);
+        m_workers.clear();
+    }
+
     if (m_tcp_server) {
         delete m_tcp_server;
         m_tcp_server = Q_NULLPTR;
     }
 
+    if (m_epoll_server) {
+        delete m_epoll_server;
+        m_epoll_server = Q_NULLPTR;
+    }
+
     if (m_timer) {
         m_timer->stop();
         delete m_timer;
@@ -78,18 +173,36 @@ bool Server::event(QEvent * event)
 {
     switch (static_cast<Event::Type>(event->type()))
     {
+        case Event::Type::Wakeup:
+        {
+            event->accept();
+            m_outgoing.consume([this](Event::Message & message) {
+                if (m_tcp_server == Q_NULLPTR && m_epoll_server == Q_NULLPTR)
+                    return;
+                if (message.event != Q_NULLPTR)
+                    this->event(message.event);
+                else
+                    writeToConnection(message.connectionId, message.data);
+            });
+            // one write per connection for whole batch
+            if (m_write_delay == 0)
+                flushConnections();
+            return true;
+        }
         case Event::Type::Data:
         {
             event->accept();
             Event::Data * e = dynamic_cast<Event::Data*>(event);
-            m_tcp_server->writeData(e->connectionId, e->data);
+            writeToConnection(e->connectionId, e->data);
+            if (m_write_delay == 0)
+                flushConnections();
             return true;
         }
         case Event::Type::CloseConnection:
         {
             event->accept();
             Event::CloseConnection * e = dynamic_cast<Event::CloseConnection*>(event);
-            m_tcp_server->closeConnection(e->connectionId);
+            closeSocket(e->connectionId);
             return true;
         }
         default: break;
@@ -97,26 +210,94 @@ bool Server::event(QEvent * event)
     return QThread::event(event);
 }
 
+void Server::setWriteDelay(int msecs)
+{
+    m_write_delay = qMax(0, msecs);
+}
+
+void Server::setWriteBufferLimit(qint64 bytes)
+{
+    m_write_buffer_limit = qMax(Q_INT64_C(0), bytes);
+}
+
+void Server::setCloseTimeout(int msecs)
+{
+    m_close_timeout = qMax(0, msecs);
+}
+
+void Server::writeToConnection(quintptr connectionId, const QByteArray & data)
+{
+    if (m_epoll_server)
+        m_epoll_server->writeData(connectionId, data);
+    else if (m_tcp_server)
+        m_tcp_server->writeData(connectionId, data);
+}
+
+void Server::flushConnections()
+{
+    if (m_epoll_server)
+        m_epoll_server->flush();
+    else if (m_tcp_server)
+        m_tcp_server->flush();
+}
+
+void Server::closeSocket(quintptr connectionId)
+{
+    if (m_epoll_server)
+        m_epoll_server->closeConnection(connectionId);
+    else if (m_tcp_server)
+        m_tcp_server->closeConnection(connectionId);
+}
+
 #ifndef QT_NO_OPENSSL
 void Server::setSslConfiguration(QSharedPointer<QSslConfiguration> ssl)
 {
     m_ssl = ssl;
     if (m_tcp_server)
         m_tcp_server->setSslConfiguration(ssl);
+
+    QMutexLocker lock(&m_workers_lock);
+    for (Server * worker: m_workers)
+        worker->setSslConfiguration(ssl);
 }
 #endif
 
-Average::Load Server::receivedStats()
+Average::Load Server::receivedStats() const
 {
-    QMutexLocker lock(&m_stats.m);
-    Average::Load copy = m_stats.br.load();
+    Average::Load copy;
+    {
+        QMutexLocker lock(&m_stats.m);
+        copy = m_stats.br.load();
+    }
+    QMutexLocker lock(&m_workers_lock);
+    for (Server * worker: m_workers)
+        copy.accumulate(worker->receivedStats());
     return copy;
 }
 
-Average::Load Server::sentStats()
+Average::Load Server::sentStats() const
 {
-    QMutexLocker lock(&m_stats.m);
-    Average::Load copy = m_stats.bs.load();
+    Average::Load copy;
+    {
+        QMutexLocker lock(&m_stats.m);
+        copy = m_stats.bs.load();
+    }
+    QMutexLocker lock(&m_workers_lock);
+    for (Server * worker: m_workers)
+        copy.accumulate(worker->sentStats());
+    return copy;
+}
+
+Average::Load Server::writesStats() const
+{
+    Average::Load copy;
+    {
+        QMutexLocker lock(&m_stats.m);
+        copy = m_stats.ws.load();
+    }
+    QMutexLocker lock(&m_workers_lock);
+    for (Server * worker: m_workers)
+        copy.accumulate(worker->writesStats());
     return copy;
 }
 
@@ -125,12 +306,14 @@ void Server::oneSecondTimer()
     QMutexLocker lock(&m_stats.m);
     m_stats.br.oneSecondTimer();
     m_stats.bs.oneSecondTimer();
+    m_stats.ws.oneSecondTimer();
 }
 
 void Server::increaseSent(int count)
 {
     QMutexLocker lock(&m_stats.m);
     m_stats.bs.increase(count);
+    m_stats.ws.increase(1);
 }
 
 void Server::increaseReceived(int count)
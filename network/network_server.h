@@ -4,8 +4,10 @@
 #include "network_tcp_server.h"
 #include "network_client.h"
 #include "network_event.h"
+#include "network_event_queue.h"
 #include "average/move.h"
 #include <QMutex>
+#include <QVector>
 #include <QThread>
 #include <QCoreApplication>
 
@@ -14,14 +16,20 @@ class QTimer;
 namespace Network
 {
     class TcpServer;
+    class EpollServer;
 
     class Server : public QThread
     {
         Q_OBJECT
     public:
-        Server(SecureMode type, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols);
+        // with ioThreads > 1 listener is served by that count of threads, each accepts connections
+        // on the same address (SO_REUSEPORT, Linux only), kernel distributes incoming connections
+        Server(SecureMode type, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols, int ioThreads = 1);
         ~Server() override;
 
+        // events to handler and writes to connections are passed through lock-free queues,
+        // receiver is woken up once per batch, writes are expected from handler's thread only
+
     signals:
         void listeningStarted(QHostAddress address, quint16 port);
         void cantStartListening(QString error);
@@ -30,6 +38,7 @@ namespace Network
         void initialize();
         void deinitialize();
         void oneSecondTimer();
+        void startWorkers(QHostAddress address, quint16 port);
 
     protected:
         bool event(QEvent *event) override;
@@ -39,6 +48,25 @@ namespace Network
         SecureMode secureMode() const;
         QHostAddress listenIp() const;
         quint16 port() const;
+        int ioThreads() const;
+
+        // Epoll serves plain TCP listener without QTcpSocket (Linux only),
+        // secured listeners and other platforms always use Qt
+        enum class Backend : quint8 { Qt, Epoll };
+        Backend backend() const;
+        void setBackend(Backend backend);
+
+        // outgoing frames are gathered for that time instead of being flushed after each batch,
+        // 0 by default, greater values trade latency for throughput
+        int writeDelay() const;
+        void setWriteDelay(int msecs);
+
+        // connection whose peer doesn't read is dropped when its unsent data exceed limit (0 - no limit),
+        // closed connection is dropped when its unsent data aren't sent in timeout (0 - no timeout)
+        qint64 writeBufferLimit() const;
+        void setWriteBufferLimit(qint64 bytes);
+        int closeTimeout() const;
+        void setCloseTimeout(int msecs);
 
         void setNetworkEventsHandler(QObject * handler);
         void clientConnected(ServerClient && connection);
@@ -48,17 +76,26 @@ namespace Network
         void clientDisconnected(quintptr connectionId);
         void closeConnection(quintptr connectionId);
 
-        Average::Load receivedStats();
-        Average::Load sentStats();
+        // summed over all I/O threads of listener
+        Average::Load receivedStats() const;
+        Average::Load sentStats() const;
+        // socket writes, sent bytes per write show how well outgoing frames are gathered
+        Average::Load writesStats() const;
 
 #ifndef QT_NO_OPENSSL
         void setSslConfiguration(QSharedPointer<QSslConfiguration> ssl);
 #endif
 
     protected:
+        // called once per socket write
         void increaseSent(int count);
         void increaseReceived(int count);
 
+    private:
+        void writeToConnection(quintptr connectionId, const QByteArray & data);
+        void flushConnections();
+        void closeSocket(quintptr connectionId);
+
     private:
         class Statistics
         {
@@ -67,12 +104,17 @@ namespace Network
 
             Average::Move<900> br; // bytes received
             Average::Move<900> bs; // bytes sent
+            Average::Move<900> ws; // socket writes
             mutable QMutex   m;
         };
 
     private:
         TcpServer    * m_tcp_server;
+        EpollServer  * m_epoll_server;
         QObject      * m_handler;
+        // lives in handler's thread
+        Event::Dispatcher * m_dispatcher;
+        Event::Queue   m_outgoing;
         QTimer       * m_timer;
         SecureMode     m_secure;
         QHostAddress   m_ip;
@@ -80,6 +122,16 @@ namespace Network
         Statistics     m_stats;
         QString        m_server_name;
         QStringList    m_subprotocols;
+        int            m_io_threads;
+        bool           m_reuse_port;
+        int            m_write_delay;
+        qint64         m_write_buffer_limit;
+        int            m_close_timeout;
+        Backend        m_backend;
+
+        // servers of other I/O threads, connections accepted by them refer to them
+        QVector<Server*> m_workers;
+        mutable QMutex   m_workers_lock;
 
         Average::Load m_recv;
         Average::Load m_sent;
@@ -89,33 +141,39 @@ namespace Network
 #endif
     private:
         friend class TcpServer;
+        friend class EpollServer;
     };
 
     typedef QSharedPointer<Server> ServerPtr;
     typedef QWeakPointer<Server> ServerWPtr;
 
-    inline void Server::setNetworkEventsHandler(QObject * handler) { m_handler = handler; }
     inline SecureMode Server::secureMode() const                   { return m_secure;     }
     inline QHostAddress Server::listenIp() const                   { return m_ip;         }
     inline quint16 Server::port() const                            { return m_port;       }
+    inline int Server::ioThreads() const                           { return m_io_threads; }
+    inline int Server::writeDelay() const                          { return m_write_delay; }
+    inline qint64 Server::writeBufferLimit() const                 { return m_write_buffer_limit; }
+    inline int Server::closeTimeout() const                        { return m_close_timeout; }
+    inline Server::Backend Server::backend() const                 { return m_backend;     }
+    inline void Server::setBackend(Backend backend)                { m_backend = backend;  }
 
     inline void Server::clientConnected(ServerClient && connection)
-    { QCoreApplication::postEvent(m_handler, new Event::IncomingConnection(std::move(connection)), Qt::HighEventPriority); }
+    { m_dispatcher->queue().push(new Event::IncomingConnection(std::move(connection))); }
 
     inline void Server::clientUpgraded(quintptr connectionId)
-    { QCoreApplication::postEvent(m_handler, new Event::WillUpgraded(connectionId),                Qt::HighEventPriority); }
+    { m_dispatcher->queue().push(new Event::WillUpgraded(connectionId));                 }
 
     inline void Server::clientReadData(quintptr connectionId, const QByteArray & data)
-    { QCoreApplication::postEvent(m_handler, new Event::Data(connectionId, data),                  Qt::HighEventPriority); }
+    { m_dispatcher->queue().push(connectionId, data);                                    }
 
     inline void Server::clientWriteData(quintptr connectionId, const QByteArray & data)
-    { QCoreApplication::postEvent(this,      new Event::Data(connectionId, data),                  Qt::HighEventPriority); }
+    { m_outgoing.push(connectionId, data);                                               }
 
     inline void Server::clientDisconnected(quintptr connectionId)
-    { QCoreApplication::postEvent(m_handler, new Event::CloseConnection(connectionId),             Qt::HighEventPriority); }
+    { m_dispatcher->queue().push(new Event::CloseConnection(connectionId));              }
 
     inline void Server::closeConnection(quintptr connectionId)
-    { QCoreApplication::postEvent(this,      new Event::CloseConnection(connectionId),             Qt::HighEventPriority); }
+    { m_outgoing.push(new Event::CloseConnection(connectionId));                         }
 }
 
 #endif // NETWORK_SERVER_H
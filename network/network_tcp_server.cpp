@@ -1,19 +1,27 @@
 #include "network_server.h"
 #include <QTimer>
+#include <QElapsedTimer>
 #include <QWebSocketServer>
 #include <QWebSocket>
 
+#include "network_listen_socket.h"
+
 #include <logger.h>
 
 using namespace Network;
 
-TcpServer::TcpServer(Server * parent, SecureMode mode, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols)
+TcpServer::TcpServer(Server * parent, SecureMode mode, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols, bool reusePort)
     :QTcpServer(parent)
     ,m_secure(mode)
     ,m_ip(listenIp)
     ,m_port(listenPort)
+    ,m_reuse_port(reusePort)
     ,m_ws_server(new QWebSocketServer(serverName, mode == SecureMode::Secured ? QWebSocketServer::SecureMode : QWebSocketServer::NonSecureMode, this))
     ,m_server(parent)
+    ,m_flush_timer(new QTimer(this))
+    ,m_write_delay(0)
+    ,m_write_buffer_limit(0)
+    ,m_close_timeout(0)
 {
     if (!supportedSubprotocols.isEmpty()) {
 #if QT_VERSION >= QT_VERSION_CHECK(6, 4, 0)
@@ -23,6 +31,9 @@ TcpServer::TcpServer(Server * parent, SecureMode mode, QHostAddress listenIp, qu
 #endif
     }
     setMaxPendingConnections(0x7FFFFFFF);
+    m_flush_timer->setSingleShot(true);
+    m_flush_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_flush_timer, &QTimer::timeout, this, &TcpServer::flush);
     QTimer::singleShot(0, this, &TcpServer::initialize);
 }
 
@@ -35,11 +46,27 @@ void TcpServer::initialize()
 {
     connect(m_ws_server, &QWebSocketServer::newConnection, this, &TcpServer::websocketConnected);
 
-    if (listen(m_ip, m_port)) {
+    QString error;
+    if (m_reuse_port ? listenReusingPort(&error) : listen(m_ip, m_port)) {
         listeningBeingOn();
     } else {
-        listeningError();
+        listeningError(m_reuse_port ? error : errorString());
+    }
+}
+
+bool TcpServer::listenReusingPort(QString * error)
+{
+    int fd = ListenSocket::open(m_ip, m_port, true, error);
+    if (fd < 0)
+        return false;
+
+    if (!setSocketDescriptor(fd)) {
+        *error = errorString();
+        ListenSocket::close(fd);
+        return false;
     }
+
+    return true;
 }
 
 void TcpServer::listeningBeingOn()
@@ -63,18 +90,18 @@ void TcpServer::listeningBeingOn()
     emit listeningStarted(serverAddress(), serverPort());
 }
 
-void TcpServer::listeningError()
+void TcpServer::listeningError(const QString & error)
 {
     log_important << printString(QStringLiteral("interface(%1:%2), socket=%3, can't start listening, %4")
                               .arg(m_ip.toString())
                               .arg(m_port)
                               .arg(socketDescriptor())
-                              .arg(errorString())
+                              .arg(error)
                               )
                   << "[" << secureMode() << "]"
                   << end_log;
     close();
-    emit cantStartListening(errorString());
+    emit cantStartListening(error);
 }
 
 void TcpServer::receiveData(QObject * socket, QHostAddress ip, quint16 port, ConnectionType type, const QByteArray & data)
@@ -181,7 +208,49 @@ SocketType * extractConnectedSocketOtherwiseRemove(QMap<quintptr, ServerClientSo
     return Q_NULLPTR;
 }
 
-void TcpServer::writeData(quintptr connectionId, QByteArray data)
+void TcpServer::setWriteDelay(int msecs)
+{
+    m_write_delay = qMax(0, msecs);
+}
+
+void TcpServer::setWriteBufferLimit(qint64 bytes)
+{
+    m_write_buffer_limit = qMax(Q_INT64_C(0), bytes);
+}
+
+void TcpServer::setCloseTimeout(int msecs)
+{
+    m_close_timeout = qMax(0, msecs);
+}
+
+void TcpServer::writeData(quintptr connectionId, const QByteArray & data)
+{
+    QByteArray & pending = m_pending_writes[connectionId];
+    if (pending.isEmpty())
+        pending = data;
+    else
+        pending.append(data);
+
+    if (m_write_delay > 0 && !m_flush_timer->isActive())
+        m_flush_timer->start(m_write_delay);
+}
+
+void TcpServer::flush()
+{
+    if (m_pending_writes.isEmpty())
+        return;
+
+    m_flush_timer->stop();
+
+    // sending may disconnect socket, which changes pending writes
+    QHash<quintptr, QByteArray> pending;
+    pending.swap(m_pending_writes);
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it)
+        sendData(it.key(), it.value());
+}
+
+void TcpServer::sendData(quintptr connectionId, const QByteArray & data)
 {
     auto it = m_connections.find(connectionId);
 
@@ -195,6 +264,14 @@ void TcpServer::writeData(quintptr connectionId, QByteArray data)
 
         case ConnectionType::TCP: {
             if (QTcpSocket * socket = extractConnectedSocketOtherwiseRemove<QTcpSocket>(it, m_connections)) {
+                // frame written to empty buffer is always accepted, so limit does not restrict packet size
+                const qint64 pending = socket->bytesToWrite();
+                if (m_write_buffer_limit > 0 && pending > 0 && pending + data.size() > m_write_buffer_limit) {
+                    log_warning << (*it) << "client doesn't read data, pending" << pending
+                                << "bytes exceed limit of" << m_write_buffer_limit << "bytes -> connection dropped" << end_log;
+                    socket->abort();
+                    return;
+                }
                 socket->write(data);
                 break;
             }
@@ -216,11 +293,23 @@ void TcpServer::writeData(quintptr connectionId, QByteArray data)
 }
 
 template <class SocketType>
-void closeSocket(SocketType * socket)
+void closeSocket(SocketType * socket, int timeout)
 {
-    while (socket->bytesToWrite() > 0) {
+    // peer which doesn't read is given limited time
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (socket->bytesToWrite() > 0 && socket->state() == QAbstractSocket::ConnectedState) {
+        const qint64 left = timeout - elapsed.elapsed();
+        if (timeout > 0 && left <= 0) {
+            log_warning << "pending data hasn't been sent in" << timeout << "ms -> connection dropped" << end_log;
+            socket->abort();
+            return;
+        }
         QEventLoop loop;
-        QObject::connect(socket, &SocketType::bytesWritten, &loop, &QEventLoop::exit);
+        QObject::connect(socket, &SocketType::bytesWritten, &loop, &QEventLoop::quit);
+        QObject::connect(socket, &SocketType::disconnected, &loop, &QEventLoop::quit);
+        if (timeout > 0)
+            QTimer::singleShot(int(left), &loop, &QEventLoop::quit);
         loop.exec();
     }
     socket->close();
@@ -228,6 +317,14 @@ void closeSocket(SocketType * socket)
 
 void TcpServer::closeConnection(quintptr connectionId)
 {
+    // data written before close is sent first
+    auto pending = m_pending_writes.find(connectionId);
+    if (pending != m_pending_writes.end()) {
+        const QByteArray data = pending.value();
+        m_pending_writes.erase(pending);
+        sendData(connectionId, data);
+    }
+
     auto it = m_connections.find(connectionId);
 
     if (it == m_connections.end())
@@ -240,12 +337,12 @@ void TcpServer::closeConnection(quintptr connectionId)
 
         case ConnectionType::TCP:
             if (QTcpSocket * socket = extractConnectedSocketOtherwiseRemove<QTcpSocket>(it, m_connections))
-                closeSocket<QTcpSocket>(socket);
+                closeSocket<QTcpSocket>(socket, m_close_timeout);
             break;
 
         case ConnectionType::WS:
             if (QWebSocket * socket = extractConnectedSocketOtherwiseRemove<QWebSocket>(it, m_connections))
-                closeSocket<QWebSocket>(socket);
+                closeSocket<QWebSocket>(socket, m_close_timeout);
             break;
     }
 }
@@ -266,11 +363,13 @@ void processDisconnectedSocket(QMap<quintptr, ServerClientSocket> & container, Q
 
 void TcpServer::socketDisconnected()
 {
+    m_pending_writes.remove(reinterpret_cast<quintptr>(sender()));
     processDisconnectedSocket<QTcpSocket>(m_connections, sender(), m_server);
 }
 
 void TcpServer::websocketDisconnected()
 {
+    m_pending_writes.remove(reinterpret_cast<quintptr>(sender()));
     processDisconnectedSocket<QWebSocket>(m_connections, sender(), m_server);
 }
 
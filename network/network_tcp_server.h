@@ -10,8 +10,10 @@
 #include <QSslConfiguration>
 #endif
 #include <QMetaMethod>
+#include <QHash>
 
 class QWebSocketServer;
+class QTimer;
 
 namespace Network
 {
@@ -21,7 +23,7 @@ namespace Network
     {
         Q_OBJECT
     private:
-        TcpServer(Server * parent, SecureMode mode, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols);
+        TcpServer(Server * parent, SecureMode mode, QHostAddress listenIp, quint16 listenPort, const QString & serverName, const QStringList & supportedSubprotocols, bool reusePort);
         ~TcpServer();
 
     signals:
@@ -50,6 +52,12 @@ namespace Network
         void setSslConfiguration(QSharedPointer<QSslConfiguration> ssl);
 #endif
 
+        // with delay writes are flushed by timer, otherwise Server flushes them after each batch
+        int writeDelay() const { return m_write_delay; }
+        void setWriteDelay(int msecs);
+        void setWriteBufferLimit(qint64 bytes);
+        void setCloseTimeout(int msecs);
+
     protected:
         void incomingConnection(qintptr socketDescriptor) override;
         void receiveData(QObject * socket, QHostAddress ip, quint16 port, ConnectionType type, const QByteArray & data);
@@ -58,20 +66,31 @@ namespace Network
         QTcpSocket * createSocket() const;
         void configureSocket(QTcpSocket * socket) const;
 
-        void writeData(quintptr connectionId, QByteArray data);
+        // frames are gathered per connection and sent by one write (one websocket message) on flush
+        void writeData(quintptr connectionId, const QByteArray & data);
+        void flush();
+        void sendData(quintptr connectionId, const QByteArray & data);
         void closeConnection(quintptr connectionId);
 
+        // binds with SO_REUSEPORT, so several servers accept connections on the same address
+        bool listenReusingPort(QString * error);
         void listeningBeingOn();
-        void listeningError();
+        void listeningError(const QString & error);
 
     private:
         SecureMode         m_secure;
         QHostAddress       m_ip;
         quint16            m_port;
+        bool               m_reuse_port;
         QWebSocketServer * m_ws_server;
         Server           * m_server;
 
         QMap<quintptr, ServerClientSocket> m_connections;
+        QHash<quintptr, QByteArray>        m_pending_writes;
+        QTimer                           * m_flush_timer;
+        int                                m_write_delay;
+        qint64                             m_write_buffer_limit;
+        int                                m_close_timeout;
 
 #       ifndef QT_NO_OPENSSL
         QWeakPointer<QSslConfiguration> m_ssl;
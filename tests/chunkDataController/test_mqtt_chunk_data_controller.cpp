@@ -1,6 +1,7 @@
 #include <QTest>
 #include <mqtt_chunk_data_controller.h>
 #include <mqtt_constants.h>
+#include <mqtt_publish_packet.h>
 
 namespace Test
 {
@@ -14,6 +15,12 @@ namespace Test
             void testSinglePacket();
             void testSplitPackets();
             void testJoinPacket();
+            void testSharedPackets();
+            void testDetachedPublishPacket();
+            void testSplitBoundaries();
+            void testCoalescedPackets();
+            void testOversizedPacket();
+            void benchmarkPipelinedPackets();
             void testOneSecondTimer();
             void testMaxDataSize();
             void cleanupTestCase();
@@ -81,6 +88,174 @@ void ChunkDataController::testJoinPacket()
     QVERIFY2(controller->isEmpty(),              "mqtt chunk data controller must be empty after take packet from");
 }
 
+void ChunkDataController::testSharedPackets()
+{
+    QByteArrayList packets = QByteArrayList()
+                             << QByteArray::fromHex("33140004696e666f000205020000001e436564616c6f")
+                             << QByteArray::fromHex("330e0004696e666f0002436564616c6f");
+
+    controller->append(packets.join());
+
+    QByteArray owner;
+    QByteArrayList taken;
+
+    for (QByteArrayList::size_type i = 0; i < packets.size(); ++i)
+    {
+        QVERIFY2(controller->packetAvailable(), "mqtt chunk data controller must has packet");
+        QByteArray packet = controller->takePacket(&owner);
+        QVERIFY2(packet == packets.at(i), "mqtt chunk data controller must has packet same as source packet");
+        QVERIFY2(packet.constData() >= owner.constData() && packet.constData() < owner.constData() + owner.size(), "mqtt chunk data controller must not copy packet");
+        taken << packet;
+    }
+
+    QVERIFY2(controller->isEmpty(), "mqtt chunk data controller must be empty after take all packets from");
+
+    controller->append(packets.at(0));
+    QVERIFY2(taken == packets, "taken packets must stay valid while owner keeps receive buffer");
+
+    QVERIFY2(controller->packetAvailable(), "mqtt chunk data controller must has packet");
+    QVERIFY2(controller->takePacket() == packets.at(0), "mqtt chunk data controller must has packet same as source packet");
+}
+
+void ChunkDataController::testDetachedPublishPacket()
+{
+    // content type "a" is kept encoded by shared decoding
+    const QByteArray source = QByteArray::fromHex("33130004696e666f00020403000161436564616c6f");
+
+    controller->clear();
+    controller->append(source);
+
+    QByteArray owner;
+    QVERIFY2(controller->packetAvailable(), "mqtt chunk data controller must has packet");
+    QByteArray data = controller->takePacket(&owner);
+
+    ::Mqtt::PublishPacket packet;
+    QVERIFY2(packet.unserialize(data, ::Mqtt::Version::Ver_5_0, owner), "publish packet must be unserialized");
+    const QByteArray payload = packet.payload();
+    QVERIFY2(payload.constData() >= owner.constData() && payload.constData() < owner.constData() + owner.size(), "payload must reference receive buffer");
+
+    packet.detach();
+    QVERIFY2(packet.payload().constData() < owner.constData() || packet.payload().constData() >= owner.constData() + owner.size(), "detached payload must not reference receive buffer");
+
+    // receive buffer is reused by connection
+    memset(const_cast<char*>(owner.constData()), 0, size_t(owner.size()));
+    data.clear();
+    owner.clear();
+    controller->clear();
+
+    QCOMPARE(packet.topicName(), QStringLiteral("info"));
+    QCOMPARE(packet.payload(), QByteArray("Cedalo"));
+    QCOMPARE(packet.properties().value(::Mqtt::PropertyId::ContentType).toString(), QStringLiteral("a"));
+}
+
+void ChunkDataController::testSplitBoundaries()
+{
+    QByteArrayList packets = QByteArrayList()
+                             << QByteArray::fromHex("33140004696e666f000205020000001e436564616c6f")
+                             << QByteArray::fromHex("330e0004696e666f0002436564616c6f");
+
+    const QByteArray stream = packets.join();
+
+    // every split point, including ones inside fixed header
+    for (QByteArray::size_type i = 1; i < stream.size(); ++i)
+    {
+        controller->clear();
+
+        ::Mqtt::ChunkDataController::FrameArray frames;
+        controller->append(stream.left(i));
+        controller->takePackets(frames);
+        controller->append(stream.mid(i));
+        controller->takePackets(frames);
+
+        QVERIFY2(frames.size() == packets.size(), "mqtt chunk data controller must assemble all packets");
+        for (int j = 0; j < frames.size(); ++j)
+            QVERIFY2(frames.at(j).data == packets.at(j), "mqtt chunk data controller must has packet same as source packet");
+        QVERIFY2(controller->isEmpty(), "mqtt chunk data controller must be empty after take all packets from");
+    }
+}
+
+void ChunkDataController::testCoalescedPackets()
+{
+    QByteArrayList packets = QByteArrayList()
+                             << QByteArray::fromHex("820d00010000076d79746f70696301")
+                             << QByteArray::fromHex("820c000100076d79746f70696301")
+                             << QByteArray::fromHex("330e0004696e666f0002436564616c6f");
+
+    controller->clear();
+
+    const QByteArray chunk = packets.join() + packets.at(0).left(3);
+    controller->append(chunk);
+
+    ::Mqtt::ChunkDataController::FrameArray frames;
+    QVERIFY2(controller->takePackets(frames) == packets.size(), "mqtt chunk data controller must take all complete packets at once");
+
+    for (int i = 0; i < frames.size(); ++i)
+    {
+        const ::Mqtt::ChunkDataController::Frame & frame = frames.at(i);
+        QVERIFY2(frame.data == packets.at(i), "mqtt chunk data controller must has packet same as source packet");
+        QVERIFY2(frame.data.constData() >= chunk.constData() && frame.data.constData() < chunk.constData() + chunk.size(), "mqtt chunk data controller must not copy packet");
+    }
+
+    QVERIFY2(!controller->isEmpty(), "mqtt chunk data controller must keep incomplete packet");
+
+    frames.clear();
+    controller->append(packets.at(0).mid(3));
+    QVERIFY2(controller->takePackets(frames) == 1, "mqtt chunk data controller must assemble incomplete packet");
+    QVERIFY2(frames.at(0).data == packets.at(0), "mqtt chunk data controller must has packet same as source packet");
+    QVERIFY2(controller->isEmpty(), "mqtt chunk data controller must be empty after take all packets from");
+}
+
+void ChunkDataController::testOversizedPacket()
+{
+    // remaining length is 64 bytes, but only fixed header is received
+    QByteArray header = QByteArray::fromHex("3040");
+
+    controller->clear();
+    controller->setMaxDataSize(30);
+
+    controller->append(header);
+    QVERIFY2(!controller->packetAvailable(), "mqtt chunk data controller must has no packet");
+    QVERIFY2(controller->isEmpty(),          "mqtt chunk data controller must drop packet exceeded max data size");
+
+    // the same when fixed header is split
+    controller->append(header.left(1));
+    QVERIFY2(!controller->packetAvailable(), "mqtt chunk data controller must has no packet");
+    QVERIFY2(!controller->isEmpty(),         "mqtt chunk data controller must keep incomplete fixed header");
+    controller->append(header.mid(1));
+    QVERIFY2(!controller->packetAvailable(), "mqtt chunk data controller must has no packet");
+    QVERIFY2(controller->isEmpty(),          "mqtt chunk data controller must drop packet exceeded max data size");
+
+    controller->setMaxDataSize(::Mqtt::Constants::MaxIncomingDataLength);
+}
+
+void ChunkDataController::benchmarkPipelinedPackets()
+{
+    const QByteArray packet = QByteArray::fromHex("330e0004696e666f0002436564616c6f");
+
+    QByteArray stream;
+    while (stream.size() < 64 * 1024)
+        stream.append(packet);
+
+    // chunks as they are read from socket, packets are split between them
+    QByteArrayList chunks;
+    for (QByteArray::size_type i = 0; i < stream.size(); i += 1460)
+        chunks << stream.mid(i, 1460);
+
+    controller->clear();
+
+    int count = 0;
+    QBENCHMARK {
+        for (const QByteArray & chunk: chunks) {
+            ::Mqtt::ChunkDataController::FrameArray frames;
+            controller->append(chunk);
+            count += controller->takePackets(frames);
+        }
+    }
+
+    QVERIFY2(count > 0 && count % (stream.size() / packet.size()) == 0, "mqtt chunk data controller must take all packets");
+    QVERIFY2(controller->isEmpty(), "mqtt chunk data controller must be empty after take all packets from");
+}
+
 void ChunkDataController::testOneSecondTimer()
 {
     controller->setTimeout(1);
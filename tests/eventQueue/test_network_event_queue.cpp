@@ -0,0 +1,216 @@
+#include <QTest>
+#include <QThread>
+#include <network_event_queue.h>
+
+namespace Test
+{
+    // counts default constructed items, so allocated segments are visible
+    class Counted
+    {
+    public:
+        Counted() { ++defaults; }
+        explicit Counted(int value) :value(value) { }
+
+    public:
+        int value = -1;
+        static int defaults;
+    };
+
+    int Counted::defaults = 0;
+
+    // gets Wakeup events of queue as Server and Dispatcher do
+    class Consumer : public QObject
+    {
+    public:
+        explicit Consumer(bool checkOrder = false) :checkOrder(checkOrder) { }
+
+    protected:
+        bool event(QEvent * event) override
+        {
+            if (static_cast<::Network::Event::Type>(event->type()) != ::Network::Event::Type::Wakeup)
+                return QObject::event(event);
+
+            ++wakeups;
+            static_cast<::Network::Event::Wakeup*>(event)->queue->consume([this](::Network::Event::Message & message) {
+                if (checkOrder && message.connectionId != quintptr(received + 1))
+                    ++misordered;
+                ++received;
+            });
+            return true;
+        }
+
+    public:
+        bool checkOrder;
+        int  wakeups    = 0;
+        int  received   = 0;
+        int  misordered = 0;
+    };
+
+    // records what handler gets from dispatcher
+    class Handler : public QObject
+    {
+    protected:
+        bool event(QEvent * event) override
+        {
+            switch (static_cast<::Network::Event::Type>(event->type()))
+            {
+                case ::Network::Event::Type::Data:
+                    log.append(qMakePair(int(::Network::Event::Type::Data), static_cast<::Network::Event::Data*>(event)->connectionId));
+                    return true;
+                case ::Network::Event::Type::CloseConnection:
+                    log.append(qMakePair(int(::Network::Event::Type::CloseConnection), static_cast<::Network::Event::CloseConnection*>(event)->connectionId));
+                    return true;
+                default: break;
+            }
+            return QObject::event(event);
+        }
+
+    public:
+        QVector<QPair<int, quintptr>> log;
+    };
+
+    class NetworkEventQueue : public QObject
+    {
+        Q_OBJECT
+    private slots:
+        void testSegmentRollover();
+        void testConsumedSegmentIsReused();
+        void testWakeupIsCoalesced();
+        void testPushRacingConsumerIsNotLost();
+        void testDataIsDeliveredBeforeDisconnection();
+    };
+}
+
+int maxloglevel = 12;
+
+using namespace Test;
+
+void NetworkEventQueue::testSegmentRollover()
+{
+    ::Network::Event::SpscQueue<Counted, 4> queue;
+
+    // backlog spans several segments and is read in order it was written
+    for (int i = 0; i < 41; ++i)
+        queue.push(Counted(i));
+
+    Counted value(0);
+    for (int i = 0; i < 41; ++i) {
+        QVERIFY2(queue.pop(value), "written item must be read");
+        QCOMPARE(value.value, i);
+    }
+    QVERIFY2(!queue.pop(value), "empty queue must not return item");
+
+    queue.push(Counted(41));
+    QVERIFY2(queue.pop(value) && value.value == 41, "queue must stay usable after it is drained");
+}
+
+void NetworkEventQueue::testConsumedSegmentIsReused()
+{
+    enum : int { SegmentSize = 4, Rounds = 20 };
+
+    Counted::defaults = 0;
+    int pops = 0;
+    {
+        ::Network::Event::SpscQueue<Counted, SegmentSize> queue;
+        Counted value(0);
+        for (int round = 0; round < Rounds; ++round) {
+            for (int i = 0; i < SegmentSize; ++i)
+                queue.push(Counted(round * SegmentSize + i));
+            for (int i = 0; i < SegmentSize; ++i) {
+                QVERIFY(queue.pop(value));
+                QCOMPARE(value.value, round * SegmentSize + i);
+                ++pops;
+            }
+        }
+    }
+
+    // every segment default constructs its items, every pop resets read item
+    const int segments = (Counted::defaults - pops) / SegmentSize;
+    QVERIFY2(segments == 2, "consumed segment must be reused by producer instead of allocating new one");
+}
+
+void NetworkEventQueue::testWakeupIsCoalesced()
+{
+    Consumer consumer;
+    ::Network::Event::Queue queue(&consumer);
+
+    for (int i = 0; i < 100; ++i)
+        queue.push(quintptr(i + 1), QByteArrayLiteral("data"));
+    QCoreApplication::sendPostedEvents(&consumer);
+
+    QCOMPARE(consumer.wakeups, 1);
+    QCOMPARE(consumer.received, 100);
+
+    // batch pushed after consumption wakes consumer up again
+    queue.push(new ::Network::Event::CloseConnection(1));
+    queue.push(new ::Network::Event::CloseConnection(2));
+    QCoreApplication::sendPostedEvents(&consumer);
+
+    QCOMPARE(consumer.wakeups, 2);
+    QCOMPARE(consumer.received, 102);
+}
+
+void NetworkEventQueue::testPushRacingConsumerIsNotLost()
+{
+    enum : int { Count = 200000 };
+
+    // producer keeps pushing while consumer resets pending flag and drains queue,
+    // message pushed between them must wake consumer up again
+    Consumer consumer(true);
+    ::Network::Event::Queue queue(&consumer);
+
+    QThread * producer = QThread::create([&queue] () {
+        for (int i = 0; i < Count; ++i) {
+            queue.push(quintptr(i + 1), QByteArray());
+            if (i % 1000 == 0)
+                QThread::yieldCurrentThread();
+        }
+    });
+    producer->start();
+
+    QTRY_COMPARE_WITH_TIMEOUT(consumer.received, int(Count), 10000);
+    QVERIFY2(producer->wait(5000), "producer must finish");
+    delete producer;
+
+    QCOMPARE(consumer.misordered, 0);
+    QVERIFY2(consumer.wakeups < int(Count), "consumer must be woken up once per batch, not per message");
+}
+
+void NetworkEventQueue::testDataIsDeliveredBeforeDisconnection()
+{
+    enum : int { Connections = 100 };
+
+    Handler handler;
+    ::Network::Event::Dispatcher * dispatcher = new ::Network::Event::Dispatcher(&handler);
+
+    // the same order as I/O thread reports last data and disconnection of connection
+    QThread * io = QThread::create([dispatcher] () {
+        for (int i = 0; i < Connections; ++i) {
+            const quintptr id = quintptr(i + 1);
+            dispatcher->queue().push(id, QByteArrayLiteral("last"));
+            dispatcher->queue().push(id, QByteArrayLiteral("words"));
+            dispatcher->queue().push(new ::Network::Event::CloseConnection(id));
+        }
+    });
+    io->start();
+
+    QTRY_COMPARE_WITH_TIMEOUT(handler.log.count(), int(Connections) * 3, 5000);
+    QVERIFY2(io->wait(5000), "producer must finish");
+    delete io;
+
+    QHash<quintptr, int> data;
+    for (auto entry: handler.log) {
+        if (entry.first == int(::Network::Event::Type::Data)) {
+            QVERIFY2(data.value(entry.second) >= 0, "data must not be delivered after disconnection");
+            ++data[entry.second];
+        } else {
+            QVERIFY2(data.value(entry.second) == 2, "disconnection must be delivered after all data of connection");
+            data[entry.second] = -1;
+        }
+    }
+
+    delete dispatcher;
+}
+
+QTEST_MAIN(Test::NetworkEventQueue)
+#include "test_network_event_queue.moc"
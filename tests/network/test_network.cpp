@@ -1,7 +1,21 @@
 #include <QTest>
 #include <QTimer>
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QSet>
 #include <network_server.h>
 #include <QWebSocket>
+#include <numeric>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <QDir>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <ctime>
+#endif
+
+Q_DECLARE_METATYPE(::Network::Server::Backend)
 
 namespace Test
 {
@@ -25,6 +39,25 @@ namespace Test
         void testCloseWsNetworkConnection();
         void testCloseWsNetworkConnectionByServer();
 
+        // cases below start own server, events of its connections are recorded
+        void testConnectionsAreSpreadBetweenThreads_data();
+        void testConnectionsAreSpreadBetweenThreads();
+        void testBatchIsSentByOneWrite_data();
+        void testBatchIsSentByOneWrite();
+        void testWritesAreFlushedByDelayTimer_data();
+        void testWritesAreFlushedByDelayTimer();
+        void testCloseSendsPendingWritesFirst_data();
+        void testCloseSendsPendingWritesFirst();
+        void testEpollAcceptConnection();
+        void testEpollReadSeveralFramesOfOneWrite();
+        void testEpollPartialSendIsResumedWhenWritable();
+        void testEpollCloseSendsWrittenDataFirst();
+        void testEpollWriteBufferLimitDropsConnection();
+        void testEpollCloseTimeoutDropsConnection();
+        void testEpollBusyConnectionIsReadInParts();
+        void testEpollAcceptIsPausedWithoutDescriptors();
+
+        void cleanup();
         void cleanupTestCase();
 
     public slots:
@@ -52,6 +85,16 @@ namespace Test
         void checkOpenConnectFinished();
         void checkCloseConnectFinished();
 
+        void backends();
+        bool startServer(::Network::Server::Backend backend, int ioThreads = 1, int writeDelay = 0);
+        // connected socket and server side of its connection
+        QTcpSocket * connectClient(::Network::ServerClient & client);
+        // socket reads nothing, so server gets EAGAIN when socket buffers are full
+        void stallReading(QTcpSocket * socket);
+        void resumeReading(QTcpSocket * socket);
+        static QByteArray payload(int size);
+        bool recordEvent(QEvent * event);
+
     private:
         enum class TestStep : quint8
         {
@@ -94,6 +137,27 @@ namespace Test
 
          QByteArray infligthData;
          QByteArray incomingData;
+
+         // frames which are gathered into one write
+         QByteArrayList frames = QByteArrayList()
+                                 << QByteArray::fromHex("20020000")
+                                 << QByteArray::fromHex("9003000100")
+                                 << QByteArray::fromHex("330e0004696e666f0002436564616c6f")
+                                 << QByteArray::fromHex("d000");
+
+         // own server drops peer which doesn't read
+         enum : int { BigPayloadSize = 32 * 1024 * 1024 };
+         enum : int { WriteBufferLimit = 1024 * 1024 };
+         enum : int { CloseTimeout = 1000 };
+
+         // state of cases with own server
+         ::Network::Server * ownServer = Q_NULLPTR;
+         quint16 ownPort = 0;
+         QVector<::Network::ServerClient> incoming;
+         QHash<quintptr, QByteArray> received;
+         QVector<quintptr> closed;
+         QVector<QTcpSocket*> sockets;
+         QHash<QTcpSocket*, QByteArray> read;
     };
 }
 
@@ -246,6 +310,383 @@ void Test::Network::testCloseWsNetworkConnectionByServer()
     QVERIFY2(ws_socket->state() == QAbstractSocket::UnconnectedState, "ws socket must be unconnected");
 }
 
+void Test::Network::testConnectionsAreSpreadBetweenThreads_data()
+{
+    backends();
+}
+
+void Test::Network::testConnectionsAreSpreadBetweenThreads()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("several I/O threads per listener are supported on Linux only");
+#endif
+    enum : int { IoThreads = 4, MaxConnections = 64 };
+
+    QFETCH(::Network::Server::Backend, backend);
+    QVERIFY2(startServer(backend, IoThreads), "server must start listening");
+
+    // other threads start listening after the first one, kernel spreads connections between listening ones
+    QSet<const ::Network::Server*> instances;
+    while (instances.count() < 2 && sockets.count() < MaxConnections) {
+        ::Network::ServerClient client;
+        QVERIFY2(connectClient(client) != Q_NULLPTR, "connection must be accepted");
+        instances.insert(client.serverInstance());
+        QTest::qWait(5);
+    }
+    QVERIFY2(instances.count() >= 2, "connections must be accepted by several threads");
+    QVERIFY2(!instances.contains(Q_NULLPTR), "connection must refer to server of its thread");
+
+    // each connection sends its own count of bytes
+    qint64 total = 0;
+    QHash<const ::Network::Server*, qint64> byInstance;
+    for (int i = 0; i < sockets.count(); ++i) {
+        const QByteArray data(100 + i, 'x');
+        sockets.at(i)->write(data);
+        byInstance[incoming.at(i).serverInstance()] += data.size();
+        total += data.size();
+    }
+
+    auto receivedTotal = [this] () {
+        return std::accumulate(received.cbegin(), received.cend(), qint64(0), [] (qint64 sum, const QByteArray & data) { return sum + data.size(); });
+    };
+    QTRY_COMPARE_WITH_TIMEOUT(receivedTotal(), total, 5000);
+
+    // listener reports sum over its threads, each thread counts its own connections only
+    QCOMPARE(ownServer->receivedStats().m_count, total);
+    for (auto it = byInstance.cbegin(); it != byInstance.cend(); ++it) {
+        if (it.key() != ownServer)
+            QCOMPARE(it.key()->receivedStats().m_count, it.value());
+    }
+}
+
+void Test::Network::testBatchIsSentByOneWrite_data()
+{
+    backends();
+}
+
+void Test::Network::testBatchIsSentByOneWrite()
+{
+    enum : int { WriteDelay = 300 };
+
+    QFETCH(::Network::Server::Backend, backend);
+    QVERIFY2(startServer(backend, 1, WriteDelay), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY2(socket != Q_NULLPTR, "connection must be accepted");
+
+    // frames written within delay are one batch
+    const qint64 before = ownServer->writesStats().m_count;
+    for (const QByteArray & frame: frames)
+        client.write(frame);
+
+    QTRY_COMPARE_WITH_TIMEOUT(read.value(socket), frames.join(), 5000);
+    QCOMPARE(ownServer->writesStats().m_count - before, Q_INT64_C(1));
+    QCOMPARE(ownServer->sentStats().m_count, qint64(frames.join().size()));
+}
+
+void Test::Network::testWritesAreFlushedByDelayTimer_data()
+{
+    backends();
+}
+
+void Test::Network::testWritesAreFlushedByDelayTimer()
+{
+    enum : int { WriteDelay = 300 };
+
+    QFETCH(::Network::Server::Backend, backend);
+    QVERIFY2(startServer(backend, 1, WriteDelay), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY2(socket != Q_NULLPTR, "connection must be accepted");
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    client.write(frames.first());
+
+    QTest::qWait(WriteDelay / 3);
+    QVERIFY2(read.value(socket).isEmpty(), "frame must wait for delay");
+
+    // nothing else is written, so only timer sends the frame
+    QTRY_COMPARE_WITH_TIMEOUT(read.value(socket), frames.first(), 5000);
+    QVERIFY2(elapsed.elapsed() >= WriteDelay / 2, "frame must be sent after delay");
+}
+
+void Test::Network::testCloseSendsPendingWritesFirst_data()
+{
+    backends();
+}
+
+void Test::Network::testCloseSendsPendingWritesFirst()
+{
+    // long delay, so only close can send frames in time
+    enum : int { WriteDelay = 3000 };
+
+    QFETCH(::Network::Server::Backend, backend);
+    QVERIFY2(startServer(backend, 1, WriteDelay), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY2(socket != Q_NULLPTR, "connection must be accepted");
+
+    QByteArray readOnDisconnect;
+    bool disconnected = false;
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket, &readOnDisconnect, &disconnected] () {
+        read[socket].append(socket->readAll());
+        readOnDisconnect = read.value(socket);
+        disconnected = true;
+    });
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (const QByteArray & frame: frames)
+        client.write(frame);
+    client.close();
+
+    QTRY_VERIFY2_WITH_TIMEOUT(disconnected, "connection must be closed by server", 5000);
+    QVERIFY2(elapsed.elapsed() < WriteDelay, "close must not wait for delay");
+    QVERIFY2(readOnDisconnect == frames.join(), "frames written before close must be received before disconnection");
+}
+
+void Test::Network::testEpollAcceptConnection()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY2(socket != Q_NULLPTR, "connection must be accepted");
+
+    QVERIFY2(client.id() != 0                       , "connection id must be assigned");
+    QVERIFY2(client.serverInstance() == ownServer   , "server in client must be assigned to this server");
+    QVERIFY2(client.ip() == socket->localAddress()  , "client ip and socket local address must be equals");
+    QVERIFY2(client.port() == socket->localPort()   , "client port and socket local port must be equals");
+
+    ::Network::ServerClient other;
+    QVERIFY2(connectClient(other) != Q_NULLPTR      , "second connection must be accepted");
+    QVERIFY2(other.id() != client.id()              , "connections must have different ids");
+}
+
+void Test::Network::testEpollReadSeveralFramesOfOneWrite()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY(socket != Q_NULLPTR);
+
+    // edge-triggered socket is signalled once, so everything must be read until EAGAIN,
+    // big part is greater than read buffer
+    QByteArray data = QByteArray::fromHex("101000044D5154540402003C000444494749")
+                    + QByteArray::fromHex("820d00010000076d79746f70696301")
+                    + QByteArray::fromHex("330e0004696e666f0002436564616c6f")
+                    + payload(200 * 1024);
+    socket->write(data);
+
+    QTRY_COMPARE_WITH_TIMEOUT(received.value(client.id()).size(), data.size(), 5000);
+    QVERIFY2(received.value(client.id()) == data, "frames must be received in order they were written");
+    QVERIFY2(!closed.contains(client.id()), "connection must stay open");
+}
+
+void Test::Network::testEpollPartialSendIsResumedWhenWritable()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY(socket != Q_NULLPTR);
+
+    stallReading(socket);
+
+    // first frame is accepted whatever its size, rest waits in queue while socket is full
+    const QByteArray big = payload(BigPayloadSize);
+    const QByteArray tail = QByteArrayLiteral("tail");
+    client.write(big);
+    client.write(tail);
+    QTest::qWait(200);
+    QVERIFY2(!closed.contains(client.id()), "connection which is written to empty queue must not be dropped");
+
+    resumeReading(socket);
+
+    QTRY_COMPARE_WITH_TIMEOUT(read.value(socket).size(), big.size() + tail.size(), 10000);
+    QVERIFY2(read.value(socket) == big + tail, "data must be sent completely and in order");
+}
+
+void Test::Network::testEpollCloseSendsWrittenDataFirst()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY(socket != Q_NULLPTR);
+
+    int readOnDisconnect = -1;
+    connect(socket, &QTcpSocket::disconnected, this, [this, socket, &readOnDisconnect] () {
+        read[socket].append(socket->readAll());
+        readOnDisconnect = read.value(socket).size();
+    });
+
+    const QByteArray big = payload(BigPayloadSize);
+    client.write(big);
+    client.close();
+
+    QTRY_VERIFY2_WITH_TIMEOUT(readOnDisconnect >= 0, "connection must be closed by server", 10000);
+    QCOMPARE(readOnDisconnect, big.size());
+    QVERIFY2(read.value(socket) == big, "data written before close must be received before disconnection");
+    QTRY_VERIFY2_WITH_TIMEOUT(closed.contains(client.id()), "handler must be notified about closed connection", 5000);
+}
+
+void Test::Network::testEpollWriteBufferLimitDropsConnection()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY(socket != Q_NULLPTR);
+
+    stallReading(socket);
+
+    client.write(payload(BigPayloadSize));
+    QTest::qWait(200);
+    QVERIFY2(!closed.contains(client.id()), "connection must not be dropped before limit is exceeded");
+
+    client.write(payload(WriteBufferLimit));
+    QTRY_VERIFY2_WITH_TIMEOUT(closed.contains(client.id()), "connection which doesn't read must be dropped", 5000);
+    QTRY_VERIFY2_WITH_TIMEOUT(socket->state() == QAbstractSocket::UnconnectedState, "socket must be disconnected", 5000);
+}
+
+void Test::Network::testEpollCloseTimeoutDropsConnection()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient client;
+    QTcpSocket * socket = connectClient(client);
+    QVERIFY(socket != Q_NULLPTR);
+
+    stallReading(socket);
+
+    client.write(payload(BigPayloadSize));
+    QElapsedTimer elapsed;
+    elapsed.start();
+    client.close();
+
+    QTRY_VERIFY2_WITH_TIMEOUT(closed.contains(client.id()), "closed connection which doesn't read must be dropped", 5000);
+    QVERIFY2(elapsed.elapsed() >= CloseTimeout / 2, "closed connection must be given time to send pending data");
+}
+
+void Test::Network::testEpollBusyConnectionIsReadInParts()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#endif
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    ::Network::ServerClient busy;
+    QTcpSocket * busySocket = connectClient(busy);
+    QVERIFY(busySocket != Q_NULLPTR);
+
+    ::Network::ServerClient other;
+    QTcpSocket * otherSocket = connectClient(other);
+    QVERIFY(otherSocket != Q_NULLPTR);
+
+    // busy connection exceeds read limit of one pass many times, rest of its data is read on next passes
+    const QByteArray big = payload(8 * 1024 * 1024);
+    const QByteArray small = QByteArray::fromHex("330e0004696e666f0002436564616c6f");
+    busySocket->write(big);
+    otherSocket->write(small);
+
+    QTRY_COMPARE_WITH_TIMEOUT(received.value(other.id()), small, 5000);
+    QTRY_COMPARE_WITH_TIMEOUT(received.value(busy.id()).size(), big.size(), 10000);
+    QVERIFY2(received.value(busy.id()) == big, "data read in several passes must be received completely and in order");
+    QCOMPARE(ownServer->receivedStats().m_count, qint64(big.size() + small.size()));
+}
+
+void Test::Network::testEpollAcceptIsPausedWithoutDescriptors()
+{
+#ifndef Q_OS_LINUX
+    QSKIP("epoll is supported on Linux only");
+#else
+    QVERIFY2(startServer(::Network::Server::Backend::Epoll), "server must start listening");
+
+    // few descriptors are left to process, all but one of them are taken, the last one is for client socket
+    int maxFd = 0;
+    for (const QString & name: QDir(QStringLiteral("/proc/self/fd")).entryList(QDir::AllEntries | QDir::System | QDir::NoDotAndDotDot))
+        maxFd = qMax(maxFd, name.toInt());
+    rlimit saved;
+    QVERIFY(::getrlimit(RLIMIT_NOFILE, &saved) == 0);
+    rlimit limit = saved;
+    limit.rlim_cur = qMin(rlim_t(maxFd + 32), saved.rlim_cur);
+    QVERIFY(::setrlimit(RLIMIT_NOFILE, &limit) == 0);
+
+    std::vector<int> taken;
+    for (int fd = ::dup(0); fd >= 0; fd = ::dup(0))
+        taken.push_back(fd);
+    if (!taken.empty()) {
+        ::close(taken.back());
+        taken.pop_back();
+    }
+
+    QTcpSocket * socket = new QTcpSocket();
+    sockets.append(socket);
+    socket->connectToHost(QHostAddress::LocalHost, ownPort);
+    const bool connected = socket->waitForConnected(5000);
+
+    // listening socket is level triggered, server must not spin on connection which it can't accept
+    timespec cpuBefore, cpuAfter;
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuBefore);
+    QTest::qWait(500);
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuAfter);
+    const qint64 cpuMsecs = qint64(cpuAfter.tv_sec - cpuBefore.tv_sec) * 1000 + (cpuAfter.tv_nsec - cpuBefore.tv_nsec) / 1000000;
+    const int acceptedWithoutDescriptors = incoming.count();
+
+    for (int fd: taken)
+        ::close(fd);
+    ::setrlimit(RLIMIT_NOFILE, &saved);
+
+    QVERIFY2(connected, "client socket must connect, connection waits in backlog");
+    QCOMPARE(acceptedWithoutDescriptors, 0);
+    QVERIFY2(cpuMsecs < 250, "server must pause accepting while descriptors are exhausted");
+
+    // accepting is resumed by timer
+    QTRY_COMPARE_WITH_TIMEOUT(incoming.count(), 1, 5000);
+#endif
+}
+
+void Test::Network::cleanup()
+{
+    for (QTcpSocket * socket: sockets) {
+        socket->disconnect(this);
+        socket->abort();
+        delete socket;
+    }
+    sockets.clear();
+    read.clear();
+
+    delete ownServer;
+    ownServer = Q_NULLPTR;
+    incoming.clear();
+    received.clear();
+    closed.clear();
+}
+
 void Test::Network::cleanupTestCase()
 {
     connect(server, &::Network::Server::finished, &waitLoop, &QEventLoop::quit);
@@ -317,6 +758,10 @@ void Test::Network::wsSocketBinaryMessage(const QByteArray & message)
 
 bool Test::Network::event(QEvent * event)
 {
+    // main server has no connections while own server is running
+    if (ownServer != Q_NULLPTR && recordEvent(event))
+        return true;
+
     ::Network::Event::Type type = static_cast<::Network::Event::Type>(event->type());
 
     switch (type)
@@ -457,5 +902,111 @@ void Test::Network::handleConnectionWillUpgraded(quintptr connectionId)
     socketServerClient = ::Network::ServerClient();
 }
 
+void Test::Network::backends()
+{
+    QTest::addColumn<::Network::Server::Backend>("backend");
+    QTest::newRow("qt")    << ::Network::Server::Backend::Qt;
+#ifdef Q_OS_LINUX
+    QTest::newRow("epoll") << ::Network::Server::Backend::Epoll;
+#endif
+}
+
+bool Test::Network::startServer(::Network::Server::Backend backend, int ioThreads, int writeDelay)
+{
+    ownPort = 0;
+    ownServer = new ::Network::Server(::Network::SecureMode::NonSecured, QHostAddress::LocalHost, 0, QString(), QStringList(), ioThreads);
+    ownServer->setBackend(backend);
+    ownServer->setWriteDelay(writeDelay);
+    ownServer->setWriteBufferLimit(WriteBufferLimit);
+    ownServer->setCloseTimeout(CloseTimeout);
+    ownServer->setNetworkEventsHandler(this);
+    connect(ownServer, &::Network::Server::listeningStarted, this, [this] (QHostAddress, quint16 port) { ownPort = port; });
+    ownServer->start();
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (ownPort == 0 && elapsed.elapsed() < 5000)
+        QTest::qWait(10);
+    return (ownPort != 0);
+}
+
+QTcpSocket * Test::Network::connectClient(::Network::ServerClient & client)
+{
+    QTcpSocket * socket = new QTcpSocket();
+    sockets.append(socket);
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket] () { read[socket].append(socket->readAll()); });
+
+    const int count = incoming.count();
+    socket->connectToHost(QHostAddress::LocalHost, ownPort);
+    if (!socket->waitForConnected(5000))
+        return Q_NULLPTR;
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (incoming.count() == count && elapsed.elapsed() < 5000)
+        QTest::qWait(10);
+    if (incoming.count() == count)
+        return Q_NULLPTR;
+
+    client = incoming.last();
+    return socket;
+}
+
+void Test::Network::stallReading(QTcpSocket * socket)
+{
+    socket->disconnect(this);
+    socket->setReadBufferSize(1);
+}
+
+void Test::Network::resumeReading(QTcpSocket * socket)
+{
+    socket->setReadBufferSize(0);
+    connect(socket, &QTcpSocket::readyRead, this, [this, socket] () { read[socket].append(socket->readAll()); });
+    read[socket].append(socket->readAll());
+}
+
+QByteArray Test::Network::payload(int size)
+{
+    // bytes depend on position, so lost or reordered part is not equal to sent one
+    QByteArray data(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i)
+        data[i] = char(i % 251);
+    return data;
+}
+
+bool Test::Network::recordEvent(QEvent * event)
+{
+    switch (static_cast<::Network::Event::Type>(event->type()))
+    {
+        case ::Network::Event::Type::IncomingConnection:
+        {
+            ::Network::Event::IncomingConnection * e = dynamic_cast<::Network::Event::IncomingConnection*>(event);
+            incoming.append(e->connection);
+            e->accept();
+            return true;
+        }
+
+        case ::Network::Event::Type::CloseConnection:
+        {
+            ::Network::Event::CloseConnection * e = dynamic_cast<::Network::Event::CloseConnection*>(event);
+            closed.append(e->connectionId);
+            e->accept();
+            return true;
+        }
+
+        case ::Network::Event::Type::Data:
+        {
+            ::Network::Event::Data * e = dynamic_cast<::Network::Event::Data*>(event);
+            received[e->connectionId].append(e->data);
+            e->accept();
+            return true;
+        }
+
+        default: break;
+    }
+
+    return false;
+}
+
 QTEST_MAIN(Test::Network)
 #include "test_network.moc"
@@ -0,0 +1,246 @@
+#include <QTest>
+#include <mqtt_properties.h>
+#include <mqtt_encoder.h>
+#include <mqtt_decoder.h>
+
+namespace Test
+{
+    namespace Mqtt
+    {
+        class Properties : public QObject
+        {
+            Q_OBJECT
+        private slots:
+            void testRoundTrip_data();
+            void testRoundTrip();
+            void testRepeatedPropertyIsRejected_data();
+            void testRepeatedPropertyIsRejected();
+            void testInvalidPropertyIsRejected_data();
+            void testInvalidPropertyIsRejected();
+            void testLazyJoinsNonContiguousSpans();
+            void testLazyWritesEncodedSpanBack();
+            void testDecodeEncodedAfterSetAndRemove();
+
+        private:
+            static QByteArray encode(const ::Mqtt::Properties & props);
+            // properties without length prefix
+            static bool decode(const QByteArray & data, ::Mqtt::Properties & props, ::Mqtt::Properties::Decoding decoding);
+        };
+    }
+}
+
+using namespace Test::Mqtt;
+using ::Mqtt::PropertyId;
+
+Q_DECLARE_METATYPE(::Mqtt::Properties::Decoding)
+
+QByteArray Properties::encode(const ::Mqtt::Properties & props)
+{
+    const int size = props.encodedSize();
+    QByteArray data(::Mqtt::Encoder::variableByteIntegerSize(quint64(size)) + size, Qt::Uninitialized);
+    ::Mqtt::BufferWriter writer(data);
+    props.write(writer, size);
+    return data;
+}
+
+bool Properties::decode(const QByteArray & data, ::Mqtt::Properties & props, ::Mqtt::Properties::Decoding decoding)
+{
+    return props.read(reinterpret_cast<const quint8*>(data.constData()), data.size(), decoding);
+}
+
+void Properties::testRoundTrip_data()
+{
+    QTest::addColumn<::Mqtt::Properties::Decoding>("decoding");
+    QTest::addColumn<int>("id");
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<int>("size");
+
+    const QList<QPair<QByteArray, ::Mqtt::Properties::Decoding>> modes = {
+         { "eager"      , ::Mqtt::Properties::Decoding::Eager      }
+        ,{ "lazy"       , ::Mqtt::Properties::Decoding::Lazy       }
+        ,{ "lazy shared", ::Mqtt::Properties::Decoding::LazyShared }
+    };
+
+    for (const auto & mode: modes) {
+        QTest::newRow((mode.first + " byte").constData())                  << mode.second << int(PropertyId::PayloadFormatIndicator) << QVariant(1u)           << 2;
+        QTest::newRow((mode.first + " two byte integer").constData())      << mode.second << int(PropertyId::TopicAlias)             << QVariant(0xABCDu)      << 3;
+        QTest::newRow((mode.first + " four byte integer").constData())     << mode.second << int(PropertyId::MessageExpiryInterval)  << QVariant(0x01020304u)  << 5;
+        QTest::newRow((mode.first + " variable byte integer").constData()) << mode.second << int(PropertyId::SubscriptionIdentifier) << QVariant(268435455u)   << 5;
+        QTest::newRow((mode.first + " string").constData())                << mode.second << int(PropertyId::ContentType)            << QVariant(QStringLiteral(u"text/plain; ÿ€")) << 3 + 17;
+        QTest::newRow((mode.first + " binary data").constData())           << mode.second << int(PropertyId::CorrelationData)        << QVariant(QByteArray("\x00\x01\xFF", 3)) << 3 + 3;
+        QTest::newRow((mode.first + " string pair").constData())           << mode.second << int(PropertyId::UserProperty)
+                                                             << QVariant::fromValue<::Mqtt::UserProperty>(::Mqtt::UserProperty(QStringLiteral("key"), QStringLiteral("value"))) << 5 + 3 + 5;
+    }
+}
+
+void Properties::testRoundTrip()
+{
+    QFETCH(::Mqtt::Properties::Decoding, decoding);
+    QFETCH(int, id);
+    QFETCH(QVariant, value);
+    QFETCH(int, size);
+
+    ::Mqtt::Properties source;
+    source.append({ PropertyId(id), value });
+    QCOMPARE(source.encodedSize(), size);
+
+    const QByteArray encoded = encode(source);
+    QCOMPARE(encoded.size(), 1 + size);
+    QCOMPARE(quint8(encoded.at(0)), quint8(size));
+    QCOMPARE(quint8(encoded.at(1)), quint8(id));
+
+    ::Mqtt::Properties decoded;
+    QVERIFY2(decode(encoded.mid(1), decoded, decoding), "encoded properties must be decoded");
+    QCOMPARE(decoded.count(), 1);
+    QVERIFY2(decoded.contains(PropertyId(id)), "decoded properties must contain encoded one");
+    QCOMPARE(decoded.encodedSize(), size);
+    QVERIFY2(encode(decoded) == encoded, "decoded properties must be encoded to the same bytes");
+    if (PropertyId::UserProperty == PropertyId(id))
+        QCOMPARE(decoded.value(PropertyId(id)).value<::Mqtt::UserProperty>(), value.value<::Mqtt::UserProperty>());
+    else
+        QCOMPARE(decoded.value(PropertyId(id)), value);
+}
+
+void Properties::testRepeatedPropertyIsRejected_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("byte twice")                  << QByteArray::fromHex("01000101")                     << false;
+    QTest::newRow("integer twice")               << QByteArray::fromHex("230001230002")                 << false;
+    QTest::newRow("string twice")                << QByteArray::fromHex("0300016103000162")             << false;
+    QTest::newRow("binary data twice")           << QByteArray::fromHex("0900010109000102")             << false;
+    QTest::newRow("string after other string")   << QByteArray::fromHex("030001610800016203000163")     << false;
+    QTest::newRow("subscription identifiers")    << QByteArray::fromHex("0b010b02")                     << true;
+    QTest::newRow("user properties")             << QByteArray::fromHex("2600016b0001762600016b000177") << true;
+}
+
+void Properties::testRepeatedPropertyIsRejected()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, valid);
+
+    for (auto decoding: { ::Mqtt::Properties::Decoding::Eager, ::Mqtt::Properties::Decoding::Lazy, ::Mqtt::Properties::Decoding::LazyShared }) {
+        ::Mqtt::Properties props;
+        QCOMPARE(decode(data, props, decoding), valid);
+    }
+}
+
+void Properties::testInvalidPropertyIsRejected_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("unknown id")                   << QByteArray::fromHex("0400");
+    QTest::newRow("id out of table")              << QByteArray::fromHex("7f00");
+    QTest::newRow("truncated integer")            << QByteArray::fromHex("020102");
+    QTest::newRow("truncated variable integer")   << QByteArray::fromHex("0b80");
+    QTest::newRow("truncated string")             << QByteArray::fromHex("03000561");
+    QTest::newRow("truncated string length")      << QByteArray::fromHex("0300");
+    QTest::newRow("string pair without value")    << QByteArray::fromHex("2600016b");
+    QTest::newRow("malformed string")             << QByteArray::fromHex("03000180");
+    QTest::newRow("string with null")             << QByteArray::fromHex("0300026100");
+    QTest::newRow("surrogate in string pair key") << QByteArray::fromHex("260003eda080000176");
+    QTest::newRow("malformed string pair value")  << QByteArray::fromHex("2600016b0001c0");
+}
+
+void Properties::testInvalidPropertyIsRejected()
+{
+    QFETCH(QByteArray, data);
+
+    for (auto decoding: { ::Mqtt::Properties::Decoding::Eager, ::Mqtt::Properties::Decoding::Lazy, ::Mqtt::Properties::Decoding::LazyShared }) {
+        ::Mqtt::Properties props;
+        QVERIFY2(!decode(data, props, decoding), "invalid properties must be rejected");
+    }
+}
+
+void Properties::testLazyJoinsNonContiguousSpans()
+{
+    // integers are decoded at once and split properties which are kept encoded
+    const QByteArray data = QByteArray::fromHex("03000161")         // content type "a"
+                          + QByteArray::fromHex("0200000e10")       // message expiry interval 3600
+                          + QByteArray::fromHex("090002beef")       // correlation data
+                          + QByteArray::fromHex("230007")           // topic alias 7
+                          + QByteArray::fromHex("2600016b000176");  // user property k=v
+
+    for (auto decoding: { ::Mqtt::Properties::Decoding::Lazy, ::Mqtt::Properties::Decoding::LazyShared }) {
+        QByteArray buffer(data.constData(), data.size());
+        ::Mqtt::Properties props;
+        QVERIFY(decode(buffer, props, decoding));
+
+        QCOMPARE(props.count(), 5);
+        QCOMPARE(props.integer(PropertyId::MessageExpiryInterval), 3600u);
+        QCOMPARE(props.integer(PropertyId::TopicAlias), 7u);
+        QVERIFY(props.contains(PropertyId::ContentType));
+        QVERIFY(props.contains(PropertyId::CorrelationData));
+        QVERIFY(props.contains(PropertyId::UserProperty));
+
+        // joined spans are copied, so they don't depend on buffer
+        buffer.fill('\0');
+
+        QCOMPARE(props.value(PropertyId::ContentType).toString(), QStringLiteral("a"));
+        QCOMPARE(props.value(PropertyId::CorrelationData).toByteArray(), QByteArray::fromHex("beef"));
+        QCOMPARE(props.userProperties().count(), 1);
+        QCOMPARE(props.userProperties().first(), ::Mqtt::UserProperty(QStringLiteral("k"), QStringLiteral("v")));
+        QCOMPARE(props.count(), 5);
+    }
+}
+
+void Properties::testLazyWritesEncodedSpanBack()
+{
+    const QByteArray data = QByteArray::fromHex("0200000e10")       // message expiry interval 3600
+                          + QByteArray::fromHex("03000161")         // content type "a"
+                          + QByteArray::fromHex("2600016b000176");  // user property k=v
+
+    ::Mqtt::Properties lazy;
+    QVERIFY(decode(data, lazy, ::Mqtt::Properties::Decoding::LazyShared));
+
+    // encoded span is written as it was received
+    const QByteArray expected = QByteArray(1, char(data.size())) + data;
+    QVERIFY2(encode(lazy) == expected, "encoded properties must be written back without decoding");
+
+    ::Mqtt::Properties eager;
+    QVERIFY(decode(data, eager, ::Mqtt::Properties::Decoding::Eager));
+    QVERIFY2(encode(eager) == expected, "decoded properties must be encoded in the same order");
+}
+
+void Properties::testDecodeEncodedAfterSetAndRemove()
+{
+    const QByteArray data = QByteArray::fromHex("03000161")         // content type "a"
+                          + QByteArray::fromHex("08000174")         // response topic "t"
+                          + QByteArray::fromHex("2600016b000176")   // user property k=v
+                          + QByteArray::fromHex("0b05");            // subscription identifier 5
+
+    ::Mqtt::Properties props;
+    QVERIFY(decode(data, props, ::Mqtt::Properties::Decoding::Lazy));
+    QCOMPARE(props.count(), 4);
+
+    // changed property decodes the rest, nothing is lost or duplicated
+    props.set(PropertyId::ContentType, QStringLiteral("b"));
+    QCOMPARE(props.count(), 4);
+    QCOMPARE(props.value(PropertyId::ContentType).toString(), QStringLiteral("b"));
+    QCOMPARE(props.value(PropertyId::ResponseTopic).toString(), QStringLiteral("t"));
+
+    props.remove(PropertyId::ResponseTopic);
+    QCOMPARE(props.count(), 3);
+    QVERIFY(!props.contains(PropertyId::ResponseTopic));
+    QCOMPARE(props.userProperties().count(), 1);
+    QCOMPARE(props.subscriptionIdentifiers().count(), 1);
+
+    ::Mqtt::Properties other;
+    QVERIFY(decode(data, other, ::Mqtt::Properties::Decoding::Lazy));
+    other.remove(PropertyId::UserProperty);
+    QCOMPARE(other.count(), 3);
+    QCOMPARE(other.value(PropertyId::ContentType).toString(), QStringLiteral("a"));
+
+    // re-encoded properties are decoded to the same values
+    const QByteArray encoded = encode(props);
+    ::Mqtt::Properties decoded;
+    QVERIFY(decode(encoded.mid(1), decoded, ::Mqtt::Properties::Decoding::Eager));
+    QCOMPARE(decoded.count(), 3);
+    QCOMPARE(decoded.value(PropertyId::ContentType).toString(), QStringLiteral("b"));
+    QCOMPARE(decoded.userProperties().first(), ::Mqtt::UserProperty(QStringLiteral("k"), QStringLiteral("v")));
+    QCOMPARE(decoded.subscriptionIdentifiers().first(), 5u);
+}
+
+QTEST_MAIN(Test::Mqtt::Properties)
+#include "test_mqtt_properties.moc"
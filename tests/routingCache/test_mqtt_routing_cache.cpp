@@ -0,0 +1,124 @@
+#include <QTest>
+#include <mqtt_routing_cache.h>
+
+namespace Test
+{
+    namespace Mqtt
+    {
+        class RoutingCache : public QObject
+        {
+            Q_OBJECT
+        private slots:
+            void init();
+            void testSubscribeInvalidatesMatchingRoutes();
+            void testUnsubscribeInvalidatesExactRoute();
+            void testSessionRemovalInvalidatesRoutesOfAllFilters();
+            void testWildcardFilterKeepsSystemRoutes();
+            void testEvictionKeepsInvalidationConsistent();
+            void cleanup();
+
+        private:
+            void addRoute(const QString & topic);
+            bool hasRoute(const QString & topic);
+
+        private:
+            ::Mqtt::RoutingCache * cache = Q_NULLPTR;
+        };
+    }
+}
+
+using namespace Test::Mqtt;
+
+void RoutingCache::init()
+{
+    cache = new ::Mqtt::RoutingCache(16);
+    for (auto topic: { "home/kitchen/temp", "home/kitchen/light", "home/hall/temp", "office/temp", "$SYS/broker/load" })
+        addRoute(QString::fromLatin1(topic));
+}
+
+void RoutingCache::addRoute(const QString & topic)
+{
+    cache->insert(::Mqtt::TopicName(topic), ::Mqtt::Topic(topic));
+}
+
+bool RoutingCache::hasRoute(const QString & topic)
+{
+    return (cache->find(::Mqtt::TopicName(topic)) != Q_NULLPTR);
+}
+
+void RoutingCache::testSubscribeInvalidatesMatchingRoutes()
+{
+    // broker invalidates routes by filter of new subscription
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("home/+/temp")));
+
+    QVERIFY2(!hasRoute(QStringLiteral("home/kitchen/temp"))  , "route matched by subscribed filter must be invalidated");
+    QVERIFY2(!hasRoute(QStringLiteral("home/hall/temp"))     , "route matched by subscribed filter must be invalidated");
+    QVERIFY2( hasRoute(QStringLiteral("home/kitchen/light")) , "route not matched by subscribed filter must be kept");
+    QVERIFY2( hasRoute(QStringLiteral("office/temp"))        , "route of other first level must be kept");
+    QCOMPARE(cache->count(), 3);
+}
+
+void RoutingCache::testUnsubscribeInvalidatesExactRoute()
+{
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("office/temp")));
+
+    QVERIFY2(!hasRoute(QStringLiteral("office/temp"))        , "route of unsubscribed filter must be invalidated");
+    QCOMPARE(cache->count(), 4);
+
+    // filter which has never been used does not touch cache
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("garage/door")));
+    QCOMPARE(cache->count(), 4);
+}
+
+void RoutingCache::testSessionRemovalInvalidatesRoutesOfAllFilters()
+{
+    // removed session unindexes every filter it was subscribed to
+    for (auto filter: { "home/kitchen/#", "office/temp" })
+        cache->invalidate(::Mqtt::Topic(QString::fromLatin1(filter)));
+
+    QVERIFY2(!hasRoute(QStringLiteral("home/kitchen/temp"))  , "route of removed session filter must be invalidated");
+    QVERIFY2(!hasRoute(QStringLiteral("home/kitchen/light")) , "route of removed session filter must be invalidated");
+    QVERIFY2(!hasRoute(QStringLiteral("office/temp"))        , "route of removed session filter must be invalidated");
+    QVERIFY2( hasRoute(QStringLiteral("home/hall/temp"))     , "route of other filters must be kept");
+    QCOMPARE(cache->count(), 2);
+}
+
+void RoutingCache::testWildcardFilterKeepsSystemRoutes()
+{
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("+/temp")));
+    QVERIFY2(!hasRoute(QStringLiteral("office/temp"))        , "route matched by filter started with wildcard must be invalidated");
+    QCOMPARE(cache->count(), 4);
+
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("#")));
+    QVERIFY2( hasRoute(QStringLiteral("$SYS/broker/load"))   , "system route must not be invalidated by filter started with wildcard");
+    QCOMPARE(cache->count(), 1);
+
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("$SYS/#")));
+    QCOMPARE(cache->count(), 0);
+}
+
+void RoutingCache::testEvictionKeepsInvalidationConsistent()
+{
+    cache->setCapacity(3);
+    QCOMPARE(cache->count(), 3);
+
+    // least recently used routes are evicted, invalidation must not see them
+    addRoute(QStringLiteral("home/garage/temp"));
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("home/#")));
+    QVERIFY2(!hasRoute(QStringLiteral("home/garage/temp"))   , "route added after eviction must be invalidated");
+
+    addRoute(QStringLiteral("home/garage/temp"));
+    QVERIFY2( hasRoute(QStringLiteral("home/garage/temp"))   , "invalidated route must be cached again");
+    cache->clear();
+    QCOMPARE(cache->count(), 0);
+    cache->invalidate(::Mqtt::Topic(QStringLiteral("home/#")));
+}
+
+void RoutingCache::cleanup()
+{
+    delete cache;
+    cache = Q_NULLPTR;
+}
+
+QTEST_MAIN(Test::Mqtt::RoutingCache)
+#include "test_mqtt_routing_cache.moc"
@@ -0,0 +1,119 @@
+#include <QTest>
+#include <mqtt_subscriptions_shared.h>
+#include <algorithm>
+
+namespace Test
+{
+    namespace Mqtt
+    {
+        class SharedSubscriptions : public QObject
+        {
+            Q_OBJECT
+        private slots:
+            void initTestCase();
+            void testStickyDoesNotDependOnOrder();
+            void testStickyLeaveMovesOnlyOwnTopics();
+            void testStickyJoinTakesOnlyItsTopics();
+            void testStickyDistribution();
+
+        private:
+            static ::Mqtt::SharedSubscriptionMember member(int n);
+            uint owner(const ::Mqtt::SharedSubscriptionMembersList & members, uint topicHash) const;
+
+        private:
+            ::Mqtt::SharedSubscriptionMembersList members;
+            QVector<uint> topics;
+        };
+    }
+}
+
+using namespace Test::Mqtt;
+
+::Mqtt::SharedSubscriptionMember SharedSubscriptions::member(int n)
+{
+    // selection uses client hash only, member without session is enough for it
+    ::Mqtt::SharedSubscriptionMember m;
+    m.key = reinterpret_cast<::Mqtt::Session*>(quintptr(n + 1));
+    m.clientHash = qHash(QStringLiteral("client-%1").arg(n));
+    return m;
+}
+
+uint SharedSubscriptions::owner(const ::Mqtt::SharedSubscriptionMembersList & members, uint topicHash) const
+{
+    int i = ::Mqtt::SharedSubscriptionGroup::stickyIndex(members, topicHash);
+    return (i < 0 ? 0 : members.at(i).clientHash);
+}
+
+void SharedSubscriptions::initTestCase()
+{
+    for (int n = 0; n < 8; ++n)
+        members.append(member(n));
+    for (int t = 0; t < 2000; ++t)
+        topics.append(qHash(QStringLiteral("factory/line/%1/state").arg(t)));
+}
+
+void SharedSubscriptions::testStickyDoesNotDependOnOrder()
+{
+    ::Mqtt::SharedSubscriptionMembersList reversed = members;
+    std::reverse(reversed.begin(), reversed.end());
+
+    for (uint topic: topics)
+        QVERIFY2(owner(members, topic) == owner(reversed, topic), "owner of topic must not depend on order of members");
+
+    QVERIFY2(::Mqtt::SharedSubscriptionGroup::stickyIndex(::Mqtt::SharedSubscriptionMembersList(), topics.first()) == -1, "empty group has no owner");
+}
+
+void SharedSubscriptions::testStickyLeaveMovesOnlyOwnTopics()
+{
+    const uint leaving = members.at(3).clientHash;
+    // member disconnects and rest of connected list is reordered
+    ::Mqtt::SharedSubscriptionMembersList rest = members;
+    rest.removeAt(3);
+    rest.move(0, rest.count() - 1);
+
+    int moved = 0;
+    for (uint topic: topics) {
+        const uint before = owner(members, topic);
+        const uint after  = owner(rest, topic);
+        if (before != leaving)
+            QVERIFY2(before == after, "topic of member which stays must not move");
+        else
+            ++moved;
+        QVERIFY2(after != leaving, "topic must not go to left member");
+    }
+    QVERIFY2(moved > 0, "left member must have owned some topics");
+}
+
+void SharedSubscriptions::testStickyJoinTakesOnlyItsTopics()
+{
+    ::Mqtt::SharedSubscriptionMembersList joined = members;
+    joined.prepend(member(100));
+    const uint joining = joined.first().clientHash;
+
+    int taken = 0;
+    for (uint topic: topics) {
+        const uint before = owner(members, topic);
+        const uint after  = owner(joined, topic);
+        if (after == joining)
+            ++taken;
+        else
+            QVERIFY2(before == after, "topic must stay with its owner or move to joined member");
+    }
+    QVERIFY2(taken > 0, "joined member must take some topics");
+    QVERIFY2(taken < topics.count() / 4, "joined member must take about its share of topics");
+}
+
+void SharedSubscriptions::testStickyDistribution()
+{
+    QHash<uint, int> counts;
+    for (uint topic: topics)
+        ++counts[owner(members, topic)];
+
+    QCOMPARE(counts.count(), members.count());
+    const int share = topics.count() / members.count();
+    for (int count: counts)
+        QVERIFY2(count > share / 2 && count < share * 2, "topics must be spread between members");
+}
+
+QTEST_MAIN(Test::Mqtt::SharedSubscriptions)
+#include "test_mqtt_shared_subscriptions.moc"
@@ -0,0 +1,130 @@
+#include <QTest>
+#include <mqtt_text_validator.h>
+#include <set>
+
+namespace Test
+{
+    namespace Mqtt
+    {
+        class TextValidator : public QObject
+        {
+            Q_OBJECT
+        private slots:
+            void testFlags_data();
+            void testFlags();
+            void testBlockBoundaries_data();
+            void testBlockBoundaries();
+
+        private:
+            // ASCII filler of given size with sequence placed at position
+            static QByteArray place(int size, int position, const QByteArray & sequence);
+        };
+    }
+}
+
+using namespace Test::Mqtt;
+using Flags = ::Mqtt::TextValidator::Flags;
+
+QByteArray TextValidator::place(int size, int position, const QByteArray & sequence)
+{
+    QByteArray data(size, 'a');
+    data.replace(position, sequence.size(), sequence);
+    return data;
+}
+
+void TextValidator::testFlags_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("flags");
+
+    QTest::newRow("empty")                    << QByteArray()                        << int(Flags::Valid);
+    QTest::newRow("ascii")                    << QByteArray("sensors/room/1")        << int(Flags::Valid);
+    QTest::newRow("two byte")                 << QByteArray::fromHex("c3bf")         << int(Flags::NonAscii);
+    QTest::newRow("three byte")               << QByteArray::fromHex("e282ac")       << int(Flags::NonAscii);
+    QTest::newRow("four byte")                << QByteArray::fromHex("f09f9880")     << int(Flags::NonAscii);
+    QTest::newRow("null")                     << QByteArray("a\0b", 3)               << int(Flags::Null);
+    QTest::newRow("plus")                     << QByteArray("a/+/b")                 << int(Flags::Wildcard);
+    QTest::newRow("hash")                     << QByteArray("a/#")                   << int(Flags::Wildcard);
+    QTest::newRow("U+0001")                   << QByteArray("\x01")                  << int(Flags::Control);
+    QTest::newRow("U+001F")                   << QByteArray("\x1f")                  << int(Flags::Control);
+    QTest::newRow("U+007F")                   << QByteArray("\x7f")                  << int(Flags::Control);
+    QTest::newRow("U+0080")                   << QByteArray::fromHex("c280")         << int(Flags::Control | Flags::NonAscii);
+    QTest::newRow("U+009F")                   << QByteArray::fromHex("c29f")         << int(Flags::Control | Flags::NonAscii);
+    QTest::newRow("U+00A0")                   << QByteArray::fromHex("c2a0")         << int(Flags::NonAscii);
+    QTest::newRow("U+FDD0")                   << QByteArray::fromHex("efb790")       << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+FDEF")                   << QByteArray::fromHex("efb7af")       << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+FDF0")                   << QByteArray::fromHex("efb7b0")       << int(Flags::NonAscii);
+    QTest::newRow("U+FFFE")                   << QByteArray::fromHex("efbfbe")       << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+FFFF")                   << QByteArray::fromHex("efbfbf")       << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+1FFFF")                  << QByteArray::fromHex("f09fbfbf")     << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+10FFFE")                 << QByteArray::fromHex("f48fbfbe")     << int(Flags::NonCharacter | Flags::NonAscii);
+    QTest::newRow("U+1FFFD")                  << QByteArray::fromHex("f09fbfbd")     << int(Flags::NonAscii);
+    QTest::newRow("lone continuation")        << QByteArray::fromHex("80")           << int(Flags::Malformed | Flags::NonAscii);
+    QTest::newRow("overlong two byte")        << QByteArray::fromHex("c0af")         << int(Flags::Malformed | Flags::NonAscii);
+    QTest::newRow("overlong three byte")      << QByteArray::fromHex("e080af")       << int(Flags::Malformed | Flags::NonAscii);
+    QTest::newRow("surrogate")                << QByteArray::fromHex("eda080")       << int(Flags::Malformed | Flags::NonAscii);
+    QTest::newRow("above U+10FFFF")           << QByteArray::fromHex("f4908080")     << int(Flags::Malformed | Flags::NonAscii);
+    QTest::newRow("truncated")                << QByteArray::fromHex("e282")         << int(Flags::Malformed | Flags::NonAscii);
+}
+
+void TextValidator::testFlags()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, flags);
+
+    QCOMPARE(int(::Mqtt::TextValidator::scanUtf8(data.constData(), data.size())), flags);
+}
+
+void TextValidator::testBlockBoundaries_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<int>("flags");
+
+    // vector code checks 16 and 32 byte blocks, scalar code checks the tail and blocks with multibyte sequences
+    const QList<QPair<QByteArray, int>> sequences = {
+         { QByteArray(1, '\0')              , int(Flags::Null)                              }
+        ,{ QByteArray("+")                  , int(Flags::Wildcard)                          }
+        ,{ QByteArray("#")                  , int(Flags::Wildcard)                          }
+        ,{ QByteArray("\x01")               , int(Flags::Control)                           }
+        ,{ QByteArray("\x7f")               , int(Flags::Control)                           }
+        ,{ QByteArray::fromHex("c3bf")      , int(Flags::NonAscii)                          }
+        ,{ QByteArray::fromHex("e282ac")    , int(Flags::NonAscii)                          }
+        ,{ QByteArray::fromHex("f09f9880")  , int(Flags::NonAscii)                          }
+        ,{ QByteArray::fromHex("efbfbf")    , int(Flags::NonCharacter | Flags::NonAscii)   }
+        ,{ QByteArray::fromHex("e282")      , int(Flags::Malformed | Flags::NonAscii)      }
+    };
+
+    for (int size: { 15, 16, 17, 31, 32, 33, 48, 64, 65 }) {
+        for (const auto & sequence: sequences) {
+            std::set<int> positions;
+            // sequence starts at boundary or ends right before it
+            for (int boundary: { 0, 15, 16, 31, 32, 47, 48, 63, 64 }) {
+                positions.insert(boundary);
+                positions.insert(boundary - sequence.first.size());
+            }
+            for (int position: positions) {
+                if (position < 0 || position + sequence.first.size() > size)
+                    continue;
+                const QByteArray row = QStringLiteral("%1 bytes, %2 at %3").arg(size).arg(QString::fromLatin1(sequence.first.toHex())).arg(position).toLatin1();
+                QTest::newRow(row.constData()) << place(size, position, sequence.first) << sequence.second;
+            }
+        }
+    }
+
+    // sequence which is cut by the end of string
+    for (int size: { 15, 16, 17, 31, 32, 33 }) {
+        const QByteArray row = QStringLiteral("%1 bytes, truncated at end").arg(size).toLatin1();
+        QTest::newRow(row.constData()) << place(size, size - 2, QByteArray::fromHex("f09f")) << int(Flags::Malformed | Flags::NonAscii);
+    }
+}
+
+void TextValidator::testBlockBoundaries()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(int, flags);
+
+    QCOMPARE(int(::Mqtt::TextValidator::scanUtf8(data.constData(), data.size())), flags);
+}
+
+QTEST_MAIN(Test::Mqtt::TextValidator)
+#include "test_mqtt_text_validator.moc"